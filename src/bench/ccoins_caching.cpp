@@ -5,9 +5,12 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
+#include <tinyformat.h>
 
+#include <iostream>
 #include <vector>
 
 // Microbenchmark for simple accesses to a CCoinsViewCache database. Note from
@@ -51,4 +54,59 @@ static void CCoinsCaching(benchmark::Bench& bench)
     ECC_Stop();
 }
 
+static constexpr size_t NUM_CACHE_COINS = 100000;
+
+static std::vector<COutPoint> RandomOutpoints(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+    }
+    return outpoints;
+}
+
+static void FillCache(CCoinsViewCache& cache, const std::vector<COutPoint>& outpoints)
+{
+    for (const COutPoint& outpoint : outpoints) {
+        // A P2WPKH output, whose script is stored inline in the Coin.
+        Coin coin(CTxOut(1000, CScript() << OP_0 << std::vector<unsigned char>(20, 1)), 1, false);
+        cache.AddCoin(outpoint, std::move(coin), false);
+    }
+}
+
+// Insert coins into an empty CCoinsViewCache, and report the memory the cache
+// accounts for per coin afterwards.
+static void CCoinsCacheInsert(benchmark::Bench& bench)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(NUM_CACHE_COINS);
+    CCoinsView coins_dummy;
+    size_t usage = 0;
+    bench.batch(outpoints.size()).unit("coin").run([&] {
+        CCoinsViewCache cache(&coins_dummy);
+        FillCache(cache, outpoints);
+        usage = cache.DynamicMemoryUsage();
+    });
+    tfm::format(std::cout, "CCoinsCacheInsert: %.1f bytes per coin (%u coins, %u bytes)\n",
+        double(usage) / outpoints.size(), outpoints.size(), usage);
+}
+
+// Look up coins that are all present in a CCoinsViewCache.
+static void CCoinsCacheLookup(benchmark::Bench& bench)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(NUM_CACHE_COINS);
+    CCoinsView coins_dummy;
+    CCoinsViewCache cache(&coins_dummy);
+    FillCache(cache, outpoints);
+    bench.batch(outpoints.size()).unit("coin").run([&] {
+        for (const COutPoint& outpoint : outpoints) {
+            bool found = !cache.AccessCoin(outpoint).IsSpent();
+            assert(found);
+        }
+    });
+}
+
 BENCHMARK(CCoinsCaching);
+BENCHMARK(CCoinsCacheInsert);
+BENCHMARK(CCoinsCacheLookup);
@@ -24,7 +24,7 @@ static const unsigned int QUEUE_BATCH_SIZE = 128;
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
+static void RunCheckQueuePrevectorJobs(benchmark::Bench& bench, int num_threads)
 {
     const ECCVerifyHandle verify_handle;
     ECC_Start();
@@ -44,7 +44,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
     };
     CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    for (auto x = 0; x < num_threads; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
 
@@ -71,4 +71,27 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
     tg.join_all();
     ECC_Stop();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
+{
+    RunCheckQueuePrevectorJobs(bench, std::max(MIN_CORES, GetNumCores()));
+}
+
+// The same workload with a fixed number of worker threads, to show how the
+// queue scales.
+static void CCheckQueuePrevectorJob_1_THREAD(benchmark::Bench& bench) { RunCheckQueuePrevectorJobs(bench, 1); }
+static void CCheckQueuePrevectorJob_2_THREADS(benchmark::Bench& bench) { RunCheckQueuePrevectorJobs(bench, 2); }
+static void CCheckQueuePrevectorJob_4_THREADS(benchmark::Bench& bench) { RunCheckQueuePrevectorJobs(bench, 4); }
+static void CCheckQueuePrevectorJob_8_THREADS(benchmark::Bench& bench) { RunCheckQueuePrevectorJobs(bench, 8); }
+static void CCheckQueuePrevectorJob_16_THREADS(benchmark::Bench& bench) { RunCheckQueuePrevectorJobs(bench, 16); }
+static void CCheckQueuePrevectorJob_32_THREADS(benchmark::Bench& bench) { RunCheckQueuePrevectorJobs(bench, 32); }
+static void CCheckQueuePrevectorJob_64_THREADS(benchmark::Bench& bench) { RunCheckQueuePrevectorJobs(bench, 64); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueuePrevectorJob_1_THREAD);
+BENCHMARK(CCheckQueuePrevectorJob_2_THREADS);
+BENCHMARK(CCheckQueuePrevectorJob_4_THREADS);
+BENCHMARK(CCheckQueuePrevectorJob_8_THREADS);
+BENCHMARK(CCheckQueuePrevectorJob_16_THREADS);
+BENCHMARK(CCheckQueuePrevectorJob_32_THREADS);
+BENCHMARK(CCheckQueuePrevectorJob_64_THREADS);
@@ -61,6 +61,15 @@ static void SHA256D64_1024(benchmark::Bench& bench)
     });
 }
 
+static void SHA256D80_1024(benchmark::Bench& bench)
+{
+    std::vector<uint8_t> in(80 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    bench.batch(in.size()).unit("byte").run([&] {
+        SHA256D80(out.data(), in.data(), 1024);
+    });
+}
+
 static void SHA512(benchmark::Bench& bench)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -103,5 +112,6 @@ BENCHMARK(SHA512);
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
 BENCHMARK(SHA256D64_1024);
+BENCHMARK(SHA256D80_1024);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
@@ -14,8 +14,7 @@
 
 #include <array>
 
-// Microbenchmark for verification of a basic P2WPKH script. Can be easily
-// modified to measure performance of other types of scripts.
+// Microbenchmark for verification of a basic P2WPKH script.
 static void VerifyScriptBench(benchmark::Bench& bench)
 {
     const ECCVerifyHandle verify_handle;
@@ -75,9 +74,98 @@ static void VerifyScriptBench(benchmark::Bench& bench)
     ECC_Stop();
 }
 
+static CKey BenchKey(unsigned char n)
+{
+    std::array<unsigned char, 32> vchKey{};
+    vchKey[31] = n;
+    CKey key;
+    key.Set(vchKey.begin(), vchKey.end(), true);
+    return key;
+}
+
+static std::vector<unsigned char> BenchSign(const CKey& key, const CScript& scriptCode, const CMutableTransaction& txSpend, const CMutableTransaction& txCredit, SigVersion sigversion)
+{
+    std::vector<unsigned char> sig;
+    key.Sign(SignatureHash(scriptCode, txSpend, 0, SIGHASH_ALL, txCredit.vout[0].nValue, sigversion), sig);
+    sig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    return sig;
+}
+
+static void BenchVerifySpend(benchmark::Bench& bench, const CMutableTransaction& txSpend, const CMutableTransaction& txCredit)
+{
+    const int flags = SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH;
+    bench.run([&] {
+        ScriptError err;
+        bool success = VerifyScript(
+            txSpend.vin[0].scriptSig,
+            txCredit.vout[0].scriptPubKey,
+            &txSpend.vin[0].scriptWitness,
+            flags,
+            MutableTransactionSignatureChecker(&txSpend, 0, txCredit.vout[0].nValue),
+            &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+    });
+}
+
+// Verification of a P2PKH spend.
+static void VerifyScriptP2PKH(benchmark::Bench& bench)
+{
+    const ECCVerifyHandle verify_handle;
+    ECC_Start();
+
+    const CKey key = BenchKey(1);
+    const CPubKey pubkey = key.GetPubKey();
+    const CScript scriptPubKey = GetScriptForDestination(PKHash(pubkey));
+    const CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+    txSpend.vin[0].scriptSig << BenchSign(key, scriptPubKey, txSpend, txCredit, SigVersion::BASE) << ToByteVector(pubkey);
+
+    BenchVerifySpend(bench, txSpend, txCredit);
+    ECC_Stop();
+}
+
+// Verification of a 2-of-3 multisig P2WSH spend.
+static void VerifyScriptP2WSHMultisig(benchmark::Bench& bench)
+{
+    const ECCVerifyHandle verify_handle;
+    ECC_Start();
+
+    const std::vector<CKey> keys{BenchKey(1), BenchKey(2), BenchKey(3)};
+    const CScript witnessScript = GetScriptForMultisig(2, {keys[0].GetPubKey(), keys[1].GetPubKey(), keys[2].GetPubKey()});
+    const CScript scriptPubKey = GetScriptForDestination(WitnessV0ScriptHash(witnessScript));
+    const CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey, 1);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+    CScriptWitness& witness = txSpend.vin[0].scriptWitness;
+    witness.stack.emplace_back();
+    witness.stack.push_back(BenchSign(keys[0], witnessScript, txSpend, txCredit, SigVersion::WITNESS_V0));
+    witness.stack.push_back(BenchSign(keys[1], witnessScript, txSpend, txCredit, SigVersion::WITNESS_V0));
+    witness.stack.emplace_back(witnessScript.begin(), witnessScript.end());
+
+    BenchVerifySpend(bench, txSpend, txCredit);
+    ECC_Stop();
+}
+
+// Evaluation of a large bare script that only moves data around the stack:
+// 100 pushes of public key sized elements, each duplicated and dropped.
+static void VerifyLargeBareScript(benchmark::Bench& bench)
+{
+    CScript script;
+    for (int i = 0; i < 100; ++i) {
+        script << std::vector<unsigned char>(33, i + 1) << OP_DUP << OP_DROP;
+    }
+    bench.run([&] {
+        ScriptStack stack;
+        ScriptError error;
+        bool ret = EvalScript(stack, script, 0, BaseSignatureChecker(), SigVersion::BASE, &error);
+        assert(ret);
+        assert(stack.size() == 100);
+    });
+}
+
 static void VerifyNestedIfScript(benchmark::Bench& bench)
 {
-    std::vector<std::vector<unsigned char>> stack;
+    ScriptStack stack;
     CScript script;
     for (int i = 0; i < 100; ++i) {
         script << OP_1 << OP_IF;
@@ -97,4 +185,7 @@ static void VerifyNestedIfScript(benchmark::Bench& bench)
 }
 
 BENCHMARK(VerifyScriptBench);
+BENCHMARK(VerifyScriptP2PKH);
+BENCHMARK(VerifyScriptP2WSHMultisig);
+BENCHMARK(VerifyLargeBareScript);
 BENCHMARK(VerifyNestedIfScript);
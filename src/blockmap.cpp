@@ -0,0 +1,74 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmap.h>
+
+#include <algorithm>
+
+constexpr size_t BlockMap::MAX_LOAD_NUM;
+constexpr size_t BlockMap::MAX_LOAD_DEN;
+constexpr size_t BlockMap::MIN_CHUNK_ENTRIES;
+
+BlockMap::const_iterator BlockMap::find(const uint256& hash) const
+{
+    if (m_table.empty()) return end();
+    const size_t pos = Position(hash);
+    if (!m_table[pos]) return end();
+    return {m_table.data() + pos, m_table.data() + m_table.size()};
+}
+
+size_t BlockMap::Position(const uint256& hash) const
+{
+    const size_t mask = m_table.size() - 1;
+    size_t pos = BlockHasher()(hash) & mask;
+    while (m_table[pos] && *m_table[pos]->phashBlock != hash) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+void BlockMap::Rehash(size_t slots)
+{
+    size_t size = 16;
+    while (size < slots) size *= 2;
+    std::vector<CBlockIndex*> table(size, nullptr);
+    m_table.swap(table);
+    for (CBlockIndex* pindex : table) {
+        if (pindex) m_table[Position(*pindex->phashBlock)] = pindex;
+    }
+}
+
+void BlockMap::AddChunk(size_t entries)
+{
+    m_chunks.emplace_back(new Entry[entries]);
+    m_chunk_size = entries;
+    m_chunk_used = 0;
+}
+
+BlockMap::Entry& BlockMap::NewEntry()
+{
+    if (m_chunk_used == m_chunk_size) {
+        // Grow with the map, so that the number of chunks stays small.
+        AddChunk(std::max(MIN_CHUNK_ENTRIES, m_size / 4));
+    }
+    return m_chunks.back()[m_chunk_used++];
+}
+
+void BlockMap::reserve(size_t count)
+{
+    if (count <= m_size) return;
+    if (count * MAX_LOAD_DEN > m_table.size() * MAX_LOAD_NUM) {
+        Rehash(count * MAX_LOAD_DEN / MAX_LOAD_NUM + 1);
+    }
+    if (m_chunk_size - m_chunk_used < count - m_size) AddChunk(count - m_size);
+}
+
+void BlockMap::clear()
+{
+    std::vector<CBlockIndex*>().swap(m_table);
+    m_chunks.clear();
+    m_chunk_size = 0;
+    m_chunk_used = 0;
+    m_size = 0;
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKMAP_H
+#define BITCOIN_BLOCKMAP_H
+
+#include <chain.h>
+#include <crypto/common.h> // for ReadLE64
+#include <uint256.h>
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct BlockHasher
+{
+    // this used to call `GetCheapHash()` in uint256, which was later moved; the
+    // cheap hash function simply calls ReadLE64() however, so the end result is
+    // identical
+    size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
+};
+
+/**
+ * The block index: CBlockIndex entries by block hash.
+ *
+ * Entries are stored, along with the hash their phashBlock points to, in
+ * chunks of contiguous memory owned by the map, and are only freed all at
+ * once by clear(). Lookups go through an open addressing table of pointers to
+ * the entries, with linear probing. Compared to an unordered_map of separately
+ * allocated entries, this saves two heap allocations and the node overhead
+ * per block, which adds up for the hundreds of thousands of headers in the
+ * block tree, and keeps entries added together close in memory.
+ *
+ * The interface is the subset of std::unordered_map that the block index
+ * needs, with (hash, entry) pairs as values. Entries are never erased
+ * individually.
+ */
+class BlockMap
+{
+public:
+    using value_type = std::pair<const uint256&, CBlockIndex*>;
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = BlockMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+        struct pointer {
+            value_type value;
+            const value_type* operator->() const { return &value; }
+        };
+
+        const_iterator(CBlockIndex* const* slot, CBlockIndex* const* end) : m_slot(slot), m_end(end) { SkipEmpty(); }
+
+        value_type operator*() const { return {*(*m_slot)->phashBlock, *m_slot}; }
+        pointer operator->() const { return pointer{**this}; }
+        const_iterator& operator++() { ++m_slot; SkipEmpty(); return *this; }
+        const_iterator operator++(int) { const_iterator ret = *this; ++*this; return ret; }
+        bool operator==(const const_iterator& other) const { return m_slot == other.m_slot; }
+        bool operator!=(const const_iterator& other) const { return m_slot != other.m_slot; }
+
+    private:
+        void SkipEmpty() { while (m_slot != m_end && !*m_slot) ++m_slot; }
+
+        CBlockIndex* const* m_slot;
+        CBlockIndex* const* m_end;
+    };
+    //! Entries are handed out as non-const pointers either way, like the
+    //! mapped values of a const std::unordered_map<uint256, CBlockIndex*>.
+    using iterator = const_iterator;
+
+    BlockMap() = default;
+    BlockMap(const BlockMap&) = delete;
+    BlockMap& operator=(const BlockMap&) = delete;
+
+    const_iterator begin() const { return {m_table.data(), m_table.data() + m_table.size()}; }
+    const_iterator end() const { return {m_table.data() + m_table.size(), m_table.data() + m_table.size()}; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const_iterator find(const uint256& hash) const;
+    size_t count(const uint256& hash) const { return find(hash) != end() ? 1 : 0; }
+
+    /**
+     * Add an entry for hash, constructed from args, unless there is one
+     * already. The new entry's phashBlock points to its key.
+     *
+     * @returns the entry for hash, and whether it was added.
+     */
+    template <typename... Args>
+    std::pair<const_iterator, bool> try_emplace(const uint256& hash, Args&&... args)
+    {
+        if ((m_size + 1) * MAX_LOAD_DEN > m_table.size() * MAX_LOAD_NUM) Rehash(m_table.size() * 2);
+        const size_t pos = Position(hash);
+        const bool inserted = !m_table[pos];
+        if (inserted) {
+            Entry& entry = NewEntry();
+            entry.hash = hash;
+            entry.index = CBlockIndex(std::forward<Args>(args)...);
+            entry.index.phashBlock = &entry.hash;
+            m_table[pos] = &entry.index;
+            ++m_size;
+        }
+        return {const_iterator{m_table.data() + pos, m_table.data() + m_table.size()}, inserted};
+    }
+
+    /** Make room for count entries, which are then stored contiguously. */
+    void reserve(size_t count);
+
+    /** Remove and free all entries. */
+    void clear();
+
+private:
+    struct Entry {
+        CBlockIndex index;
+        uint256 hash;
+    };
+
+    //! Maximum load factor of the table, as a fraction.
+    static constexpr size_t MAX_LOAD_NUM = 3;
+    static constexpr size_t MAX_LOAD_DEN = 4;
+    //! Smallest number of entries allocated at once.
+    static constexpr size_t MIN_CHUNK_ENTRIES = 1024;
+
+    //! Slot of the table holding hash, or the empty slot where it belongs.
+    size_t Position(const uint256& hash) const;
+    //! Resize the table to slots slots (at least the minimum, rounded to a power of two).
+    void Rehash(size_t slots);
+    void AddChunk(size_t entries);
+    Entry& NewEntry();
+
+    std::vector<std::unique_ptr<Entry[]>> m_chunks;
+    //! Number of entries in, and used of, the last chunk.
+    size_t m_chunk_size{0};
+    size_t m_chunk_used{0};
+    //! Power of two sized table of pointers to the entries, nullptr for empty slots.
+    std::vector<CBlockIndex*> m_table;
+    size_t m_size{0};
+};
+
+#endif // BITCOIN_BLOCKMAP_H
@@ -37,6 +37,11 @@ static constexpr int64_t TIMESTAMP_WINDOW = MAX_FUTURE_BLOCK_TIME;
  */
 static constexpr int64_t MAX_BLOCK_TIME_GAP = 90 * 60;
 
+enum BlockFileFlags : uint32_t {
+    //! The records of the blk and rev file are compressed (see BLOCK_RECORD_COMPRESSED).
+    BLOCK_FILE_COMPRESSED = 1,
+};
+
 class CBlockFileInfo
 {
 public:
@@ -47,16 +52,22 @@ public:
     unsigned int nHeightLast;  //!< highest height of block in file
     uint64_t nTimeFirst;       //!< earliest time of block in file
     uint64_t nTimeLast;        //!< latest time of block in file
+    uint32_t nFlags;           //!< BlockFileFlags of the blk and rev file
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << VARINT(nBlocks) << VARINT(nSize) << VARINT(nUndoSize) << VARINT(nHeightFirst) << VARINT(nHeightLast) << VARINT(nTimeFirst) << VARINT(nTimeLast);
+        s << VARINT(nFlags);
+    }
 
-    SERIALIZE_METHODS(CBlockFileInfo, obj)
+    template <typename Stream>
+    void Unserialize(Stream& s)
     {
-        READWRITE(VARINT(obj.nBlocks));
-        READWRITE(VARINT(obj.nSize));
-        READWRITE(VARINT(obj.nUndoSize));
-        READWRITE(VARINT(obj.nHeightFirst));
-        READWRITE(VARINT(obj.nHeightLast));
-        READWRITE(VARINT(obj.nTimeFirst));
-        READWRITE(VARINT(obj.nTimeLast));
+        s >> VARINT(nBlocks) >> VARINT(nSize) >> VARINT(nUndoSize) >> VARINT(nHeightFirst) >> VARINT(nHeightLast) >> VARINT(nTimeFirst) >> VARINT(nTimeLast);
+        // Entries written by older versions end here.
+        nFlags = 0;
+        if (!s.empty()) s >> VARINT(nFlags);
     }
 
      void SetNull() {
@@ -67,6 +78,7 @@ public:
          nHeightLast = 0;
          nTimeFirst = 0;
          nTimeLast = 0;
+         nFlags = 0;
      }
 
      CBlockFileInfo() {
@@ -133,6 +145,9 @@ enum BlockStatus: uint32_t {
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
  * to it, but at most one of them can be part of the currently active branch.
+ *
+ * The members that ancestor walks and chain selection read come first, so that
+ * they share a cache line.
  */
 class CBlockIndex
 {
@@ -149,29 +164,35 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight{0};
 
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile{0};
-
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos{0};
-
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos{0};
+    //! Verification status of this block. See enum BlockStatus
+    uint32_t nStatus{0};
 
     //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
     arith_uint256 nChainWork{};
 
-    //! Number of transactions in this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied upon
-    unsigned int nTx{0};
-
     //! (memory only) Number of transactions in the chain up to and including this block.
     //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx{0};
 
-    //! Verification status of this block. See enum BlockStatus
-    uint32_t nStatus{0};
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    int32_t nSequenceId{0};
+
+    //! (memory only) Maximum nTime in the chain up to and including this block.
+    unsigned int nTimeMax{0};
+
+    //! Number of transactions in this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied upon
+    unsigned int nTx{0};
+
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile{0};
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos{0};
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos{0};
 
     //! block header
     int32_t nVersion{0};
@@ -180,12 +201,6 @@ public:
     uint32_t nBits{0};
     uint32_t nNonce{0};
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    int32_t nSequenceId{0};
-
-    //! (memory only) Maximum nTime in the chain up to and including this block.
-    unsigned int nTimeMax{0};
-
     CBlockIndex()
     {
     }
@@ -156,6 +156,10 @@ public:
             }
         };
 
+        // No snapshot hashes are shipped for this network, so loadtxoutset
+        // refuses to load a snapshot here.
+        m_assumeutxo_data = MapAssumeutxo{};
+
         chainTxData = ChainTxData{
             // Data from RPC: getchaintxstats 4096 0000000000000000000f2adce67e49b0b6bdeb9de8b7c3d7e93b21e7fc1e819d
             /* nTime    */ 1585764811,
@@ -241,6 +245,10 @@ public:
             }
         };
 
+        // No snapshot hashes are shipped for this network, so loadtxoutset
+        // refuses to load a snapshot here.
+        m_assumeutxo_data = MapAssumeutxo{};
+
         chainTxData = ChainTxData{
             // Data from RPC: getchaintxstats 4096 000000000000056c49030c174179b52a928c870e6e8a822c75973b7970cfbd01
             /* nTime    */ 1585561140,
@@ -313,6 +321,17 @@ public:
             }
         };
 
+        m_assumeutxo_data = MapAssumeutxo{
+            {
+                100,
+                {uint256S("0xd4b614f476b99a6e569973bf1c0120d88b1a168076f8ce25691fb41dd1cef149"), 101},
+            },
+            {
+                110,
+                {uint256S("0x18a6b7a6b3f76dc990aae86e5616fe69909fa7fb003e2b7331476d2f47e48d83"), 111},
+            },
+        };
+
         chainTxData = ChainTxData{
             0,
             0,
@@ -8,6 +8,10 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +20,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+//! Maximum number of work queues of a CCheckQueue. Threads beyond this share queues.
+static const int MAX_CHECKQUEUE_WORK_QUEUES = 64;
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +32,24 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * To keep the threads from contending on a single lock, every thread has a
+  * work queue of its own (the master's is number 0). Add() hands out batches
+  * to the queues in turn, a thread takes work from the back of its own queue
+  * first, and steals from the front of the others' once it runs dry. The
+  * shared mutex is only taken to sleep and to wake threads up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A work queue, owned by one or more threads, that any thread may steal from.
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Mutex to protect the sleeping threads' state
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,86 +58,123 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The work queues. As the order of booleans doesn't matter, they are
+    //! used as stacks by their owners.
+    std::unique_ptr<WorkQueue[]> m_queues;
+
+    //! The number of work queues in use, including the master's.
+    std::atomic<int> m_num_queues{1};
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of threads that called Thread(), which assigns their queues.
+    std::atomic<int> m_num_threads{0};
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The queue the next batch of Add() goes to.
+    int m_next_queue{0};
+
+    //! The number of workers that are idle or about to be.
+    std::atomic<int> m_idle{0};
+
+    //! The number of verifications that are in the work queues, or about to be.
+    std::atomic<unsigned int> m_queued{0};
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> m_all_ok{true};
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but still in a
+     * thread's own batch.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> m_todo{0};
 
     //! The maximum number of elements to be processed in one batch
-    unsigned int nBatchSize;
+    const unsigned int nBatchSize;
+
+    /**
+     * Take a batch of verifications from the back of work queue own, or steal
+     * one from the front of another queue if it is empty.
+     * @returns false if all queues were empty.
+     */
+    bool TakeBatch(int own, std::vector<T>& batch)
+    {
+        const int num_queues = m_num_queues.load();
+        for (int i = 0; i < num_queues; ++i) {
+            const bool steal = i > 0;
+            WorkQueue& work = m_queues[(own + i) % num_queues];
+            std::lock_guard<std::mutex> lock(work.mutex);
+            if (work.checks.empty()) continue;
+            // Do not try to do everything at once, but aim for increasingly
+            // smaller batches so all threads finish approximately
+            // simultaneously, and leave half of a queue to the thieves.
+            const unsigned int now = std::max<unsigned int>(1, std::min<unsigned int>(nBatchSize, work.checks.size() / 2));
+            batch.resize(now);
+            for (T& check : batch) {
+                // Swap jobs out of the queue instead of copying them.
+                if (steal) {
+                    check.swap(work.checks.front());
+                    work.checks.pop_front();
+                } else {
+                    check.swap(work.checks.back());
+                    work.checks.pop_back();
+                }
+            }
+            m_queued -= now;
+            return true;
+        }
+        return false;
+    }
+
+    //! Run a batch, and destroy it before marking its verifications done.
+    void RunBatch(std::vector<T>& batch, bool fMaster)
+    {
+        // Check whether we need to do work at all
+        bool fOk = m_all_ok.load(std::memory_order_relaxed);
+        for (T& check : batch) {
+            if (!fOk) break;
+            fOk = check();
+        }
+        const unsigned int nNow = batch.size();
+        batch.clear();
+        if (!fOk) m_all_ok = false;
+        if (m_todo.fetch_sub(nNow) == nNow && !fMaster) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
 
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const int own = fMaster ? 0 : 1 + m_num_threads++ % (MAX_CHECKQUEUE_WORK_QUEUES - 1);
+        if (!fMaster) {
+            int num_queues = m_num_queues.load();
+            while (num_queues <= own && !m_num_queues.compare_exchange_weak(num_queues, own + 1)) {}
+        }
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+            if (TakeBatch(own, vChecks)) {
+                RunBatch(vChecks, fMaster);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                // Only the master adds work, so once the queues are empty,
+                // all that is left is to wait for the other threads' batches.
+                while (m_todo != 0) {
+                    condMaster.wait(lock);
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                // return the current status, and reset it for new work later
+                return m_all_ok.exchange(true);
+            }
+            // Add() checks m_idle after queueing work, so it is bound to see
+            // this thread about to sleep if it is not seen here.
+            ++m_idle;
+            while (m_queued == 0) {
+                condWorker.wait(lock); // wait
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            --m_idle;
         } while (true);
     }
 
@@ -127,7 +183,7 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : m_queues(new WorkQueue[MAX_CHECKQUEUE_WORK_QUEUES]), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -144,16 +200,30 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty()) return;
+        m_todo += vChecks.size();
+        // Announce the checks before queueing them, so that the count never
+        // drops below the number of checks in the queues.
+        m_queued += vChecks.size();
+        const int num_queues = m_num_queues.load();
+        for (size_t begin = 0; begin < vChecks.size(); begin += nBatchSize) {
+            const size_t end = std::min<size_t>(vChecks.size(), begin + nBatchSize);
+            WorkQueue& work = m_queues[m_next_queue];
+            m_next_queue = (m_next_queue + 1) % num_queues;
+            std::lock_guard<std::mutex> lock(work.mutex);
+            for (size_t i = begin; i < end; ++i) {
+                work.checks.emplace_back();
+                vChecks[i].swap(work.checks.back());
+            }
+        }
+        if (m_idle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1) {
+                condWorker.notify_one();
+            } else {
+                condWorker.notify_all();
+            }
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
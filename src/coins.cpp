@@ -4,15 +4,19 @@
 
 #include <coins.h>
 
+#include <checkqueue.h>
 #include <consensus/consensus.h>
 #include <logging.h>
 #include <random.h>
+#include <util/memory.h>
 #include <version.h>
 
+#include <algorithm>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
@@ -27,13 +31,21 @@ bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) { return base->BatchWrite(mapCoins, hashBlock, erase); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
+bool CCoinsFetch::operator()()
+{
+    if (!m_view->GetCoin(m_outpoint, *m_coin)) {
+        m_coin->Clear();
+    }
+    return true;
+}
+
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), m_cache_coins_memory_resource(MakeUnique<CCoinsMapMemoryResource>()), cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), m_cache_coins_memory_resource.get()), cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -41,8 +53,10 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.referenced = true;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
@@ -56,6 +70,46 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     return ret;
 }
 
+size_t CCoinsViewCache::PrefetchCoins(const std::vector<COutPoint>& outpoints, CCheckQueue<CCoinsFetch>* queue) const
+{
+    std::vector<COutPoint> missing;
+    missing.reserve(outpoints.size());
+    for (const COutPoint& outpoint : outpoints) {
+        if (!cacheCoins.count(outpoint)) missing.push_back(outpoint);
+    }
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+    if (missing.empty()) return 0;
+
+    std::vector<Coin> coins(missing.size());
+    {
+        std::vector<CCoinsFetch> fetches;
+        fetches.reserve(missing.size());
+        for (size_t i = 0; i < missing.size(); ++i) {
+            fetches.emplace_back(*base, missing[i], coins[i]);
+        }
+        if (queue != nullptr) {
+            CCheckQueueControl<CCoinsFetch> control(queue);
+            control.Add(fetches);
+            control.Wait();
+        } else {
+            for (CCoinsFetch& fetch : fetches) {
+                fetch();
+            }
+        }
+    }
+
+    size_t added = 0;
+    for (size_t i = 0; i < missing.size(); ++i) {
+        // Like FetchCoin, only cache coins the backing view actually has.
+        if (coins[i].IsSpent()) continue;
+        CCoinsMap::iterator it = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(missing[i]), std::forward_as_tuple(std::move(coins[i]))).first;
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+        ++added;
+    }
+    return added;
+}
+
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
@@ -157,8 +211,8 @@ void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, bool erase) {
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
         // Ignore non-dirty entries (optimization).
         if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
             continue;
@@ -171,7 +225,11 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 // Create the coin in the parent cache, move the data up
                 // and mark it as dirty.
                 CCoinsCacheEntry& entry = cacheCoins[it->first];
-                entry.coin = std::move(it->second.coin);
+                if (erase) {
+                    entry.coin = std::move(it->second.coin);
+                } else {
+                    entry.coin = it->second.coin;
+                }
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                 entry.flags = CCoinsCacheEntry::DIRTY;
                 // We can mark it FRESH in the parent if it was FRESH in the child
@@ -199,7 +257,11 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             } else {
                 // A normal modification.
                 cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.coin = std::move(it->second.coin);
+                if (erase) {
+                    itUs->second.coin = std::move(it->second.coin);
+                } else {
+                    itUs->second.coin = it->second.coin;
+                }
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 // NOTE: It isn't safe to mark the coin as FRESH in the parent
@@ -217,9 +279,100 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    // Give the pool's chunks back, otherwise the cache would keep reporting
+    // its peak memory usage after the flush.
+    ReallocateCache();
+    return fOk;
+}
+
+bool CCoinsViewCache::Sync()
+{
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, /* erase */ false);
+    // Instead of clearing cacheCoins as Flush() does, drop the spent coins
+    // and mark the others as unmodified: they now match the base.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
     return fOk;
 }
 
+size_t CCoinsViewCache::Trim(size_t target_usage)
+{
+    size_t evicted = 0;
+    // The first sweep clears the reference bits it passes, so the second one
+    // can evict any clean coin.
+    for (int sweep = 0; sweep < 2 && CompactedMemoryUsage() > target_usage; ++sweep) {
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && CompactedMemoryUsage() > target_usage;) {
+            if (it->second.flags != 0) {
+                ++it;
+            } else if (it->second.referenced) {
+                it->second.referenced = false;
+                ++it;
+            } else {
+                cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+                it = cacheCoins.erase(it);
+                ++evicted;
+            }
+        }
+    }
+
+    // Erased coins, whether evicted here or spent and dropped by Sync(), stay
+    // in the pool's chunks, so compact whenever those hold more than an
+    // eighth (and at least a chunk) on top of what the remaining coins need.
+    const size_t compacted_usage = CompactedMemoryUsage();
+    const size_t slack = std::max(compacted_usage / 8, m_cache_coins_memory_resource->ChunkSizeBytes());
+    if (DynamicMemoryUsage() > compacted_usage + slack) {
+        CompactCache();
+    }
+    return evicted;
+}
+
+size_t CCoinsViewCache::CompactedMemoryUsage() const
+{
+    return memusage::CompactedDynamicUsage(cacheCoins) + cachedCoinsUsage;
+}
+
+void CCoinsViewCache::CompactCache()
+{
+    // Move the coins in the order of their addresses in the old pool, so that
+    // its chunks empty one after the other and can be freed along the way.
+    // The memory held then stays close to that of the remaining coins,
+    // instead of doubling as a copy of the whole map would.
+    std::vector<CCoinsMap::iterator> order;
+    order.reserve(cacheCoins.size());
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+        order.push_back(it);
+    }
+    std::sort(order.begin(), order.end(), [](const CCoinsMap::iterator& a, const CCoinsMap::iterator& b) {
+        return std::less<const CCoinsMap::value_type*>()(&*a, &*b);
+    });
+
+    auto resource = MakeUnique<CCoinsMapMemoryResource>();
+    CCoinsMap coins{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, resource.get()};
+    coins.reserve(order.size());
+    // A small map may have its bucket array in the old pool, which must stay
+    // allocated until the map is destroyed.
+    const bool release_chunks = cacheCoins.bucket_count() * sizeof(void*) > CCoinsMapMemoryResource::MaxBlockSizeBytes();
+    static constexpr size_t RELEASE_INTERVAL = 1024;
+    for (size_t i = 0; i < order.size(); ++i) {
+        coins.emplace(order[i]->first, std::move(order[i]->second));
+        cacheCoins.erase(order[i]);
+        if (release_chunks && (i + 1) % RELEASE_INTERVAL == 0 && i + 1 < order.size()) {
+            m_cache_coins_memory_resource->ReleaseChunksBelow(&*order[i + 1]);
+        }
+    }
+
+    cacheCoins.~CCoinsMap();
+    m_cache_coins_memory_resource = std::move(resource);
+    ::new (&cacheCoins) CCoinsMap(std::move(coins));
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -250,7 +403,8 @@ void CCoinsViewCache::ReallocateCache()
     // Cache should be empty when we're calling this.
     assert(cacheCoins.size() == 0);
     cacheCoins.~CCoinsMap();
-    ::new (&cacheCoins) CCoinsMap();
+    m_cache_coins_memory_resource = MakeUnique<CCoinsMapMemoryResource>();
+    ::new (&cacheCoins) CCoinsMap{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, m_cache_coins_memory_resource.get()};
 }
 
 static const size_t MIN_TRANSACTION_OUTPUT_WEIGHT = WITNESS_SCALE_FACTOR * ::GetSerializeSize(CTxOut(), PROTOCOL_VERSION);
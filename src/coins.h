@@ -12,12 +12,14 @@
 #include <memusage.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
 #include <stdint.h>
 
 #include <functional>
+#include <memory>
 #include <unordered_map>
 
 /**
@@ -128,6 +130,13 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    /**
+     * Set when the coin is looked up again while cached. Used by
+     * CCoinsViewCache::Trim to give recently used coins a second chance
+     * before evicting them (CLOCK eviction). It does not affect the coin's
+     * state, and fits in the padding after flags.
+     */
+    bool referenced{false};
 
     enum Flags {
         /**
@@ -154,7 +163,57 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The coins cache allocates its nodes from a PoolResource instead of one heap
+ * allocation per coin. This removes the malloc overhead per entry and makes
+ * the memory usage of the cache exact.
+ *
+ * The node type of std::unordered_map is implementation defined. Most
+ * implementations add one or two pointers to the value (for the linked list)
+ * and some also store the hash, so allowing for 4 additional pointers in
+ * MAX_BLOCK_SIZE_BYTES ensures all implementations allocate the nodes from
+ * the pool.
+ */
+typedef std::unordered_map<COutPoint,
+                           CCoinsCacheEntry,
+                           SaltedOutpointHasher,
+                           std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                         sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                                         alignof(void*)>>
+    CCoinsMap;
+
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
+
+template <typename T>
+class CCheckQueue;
+class CCoinsView;
+
+/**
+ * A single coin lookup in a backing view, to be run on a CCheckQueue worker
+ * thread as part of CCoinsViewCache::PrefetchCoins. The result is written to
+ * the Coin passed in, which is left spent if the coin was not found.
+ */
+class CCoinsFetch
+{
+private:
+    const CCoinsView* m_view{nullptr};
+    COutPoint m_outpoint;
+    Coin* m_coin{nullptr};
+
+public:
+    CCoinsFetch() {}
+    CCoinsFetch(const CCoinsView& view, const COutPoint& outpoint, Coin& coin) : m_view(&view), m_outpoint(outpoint), m_coin(&coin) {}
+
+    bool operator()();
+
+    void swap(CCoinsFetch& fetch)
+    {
+        std::swap(m_view, fetch.m_view);
+        std::swap(m_outpoint, fetch.m_outpoint);
+        std::swap(m_coin, fetch.m_coin);
+    }
+};
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -199,8 +258,9 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified. If erase is true, all of its
+    //! entries are removed; otherwise they are left in place, unchanged.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -226,7 +286,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -241,6 +301,7 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    mutable std::unique_ptr<CCoinsMapMemoryResource> m_cache_coins_memory_resource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -259,7 +320,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -283,6 +344,18 @@ public:
      */
     const Coin& AccessCoin(const COutPoint &output) const;
 
+    /**
+     * Load the given outpoints into the cache ahead of their use, e.g. all
+     * inputs of a block before it is connected. Outpoints that are not in
+     * the cache are looked up in the backing view as a batch, concurrently
+     * on the threads of queue if one is given. The backing view's GetCoin()
+     * must therefore be safe to call from several threads at once, which is
+     * the case for CCoinsViewDB but not for another CCoinsViewCache.
+     *
+     * @returns the number of coins that were added to the cache
+     */
+    size_t PrefetchCoins(const std::vector<COutPoint>& outpoints, CCheckQueue<CCoinsFetch>* queue) const;
+
     /**
      * Add a coin. Set possible_overwrite to true if an unspent version may
      * already exist in the cache.
@@ -303,6 +376,31 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep the unspent coins cached and mark them as unmodified. Spent
+     * coins are removed. This avoids the cold cache that follows a Flush().
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Evict unmodified coins until CompactedMemoryUsage() is at most
+     * target_usage, then, if the pool holds noticeably more memory than the
+     * remaining coins need, move them to freshly allocated memory so that
+     * the memory of the evicted and spent ones is released. Coins are
+     * visited in CLOCK order: a coin that was looked up again since the
+     * previous sweep is spared once, so the coins that are used repeatedly
+     * stay cached. Modified (DIRTY) coins are never evicted; call Sync()
+     * first.
+     *
+     * @returns the number of coins evicted
+     */
+    size_t Trim(size_t target_usage);
+
+    //! The DynamicMemoryUsage() the cache would have once Trim() compacts it
+    size_t CompactedMemoryUsage() const;
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -326,6 +424,10 @@ public:
     void ReallocateCache();
 
 private:
+    //! Move the coins to a new map with a fresh pool, releasing the old
+    //! pool's memory as it empties.
+    void CompactCache();
+
     /**
      * @note this is marked const, but may actually append to `cacheCoins`, increasing
      * memory usage.
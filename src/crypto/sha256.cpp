@@ -29,6 +29,16 @@ namespace sha256d64_avx2
 void Transform_8way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256d80_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d80_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+
 namespace sha256d64_shani
 {
 void Transform_2way(unsigned char* out, const unsigned char* in);
@@ -456,11 +466,54 @@ void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
     WriteBE32(out + 28, s[7]);
 }
 
+template<TransformType tr>
+void TransformD80Wrapper(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    unsigned char buffer1[64] = {
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0x80
+    };
+    unsigned char buffer2[64] = {
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    memcpy(buffer1, in + 64, 16);
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, buffer1, 1);
+    WriteBE32(buffer2 + 0, s[0]);
+    WriteBE32(buffer2 + 4, s[1]);
+    WriteBE32(buffer2 + 8, s[2]);
+    WriteBE32(buffer2 + 12, s[3]);
+    WriteBE32(buffer2 + 16, s[4]);
+    WriteBE32(buffer2 + 20, s[5]);
+    WriteBE32(buffer2 + 24, s[6]);
+    WriteBE32(buffer2 + 28, s[7]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    WriteBE32(out + 0, s[0]);
+    WriteBE32(out + 4, s[1]);
+    WriteBE32(out + 8, s[2]);
+    WriteBE32(out + 12, s[3]);
+    WriteBE32(out + 16, s[4]);
+    WriteBE32(out + 20, s[5]);
+    WriteBE32(out + 24, s[6]);
+    WriteBE32(out + 28, s[7]);
+}
+
 TransformType Transform = sha256::Transform;
 TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+TransformD64Type TransformD80 = TransformD80Wrapper<sha256::Transform>;
+TransformD64Type TransformD80_4way = nullptr;
+TransformD64Type TransformD80_8way = nullptr;
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -508,6 +561,25 @@ bool SelfTest() {
         0x6a, 0x46, 0x30, 0xa6, 0x89, 0x86, 0x23, 0xac, 0xf8, 0xa5, 0x15, 0xe9, 0x0a, 0xaa, 0x1e, 0x9a,
         0xd7, 0x93, 0x6b, 0x28, 0xe4, 0x3b, 0xfd, 0x59, 0xc6, 0xed, 0x7c, 0x5f, 0xa5, 0x41, 0xcb, 0x51
     };
+    // Expected output for each of the individual 8 80-byte messages under full double SHA256 (including padding).
+    static const unsigned char result_d80[256] = {
+        0xe9, 0x82, 0xae, 0xd1, 0xa6, 0x27, 0x65, 0x01, 0xcd, 0x7d, 0x10, 0xaf, 0x74, 0x2a, 0xcb, 0x36,
+        0xd5, 0xcd, 0xa4, 0x06, 0x31, 0x8f, 0xd4, 0x98, 0x7e, 0x2e, 0x5e, 0x2a, 0x02, 0x16, 0x93, 0x2b,
+        0xd3, 0x59, 0x99, 0xe4, 0xee, 0x33, 0xc4, 0xad, 0xfd, 0x13, 0xf1, 0x25, 0xd8, 0xd2, 0x82, 0xd4,
+        0x8f, 0xfb, 0xc6, 0xa9, 0x89, 0xe5, 0xe8, 0x04, 0x28, 0xa7, 0xb2, 0x8a, 0xa3, 0x30, 0x90, 0xb0,
+        0xbd, 0x93, 0x41, 0x4b, 0xfc, 0xd2, 0xbe, 0x42, 0x95, 0xe7, 0x67, 0x15, 0xa2, 0x39, 0x5d, 0xe9,
+        0x25, 0x67, 0x5d, 0x57, 0x8d, 0x10, 0x3c, 0x11, 0xf5, 0xb6, 0x1d, 0xd6, 0x6d, 0x0b, 0x0d, 0x74,
+        0x44, 0x26, 0x8b, 0x8b, 0x88, 0x89, 0x31, 0x51, 0xb1, 0x51, 0x31, 0xf7, 0x67, 0x4c, 0x78, 0x15,
+        0x25, 0x08, 0xff, 0x0b, 0x4f, 0xfd, 0x0b, 0x3d, 0xef, 0x8a, 0x9c, 0x1d, 0x01, 0xcc, 0xaa, 0x79,
+        0xaa, 0xb0, 0x80, 0x33, 0x66, 0x2e, 0x50, 0x34, 0x59, 0x36, 0x5a, 0xd3, 0x79, 0x95, 0xc2, 0xf0,
+        0x00, 0x2b, 0x5e, 0x49, 0x16, 0xb2, 0xce, 0xe8, 0x42, 0x72, 0x40, 0x5a, 0x14, 0xec, 0x4c, 0xe8,
+        0x8b, 0x44, 0x60, 0xa3, 0x8e, 0x1a, 0x02, 0x9c, 0x3a, 0x70, 0xeb, 0x6d, 0x5d, 0x22, 0x21, 0x94,
+        0x9b, 0xa3, 0xfc, 0x1b, 0xb8, 0x65, 0x9b, 0x81, 0xd2, 0x49, 0x36, 0x6b, 0x7e, 0x7d, 0x43, 0xf5,
+        0x45, 0x0b, 0xa3, 0x29, 0x3c, 0x5a, 0x6c, 0xfa, 0x17, 0x0d, 0x2a, 0xfe, 0x55, 0xc9, 0x31, 0x1b,
+        0xf4, 0xad, 0x9e, 0x2d, 0x62, 0x87, 0x71, 0x67, 0x96, 0x06, 0x68, 0x11, 0x89, 0x89, 0xbd, 0x44,
+        0x4b, 0xe7, 0x57, 0x0e, 0x8f, 0x70, 0xeb, 0x09, 0x36, 0x40, 0xc8, 0x46, 0x82, 0x74, 0xba, 0x75,
+        0x97, 0x45, 0xa7, 0xaa, 0x2b, 0x7d, 0x25, 0xab, 0x1e, 0x04, 0x21, 0xb2, 0x59, 0x84, 0x50, 0x14
+    };
 
 
     // Test Transform() for 0 through 8 transformations.
@@ -544,6 +616,24 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test TransformD80
+    TransformD80(out, data + 1);
+    if (!std::equal(out, out + 32, result_d80)) return false;
+
+    // Test TransformD80_4way, if available.
+    if (TransformD80_4way) {
+        unsigned char out[128];
+        TransformD80_4way(out, data + 1);
+        if (!std::equal(out, out + 128, result_d80)) return false;
+    }
+
+    // Test TransformD80_8way, if available.
+    if (TransformD80_8way) {
+        unsigned char out[256];
+        TransformD80_8way(out, data + 1);
+        if (!std::equal(out, out + 256, result_d80)) return false;
+    }
+
     return true;
 }
 
@@ -597,6 +687,7 @@ std::string SHA256AutoDetect()
         Transform = sha256_shani::Transform;
         TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
         TransformD64_2way = sha256d64_shani::Transform_2way;
+        TransformD80 = TransformD80Wrapper<sha256_shani::Transform>;
         ret = "shani(1way,2way)";
         have_sse4 = false; // Disable SSE4/AVX2;
         have_avx2 = false;
@@ -607,10 +698,12 @@ std::string SHA256AutoDetect()
 #if defined(__x86_64__) || defined(__amd64__)
         Transform = sha256_sse4::Transform;
         TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        TransformD80 = TransformD80Wrapper<sha256_sse4::Transform>;
         ret = "sse4(1way)";
 #endif
 #if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
         TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformD80_4way = sha256d80_sse41::Transform_4way;
         ret += ",sse41(4way)";
 #endif
     }
@@ -618,6 +711,7 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformD80_8way = sha256d80_avx2::Transform_8way;
         ret += ",avx2(8way)";
     }
 #endif
@@ -717,3 +811,29 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+void SHA256D80(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD80_8way) {
+        while (blocks >= 8) {
+            TransformD80_8way(out, in);
+            out += 256;
+            in += 640;
+            blocks -= 8;
+        }
+    }
+    if (TransformD80_4way) {
+        while (blocks >= 4) {
+            TransformD80_4way(out, in);
+            out += 128;
+            in += 320;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD80(out, in);
+        out += 32;
+        in += 80;
+        --blocks;
+    }
+}
@@ -5,8 +5,11 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
-#include <string>
+#include <span.h>
+
 #include <functional>
+#include <memory>
+#include <string>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -113,6 +116,18 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write HTTP reply with the body reply, which is sent without copying it.
+     * owner keeps reply valid, and is released once the reply was sent.
+     *
+     * @note See WriteReply(int, const std::string&).
+     */
+    void WriteReply(int nStatus, Span<const unsigned char> reply, std::shared_ptr<const void> owner);
+
+private:
+    /** Send the reply, whose body is in the output buffer, from the main http thread. */
+    void SendReply(int nStatus);
 };
 
 /** Event handler closure.
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <index/txindex.h>
 #include <node/ui_interface.h>
 #include <shutdown.h>
@@ -263,17 +264,32 @@ bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRe
         return false;
     }
 
-    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    // Open at the index header, which tells whether the block is compressed
+    FlatFilePos hpos = postx;
+    hpos.nPos -= 8;
+    CAutoFile file(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (file.IsNull()) {
         return error("%s: OpenBlockFile failed", __func__);
     }
     CBlockHeader header;
     try {
-        file >> header;
-        if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
-            return error("%s: fseek(...) failed", __func__);
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+        file >> blk_start >> blk_size;
+        if (blk_size & BLOCK_RECORD_COMPRESSED) {
+            std::vector<uint8_t> block_data;
+            if (!ReadRawBlockFromDisk(block_data, postx, Params().MessageStart())) {
+                return error("%s: ReadRawBlockFromDisk failed", __func__);
+            }
+            VectorReader(SER_DISK, CLIENT_VERSION, block_data, 0) >> header;
+            VectorReader(SER_DISK, CLIENT_VERSION, block_data, ::GetSerializeSize(header, CLIENT_VERSION) + postx.nTxOffset) >> tx;
+        } else {
+            file >> header;
+            if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
+                return error("%s: fseek(...) failed", __func__);
+            }
+            file >> tx;
         }
-        file >> tx;
     } catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
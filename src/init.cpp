@@ -30,6 +30,7 @@
 #include <net_permissions.h>
 #include <net_processing.h>
 #include <netbase.h>
+#include <node/blockservecache.h>
 #include <node/context.h>
 #include <node/ui_interface.h>
 #include <policy/feerate.h>
@@ -84,6 +85,7 @@
 #endif
 
 static bool fFeeEstimatesInitialized = false;
+static bool g_sigcaches_initialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
@@ -216,6 +218,10 @@ void Shutdown(NodeContext& node)
 
     StopTorControl();
 
+    // Background validation may still be connecting blocks, which needs the
+    // scheduler to drain the validation interface queue.
+    if (node.chainman) node.chainman->StopBackgroundValidation();
+
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue, threadGroup and load block thread.
     if (node.scheduler) node.scheduler->stop();
@@ -233,6 +239,10 @@ void Shutdown(NodeContext& node)
         DumpMempool(::mempool);
     }
 
+    if (g_sigcaches_initialized && gArgs.GetArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        DumpSignatureCaches();
+    }
+
     if (fFeeEstimatesInitialized)
     {
         ::feeEstimator.FlushUnconfirmed();
@@ -281,6 +291,9 @@ void Shutdown(NodeContext& node)
                 chainstate->ResetCoinsViews();
             }
         }
+        if (pblocktree && gArgs.GetBoolArg("-blockindexcache", DEFAULT_BLOCKINDEXCACHE)) {
+            node.chainman->m_blockman.WriteBlockIndexCache(*pblocktree);
+        }
         pblocktree.reset();
     }
     for (const auto& client : node.chain_clients) {
@@ -396,8 +409,11 @@ void SetupServerArgs(NodeContext& node)
 #if HAVE_SYSTEM
     argsman.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
+    argsman.AddArg("-blockindexcache", strprintf("Whether to save the block index to a flat file on shutdown and load it from there on restart, if it is still up to date (default: %u)", DEFAULT_BLOCKINDEXCACHE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksonly", strprintf("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless the peer has the 'forcerelay' permission. RPC transactions are not affected. (default: %u)", DEFAULT_BLOCKSONLY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-coinsfetchthreads=<n>", strprintf("Set the number of threads looking up the inputs of a block in the coins database before connecting it (0 to %d, 0 = disable, default: %d)", MAX_COINS_FETCH_THREADS, DEFAULT_COINS_FETCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-compressblocks", strprintf("Whether to compress the blocks and undo data of new block files. Existing block files are read in either format, and can be converted with -rewriteblockfiles (default: %u)", DEFAULT_COMPRESS_BLOCKS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-conf=<file>", strprintf("Specify path to read-only configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
@@ -405,7 +421,7 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     argsman.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    argsman.AddArg("-loadblock=<file>", "Imports blocks from external file on startup", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-loadblock=<file>", strprintf("Imports blocks from external file on startup. Blocks read ahead of the import use up to %d%% of -dbcache (at least %d MiB) in addition to it", BLOCK_IMPORT_BUFFER_DBCACHE_PERCENT, MIN_BLOCK_IMPORT_BUFFER >> 20), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-maxmempool=<n>", strprintf("Keep the transaction memory pool below <n> megabytes (default: %u)", DEFAULT_MAX_MEMPOOL_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -413,12 +429,15 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-persistsigcache", strprintf("Whether to save the signature and script execution caches on shutdown and load them on restart (default: %u)", DEFAULT_PERSIST_SIGCACHE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-prefetchblocks=<n>", strprintf("Number of blocks to read from disk ahead of the tip while connecting blocks, e.g. during initial sync or -reindex-chainstate (0 to %d, 0 = disable, default: %d)", MAX_PREFETCH_BLOCKS, DEFAULT_PREFETCH_BLOCKS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    argsman.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-reindex", strprintf("Rebuild chain state and block index from the blk*.dat files on disk. Blocks read ahead of the import use up to %d%% of -dbcache (at least %d MiB) in addition to it, as with -loadblock", BLOCK_IMPORT_BUFFER_DBCACHE_PERCENT, MIN_BLOCK_IMPORT_BUFFER >> 20), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks. When in pruning mode or if blocks on disk might be corrupted, use full -reindex instead.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-rewriteblockfiles", "Rewrite the existing block files in the format selected by -compressblocks on startup. This requires rebuilding -txindex.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-settings=<file>", strprintf("Specify path to dynamic settings data file. Can be disabled with -nosettings. File is written at runtime and not meant to be edited by users (use %s instead for custom settings). Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME, BITCOIN_SETTINGS_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #ifndef WIN32
     argsman.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -435,6 +454,7 @@ void SetupServerArgs(NodeContext& node)
     argsman.AddArg("-asmap=<file>", strprintf("Specify asn mapping used for bucketing of the peers (default: %s). Relative paths will be prefixed by the net-specific datadir location.", DEFAULT_ASMAP_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-bantime=<n>", strprintf("Default duration (in seconds) of manually configured bans (default: %u)", DEFAULT_MISBEHAVING_BANTIME), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-bind=<addr>", "Bind to given address and always listen on it. Use [host]:port notation for IPv6", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
+    argsman.AddArg("-blockservecache=<n>", strprintf("Maximum memory in MiB for serialized recent blocks and compact blocks that are served to peers (0 to disable, default: %d)", DEFAULT_BLOCK_SERVE_CACHE_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-connect=<ip>", "Connect only to the specified node; -noconnect disables automatic connections (the rules for this peer are the same as for -addnode). This option can be specified multiple times to connect to multiple nodes.", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
     argsman.AddArg("-discover", "Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-dns", strprintf("Allow DNS lookups for -addnode, -seednode and -connect (default: %u)", DEFAULT_NAME_LOOKUP), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -551,6 +571,7 @@ void SetupServerArgs(NodeContext& node)
 
     argsman.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-blocktemplateupdate=<n>", strprintf("Update the block template cached by getblocktemplate in place as transactions enter or leave the mempool, for up to <n> seconds before selecting its transactions again (default: %u, 0 to disable)", DEFAULT_BLOCK_TEMPLATE_UPDATE), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
 
     argsman.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
@@ -642,6 +663,28 @@ struct CImportingNow
 };
 
 
+// Snapshot chainstates (see loadtxoutset) are not reloaded on startup, so the
+// coins databases they leave in the datadir, named chainstate_<base blockhash>,
+// would only take up space. Delete them; the node carries on with the chainstate
+// that was validated from genesis.
+static void CleanupSnapshotChainstates()
+{
+    try {
+        std::vector<fs::path> snapshot_dirs;
+        for (fs::directory_iterator it(GetDataDir()); it != fs::directory_iterator(); it++) {
+            if (fs::is_directory(*it) && it->path().filename().string().compare(0, 11, "chainstate_") == 0) {
+                snapshot_dirs.push_back(it->path());
+            }
+        }
+        for (const fs::path& path : snapshot_dirs) {
+            LogPrintf("Removing the coins database of a UTXO snapshot loaded before the restart: %s\n", path.string());
+            fs::remove_all(path);
+        }
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("Warning: Could not remove the coins database of a UTXO snapshot: %s\n", fsbridge::get_filesystem_error_message(e));
+    }
+}
+
 // If we're using -prune with -reindex, then delete block files that will be ignored by the
 // reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
 // is missing, do the same here to delete any later block files after a gap.  Also delete all
@@ -683,7 +726,7 @@ static void CleanupBlockRevFiles()
     }
 }
 
-static void ThreadImport(ChainstateManager& chainman, std::vector<fs::path> vImportFiles)
+static void ThreadImport(ChainstateManager& chainman, std::vector<fs::path> vImportFiles, size_t import_buffer)
 {
     const CChainParams& chainparams = Params();
     ScheduleBatchPriority();
@@ -693,21 +736,17 @@ static void ThreadImport(ChainstateManager& chainman, std::vector<fs::path> vImp
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
+        std::vector<ExternalBlockFile> block_files;
+        for (int nFile = 0; true; nFile++) {
             FlatFilePos pos(nFile, 0);
             if (!fs::exists(GetBlockPosFilename(pos)))
                 break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            if (ShutdownRequested()) {
-                LogPrintf("Shutdown requested. Exit %s\n", __func__);
-                return;
-            }
-            nFile++;
+            block_files.push_back({GetBlockPosFilename(pos), nFile});
+        }
+        LoadExternalBlockFiles(chainparams, block_files, import_buffer);
+        if (ShutdownRequested()) {
+            LogPrintf("Shutdown requested. Exit %s\n", __func__);
+            return;
         }
         pblocktree->WriteReindexing(false);
         fReindex = false;
@@ -717,18 +756,14 @@ static void ThreadImport(ChainstateManager& chainman, std::vector<fs::path> vImp
     }
 
     // -loadblock=
+    std::vector<ExternalBlockFile> import_files;
     for (const fs::path& path : vImportFiles) {
-        FILE *file = fsbridge::fopen(path, "rb");
-        if (file) {
-            LogPrintf("Importing blocks file %s...\n", path.string());
-            LoadExternalBlockFile(chainparams, file);
-            if (ShutdownRequested()) {
-                LogPrintf("Shutdown requested. Exit %s\n", __func__);
-                return;
-            }
-        } else {
-            LogPrintf("Warning: Could not open blocks file %s\n", path.string());
-        }
+        import_files.push_back({path, nullopt});
+    }
+    LoadExternalBlockFiles(chainparams, import_files, import_buffer);
+    if (ShutdownRequested()) {
+        LogPrintf("Shutdown requested. Exit %s\n", __func__);
+        return;
     }
 
     // scan for better chains in the block chain database, that are not yet connected in the active best chain
@@ -1070,6 +1105,7 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    g_compress_blocks = gArgs.GetBoolArg("-compressblocks", DEFAULT_COMPRESS_BLOCKS);
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
@@ -1295,6 +1331,10 @@ bool AppInitMain(const util::Ref& context, NodeContext& node)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (gArgs.GetArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadSignatureCaches();
+    }
+    g_sigcaches_initialized = true;
 
     int script_threads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (script_threads <= 0) {
@@ -1317,6 +1357,23 @@ bool AppInitMain(const util::Ref& context, NodeContext& node)
         }
     }
 
+    int coins_fetch_threads = std::max(0, std::min<int>(gArgs.GetArg("-coinsfetchthreads", DEFAULT_COINS_FETCH_THREADS), MAX_COINS_FETCH_THREADS));
+    LogPrintf("Coins database lookups use %d additional threads\n", coins_fetch_threads);
+    if (coins_fetch_threads >= 1) {
+        g_parallel_coins_fetch = true;
+        for (int i = 0; i < coins_fetch_threads; ++i) {
+            threadGroup.create_thread([i]() { return ThreadCoinsFetch(i); });
+        }
+    }
+
+    g_block_prefetch_depth = std::max(0, std::min<int>(gArgs.GetArg("-prefetchblocks", DEFAULT_PREFETCH_BLOCKS), MAX_PREFETCH_BLOCKS));
+    if (g_block_prefetch_depth > 0) {
+        LogPrintf("Block prefetch reads up to %d blocks ahead using %d threads\n", g_block_prefetch_depth, BLOCK_PREFETCH_THREADS);
+        for (int i = 0; i < BLOCK_PREFETCH_THREADS; ++i) {
+            threadGroup.create_thread([i]() { return ThreadBlockPrefetch(i); });
+        }
+    }
+
     assert(!node.scheduler);
     node.scheduler = MakeUnique<CScheduler>();
 
@@ -1521,6 +1578,8 @@ bool AppInitMain(const util::Ref& context, NodeContext& node)
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
+    // -reindex and -loadblock use this on top of the cache for the blocks waiting to be imported
+    const size_t import_buffer = std::max<int64_t>(MIN_BLOCK_IMPORT_BUFFER, nTotalCache / 100 * BLOCK_IMPORT_BUFFER_DBCACHE_PERCENT);
     int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
     nTotalCache -= nBlockTreeDBCache;
     int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
@@ -1548,6 +1607,11 @@ bool AppInitMain(const util::Ref& context, NodeContext& node)
     }
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    if (fReindex || gArgs.IsArgSet("-loadblock")) {
+        LogPrintf("* Using up to %.1f MiB for blocks waiting to be imported\n", import_buffer * (1.0 / 1024 / 1024));
+    }
+
+    CleanupSnapshotChainstates();
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
@@ -1773,6 +1837,21 @@ bool AppInitMain(const util::Ref& context, NodeContext& node)
         return false;
     }
 
+    if (gArgs.GetBoolArg("-rewriteblockfiles", false)) {
+        if (fReindex) {
+            LogPrintf("Not rewriting block files while reindexing\n");
+        } else {
+            uiInterface.InitMessage(_("Rewriting block files...").translated);
+            if (!RewriteBlockFiles(chainparams)) {
+                return InitError(_("Error rewriting block files, see debug.log for details"));
+            }
+            if (ShutdownRequested()) {
+                LogPrintf("Shutdown requested. Exiting.\n");
+                return false;
+            }
+        }
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1782,7 +1861,11 @@ bool AppInitMain(const util::Ref& context, NodeContext& node)
 
     // ********************************************************* Step 8: start indexers
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-        g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
+        // Rewritten block files invalidate the transaction positions
+        bool block_files_rewritten = false;
+        pblocktree->ReadFlag("blockfilesrewritten", block_files_rewritten);
+        g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex || block_files_rewritten);
+        if (block_files_rewritten) pblocktree->WriteFlag("blockfilesrewritten", false);
         g_txindex->Start();
     }
 
@@ -1850,7 +1933,7 @@ bool AppInitMain(const util::Ref& context, NodeContext& node)
         vImportFiles.push_back(strFile);
     }
 
-    g_load_block = std::thread(&TraceThread<std::function<void()>>, "loadblk", [=, &chainman]{ ThreadImport(chainman, vImportFiles); });
+    g_load_block = std::thread(&TraceThread<std::function<void()>>, "loadblk", [=, &chainman]{ ThreadImport(chainman, vImportFiles, import_buffer); });
 
     // Wait for genesis block to be processed
     {
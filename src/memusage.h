@@ -7,6 +7,7 @@
 
 #include <indirectmap.h>
 #include <prevector.h>
+#include <support/allocators/pool.h>
 
 #include <stdlib.h>
 
@@ -167,6 +168,32 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template <class Key, class T, class Hash, class Pred, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<Key, T, Hash, Pred, PoolAllocator<std::pair<const Key, T>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    // The nodes live in the chunks of the pool resource, so its usage is
+    // exact rather than an estimate per node. The chunks are tracked in a
+    // std::list, whose nodes hold two links and the chunk pointer.
+    auto* pool_resource = m.get_allocator().resource();
+    size_t estimated_list_node_size = MallocUsage(sizeof(void*) * 3);
+    size_t usage_resource = estimated_list_node_size * pool_resource->NumAllocatedChunks();
+    size_t usage_chunks = MallocUsage(pool_resource->ChunkSizeBytes()) * pool_resource->NumAllocatedChunks();
+    return usage_resource + usage_chunks + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
+/** The DynamicUsage() of a pooled map once its elements have been moved into
+ *  a new map with a fresh pool resource and the same bucket count. The bytes
+ *  in use are scaled by the cost of a chunk instead of being rounded up to
+ *  whole chunks, so that the result drops with every element removed. */
+template <class Key, class T, class Hash, class Pred, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+static inline size_t CompactedDynamicUsage(const std::unordered_map<Key, T, Hash, Pred, PoolAllocator<std::pair<const Key, T>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    auto* pool_resource = m.get_allocator().resource();
+    uint64_t chunk_usage = MallocUsage(sizeof(void*) * 3) + MallocUsage(pool_resource->ChunkSizeBytes());
+    uint64_t usage_chunks = uint64_t{pool_resource->BytesInUse()} * chunk_usage / pool_resource->ChunkSizeBytes();
+    return usage_chunks + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
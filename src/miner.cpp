@@ -22,6 +22,7 @@
 #include <util/system.h>
 
 #include <algorithm>
+#include <iterator>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -119,6 +120,99 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     LOCK2(cs_main, m_mempool.cs);
     CBlockIndex* pindexPrev = ::ChainActive().Tip();
     assert(pindexPrev != nullptr);
+    StartBlock(pindexPrev);
+
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+
+    int64_t nTime1 = GetTimeMicros();
+
+    m_last_block_num_txs = nBlockTx;
+    m_last_block_weight = nBlockWeight;
+
+    FinishBlock(scriptPubKeyIn, pindexPrev);
+    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+
+    return std::move(pblocktemplate);
+}
+
+bool BlockAssembler::UpdateBlock(CBlockTemplate& blocktemplate, std::chrono::seconds since)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, m_mempool.cs);
+    CBlockIndex* pindexPrev = ::ChainActive().Tip();
+    assert(pindexPrev != nullptr);
+    // Transactions confirmed or conflicted by a new tip are not tracked here;
+    // the caller has to start over.
+    if (blocktemplate.block.hashPrevBlock != pindexPrev->GetBlockHash()) return false;
+
+    const std::vector<CTransactionRef> previous = std::move(blocktemplate.block.vtx);
+    const CScript scriptPubKeyIn = previous.at(0)->vout.at(0).scriptPubKey;
+
+    resetBlock();
+    pblocktemplate.reset(new CBlockTemplate());
+    CBlock* const pblock = &pblocktemplate->block; // pointer for convenience
+    pblock->vtx.emplace_back();
+    pblocktemplate->vTxFees.push_back(-1); // updated at end
+    pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+    StartBlock(pindexPrev);
+
+    // Keep the transactions still in the mempool, in their original order.
+    // Removing a transaction from the mempool removes its descendants too, so
+    // the parents of every kept transaction are still ahead of it.
+    int nKept = 0;
+    for (size_t i = 1; i < previous.size(); ++i) {
+        Optional<CTxMemPool::txiter> it = m_mempool.GetIter(previous[i]->GetHash());
+        if (!it) continue;
+        AddToBlock(*it);
+        ++nKept;
+    }
+
+    // Append the transactions that entered the mempool since the last update,
+    // in arrival order, where they fit and their unconfirmed parents are
+    // already in the block. This is not the feerate-optimal selection that
+    // CreateNewBlock makes, which is why callers rebuild periodically.
+    int nAdded = 0;
+    const auto& by_time = m_mempool.mapTx.get<entry_time>();
+    auto mi = by_time.end();
+    while (mi != by_time.begin() && std::prev(mi)->GetTime() >= since) --mi;
+    for (; mi != by_time.end(); ++mi) {
+        CTxMemPool::txiter iter = m_mempool.mapTx.project<0>(mi);
+        if (inBlock.count(iter)) continue;
+        if (iter->GetModifiedFee() < blockMinFeeRate.GetFee(iter->GetTxSize())) continue;
+        if (!TestPackage(iter->GetTxSize(), iter->GetSigOpCost())) continue;
+        const CTxMemPoolEntry::Links& parents = m_mempool.GetMemPoolParents(iter);
+        if (!std::all_of(parents.begin(), parents.end(), [&](const CTxMemPoolEntry* parent) {
+                return inBlock.count(m_mempool.mapTx.iterator_to(*parent)) > 0;
+            })) continue;
+        if (!TestPackageTransactions({iter})) continue;
+        AddToBlock(iter);
+        ++nAdded;
+    }
+
+    int64_t nTime1 = GetTimeMicros();
+
+    m_last_block_num_txs = nBlockTx;
+    m_last_block_weight = nBlockWeight;
+
+    FinishBlock(scriptPubKeyIn, pindexPrev);
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint(BCLog::BENCH, "UpdateBlock() txs: %.2fms (%d kept, %d dropped, %d added), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nKept, previous.size() - 1 - nKept, nAdded, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+
+    blocktemplate = std::move(*pblocktemplate);
+    pblocktemplate.reset();
+    return true;
+}
+
+void BlockAssembler::StartBlock(const CBlockIndex* pindexPrev)
+{
+    CBlock* const pblock = &pblocktemplate->block;
     nHeight = pindexPrev->nHeight + 1;
 
     pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
@@ -144,16 +238,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // TODO: replace this with a call to main to assess validity of a mempool
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
+}
 
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
-
-    int64_t nTime1 = GetTimeMicros();
-
-    m_last_block_num_txs = nBlockTx;
-    m_last_block_weight = nBlockWeight;
-
+void BlockAssembler::FinishBlock(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev)
+{
+    CBlock* const pblock = &pblocktemplate->block;
     // Create coinbase transaction.
     CMutableTransaction coinbaseTx;
     coinbaseTx.vin.resize(1);
@@ -166,8 +255,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
 
-    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
-
     // Fill in header
     pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
@@ -179,24 +266,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, state.ToString()));
     }
-    int64_t nTime2 = GetTimeMicros();
-
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
-
-    return std::move(pblocktemplate);
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
+void BlockAssembler::onlyUnconfirmed(CTxMemPool::vecEntries& testSet)
 {
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
-        // Only test txs not already in the block
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        }
-        else {
-            iit++;
-        }
-    }
+    // Only test txs not already in the block
+    testSet.erase(std::remove_if(testSet.begin(), testSet.end(), [&](CTxMemPool::txiter it) { return inBlock.count(it) > 0; }), testSet.end());
 }
 
 bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const
@@ -213,7 +288,7 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost
 // - transaction finality (locktime)
 // - premature witness (in case segwit transactions are added to mempool before
 //   segwit activation)
-bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
+bool BlockAssembler::TestPackageTransactions(const CTxMemPool::vecEntries& package)
 {
     for (CTxMemPool::txiter it : package) {
         if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
@@ -243,16 +318,17 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
-int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
+int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::vecEntries& alreadyAdded,
         indexed_modified_transaction_set &mapModifiedTx)
 {
     int nDescendantsUpdated = 0;
+    CTxMemPool::vecEntries descendants;
     for (CTxMemPool::txiter it : alreadyAdded) {
-        CTxMemPool::setEntries descendants;
         m_mempool.CalculateDescendants(it, descendants);
-        // Insert all descendants (not yet in block) into the modified set
+        // Insert all descendants (not yet in block) into the modified set.
+        // alreadyAdded is in inBlock by now, and no other descendant can be.
         for (CTxMemPool::txiter desc : descendants) {
-            if (alreadyAdded.count(desc))
+            if (inBlock.count(desc))
                 continue;
             ++nDescendantsUpdated;
             modtxiter mit = mapModifiedTx.find(desc);
@@ -285,7 +361,7 @@ bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_tran
     return mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it);
 }
 
-void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries)
+void BlockAssembler::SortForBlock(const CTxMemPool::vecEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries)
 {
     // Sort package by ancestor count
     // If a transaction A depends on transaction B, then A's ancestor count
@@ -316,7 +392,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
     // Start by adding all descendants of previously added txs to mapModifiedTx
     // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
+    UpdatePackagesForAdded(CTxMemPool::vecEntries(inBlock.begin(), inBlock.end()), mapModifiedTx);
 
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = m_mempool.mapTx.get<ancestor_score>().begin();
     CTxMemPool::txiter iter;
@@ -398,13 +474,13 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
-        CTxMemPool::setEntries ancestors;
+        CTxMemPool::vecEntries ancestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
         std::string dummy;
         m_mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
 
         onlyUnconfirmed(ancestors);
-        ancestors.insert(iter);
+        ancestors.push_back(iter);
 
         // Test if all tx's are Final
         if (!TestPackageTransactions(ancestors)) {
@@ -19,6 +19,7 @@
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <span.h>
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
@@ -111,6 +112,24 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string m_type;
+    //! If set, keeps external_data valid, which is sent as the payload instead of data without being copied (e.g. a block in a mapped blk file).
+    std::shared_ptr<const void> external_owner;
+    Span<const unsigned char> external_data;
+
+    Span<const unsigned char> Payload() const { return external_owner ? external_data : MakeSpan(data); }
+};
+
+/** Bytes queued for sending to a peer: a message header, or a message payload that is owned or external (see CSerializedNetMsg). */
+struct CNetSendBuffer
+{
+    explicit CNetSendBuffer(std::vector<unsigned char>&& data_in) : data(std::move(data_in)) {}
+    CNetSendBuffer(std::shared_ptr<const void> owner, Span<const unsigned char> bytes) : external_owner(std::move(owner)), external_data(bytes) {}
+
+    std::vector<unsigned char> data;
+    std::shared_ptr<const void> external_owner;
+    Span<const unsigned char> external_data;
+
+    Span<const unsigned char> Bytes() const { return external_owner ? external_data : MakeSpan(data); }
 };
 
 
@@ -728,7 +747,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CNetSendBuffer> vSendMsg GUARDED_BY(cs_vSend);
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -16,6 +16,8 @@
 #include <merkleblock.h>
 #include <netbase.h>
 #include <netmessagemaker.h>
+#include <node/blockservecache.h>
+#include <optional.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <primitives/block.h>
@@ -101,6 +103,8 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
 /** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
 static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Maximum depth of blocks whose serialized block and compact block messages are cached for other peers. */
+static const int MAX_BLOCK_SERVE_CACHE_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
@@ -209,6 +213,9 @@ namespace {
     Mutex g_cs_recent_confirmed_transactions;
     std::unique_ptr<CRollingBloomFilter> g_recent_confirmed_transactions GUARDED_BY(g_cs_recent_confirmed_transactions);
 
+    /** Serialized messages for recent blocks, sent to peers that request them in getdata. */
+    BlockServeCache g_block_serve_cache{DEFAULT_BLOCK_SERVE_CACHE_SIZE << 20};
+
     /** Blocks that are in flight, and that are in the queue to be downloaded. */
     struct QueuedBlock {
         uint256 hash;
@@ -751,6 +758,48 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     }
 }
 
+/** While a snapshot chainstate is validated in the background, add the not-in-flight blocks
+ *  between from_tip (the tip of the background validation chainstate) and target (the snapshot
+ *  base) that are missing to vBlocks, until it has at most count entries. Only blocks within
+ *  BLOCK_DOWNLOAD_WINDOW of from_tip are fetched. */
+static void FindNextHistoricalBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, const CBlockIndex* from_tip, const CBlockIndex* target, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (vBlocks.size() >= count)
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    // The peer has to be on the chain of the snapshot.
+    if (state->pindexBestKnownBlock == nullptr || state->pindexBestKnownBlock->GetAncestor(target->nHeight) != target)
+        return;
+
+    const int nMaxHeight = std::min<int>(target->nHeight, from_tip->nHeight + BLOCK_DOWNLOAD_WINDOW);
+    if (nMaxHeight <= from_tip->nHeight)
+        return;
+    std::vector<const CBlockIndex*> vToFetch(nMaxHeight - from_tip->nHeight);
+    const CBlockIndex* pindexWalk = target->GetAncestor(nMaxHeight);
+    for (auto it = vToFetch.rbegin(); it != vToFetch.rend(); ++it) {
+        *it = pindexWalk;
+        pindexWalk = pindexWalk->pprev;
+    }
+
+    for (const CBlockIndex* pindex : vToFetch) {
+        if (pindex->nStatus & BLOCK_FAILED_MASK) {
+            // Background validation will not get past this block.
+            return;
+        }
+        if (!state->fHaveWitness && IsWitnessEnabled(pindex->pprev, consensusParams)) {
+            return;
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) && mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
+            vBlocks.push_back(pindex);
+            if (vBlocks.size() == count) {
+                return;
+            }
+        }
+    }
+}
+
 void EraseTxRequest(const GenTxid& gtxid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     g_already_asked_for.erase(gtxid.GetHash());
@@ -919,6 +968,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     return true;
 }
 
+BlockServeCacheStats GetBlockServeCacheStats()
+{
+    return g_block_serve_cache.GetStats();
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -1216,6 +1270,8 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     // same probability that we have in the reject filter).
     g_recent_confirmed_transactions.reset(new CRollingBloomFilter(48000, 0.000001));
 
+    g_block_serve_cache.SetMaxUsage(std::max<int64_t>(0, gArgs.GetArg("-blockservecache", DEFAULT_BLOCK_SERVE_CACHE_SIZE)) << 20);
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
     // don't want them to get out of sync due to drift in the scheduler, so we
@@ -1513,6 +1569,18 @@ static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman&
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/** Push a block or compact block message, first adding its payload to the serialized block cache if format is set. */
+static void PushBlockMessage(CConnman& connman, CNode& pfrom, CSerializedNetMsg&& msg, const uint256& hash, const Optional<ServedBlockFormat>& format)
+{
+    if (format) {
+        auto payload = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+        g_block_serve_cache.Insert(hash, *format, payload);
+        msg.external_data = *payload;
+        msg.external_owner = std::move(payload);
+    }
+    connman.PushMessage(&pfrom, std::move(msg));
+}
+
 void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, const CInv& inv, CConnman& connman)
 {
     bool send = false;
@@ -1585,17 +1653,51 @@ void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, c
     // it's available before trying to send.
     if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
     {
+        // If a peer is asking for old blocks, we're almost guaranteed
+        // they won't have a useful mempool to match against a compact block,
+        // and we don't feel like constructing the object for them, so
+        // instead we respond with the full, non-compact block.
+        const bool fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
+        const bool send_compact = inv.type == MSG_CMPCT_BLOCK && CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH;
+
+        // Block and compact block messages for blocks near the tip, which many
+        // peers request at about the same time, are cached once serialized.
+        Optional<ServedBlockFormat> cache_format;
+        if (pindex->nHeight >= ::ChainActive().Height() - MAX_BLOCK_SERVE_CACHE_DEPTH) {
+            if (inv.type == MSG_BLOCK) {
+                cache_format = ServedBlockFormat::BLOCK_NO_WITNESS;
+            } else if (inv.type == MSG_WITNESS_BLOCK) {
+                cache_format = ServedBlockFormat::BLOCK;
+            } else if (inv.type == MSG_CMPCT_BLOCK && send_compact) {
+                cache_format = fPeerWantsWitness ? ServedBlockFormat::CMPCT_BLOCK : ServedBlockFormat::CMPCT_BLOCK_NO_WITNESS;
+            } else if (inv.type == MSG_CMPCT_BLOCK) {
+                cache_format = fPeerWantsWitness ? ServedBlockFormat::BLOCK : ServedBlockFormat::BLOCK_NO_WITNESS;
+            }
+        }
+        BlockServeCache::Payload cached_payload;
+        if (cache_format) cached_payload = g_block_serve_cache.Get(inv.hash, *cache_format);
+
         std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        if (cached_payload) {
+            connman.PushMessage(&pfrom, msgMaker.MakeExternal(send_compact ? NetMsgType::CMPCTBLOCK : NetMsgType::BLOCK, cached_payload, *cached_payload));
+            // Don't set pblock as we've sent the block
+        } else if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
+        } else if (inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_BLOCK && !IsWitnessEnabled(pindex->pprev, consensusParams))) {
             // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+            // as the network format matches the format on disk. Blocks from before segwit
+            // activation cannot contain witnesses, so there is nothing to strip for MSG_BLOCK.
+            // The block is sent from a mapping of the block file, without copying it.
+            Span<const uint8_t> block_data;
+            std::shared_ptr<const void> block_owner;
+            if (!MapRawBlockFromDisk(block_data, block_owner, pindex, chainparams.MessageStart())) {
                 assert(!"cannot load block from disk");
             }
-            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+            if (cache_format) {
+                PushBlockMessage(connman, pfrom, msgMaker.Make(NetMsgType::BLOCK, block_data), inv.hash, cache_format);
+            } else {
+                connman.PushMessage(&pfrom, msgMaker.MakeExternal(NetMsgType::BLOCK, std::move(block_owner), block_data));
+            }
             // Don't set pblock as we've sent the block
         } else {
             // Send block from disk
@@ -1606,9 +1708,9 @@ void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, c
         }
         if (pblock) {
             if (inv.type == MSG_BLOCK)
-                connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
+                PushBlockMessage(connman, pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock), inv.hash, cache_format);
             else if (inv.type == MSG_WITNESS_BLOCK)
-                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                PushBlockMessage(connman, pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock), inv.hash, cache_format);
             else if (inv.type == MSG_FILTERED_BLOCK)
             {
                 bool sendMerkleBlock = false;
@@ -1637,25 +1739,19 @@ void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, c
             }
             else if (inv.type == MSG_CMPCT_BLOCK)
             {
-                // If a peer is asking for old blocks, we're almost guaranteed
-                // they won't have a useful mempool to match against a compact block,
-                // and we don't feel like constructing the object for them, so
-                // instead we respond with the full, non-compact block.
-                bool fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
                 int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                if (CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
+                if (send_compact) {
                     if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                        connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                        PushBlockMessage(connman, pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block), inv.hash, cache_format);
                     } else {
                         CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                        connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                        PushBlockMessage(connman, pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock), inv.hash, cache_format);
                     }
                 } else {
-                    connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                    PushBlockMessage(connman, pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock), inv.hash, cache_format);
                 }
             }
         }
-
         // Trigger the peer node to send a getblocks request for the next batch of inventory
         if (inv.hash == pfrom.hashContinue)
         {
@@ -1815,6 +1911,9 @@ static void ProcessHeadersMessage(CNode& pfrom, CConnman& connman, ChainstateMan
         return;
     }
 
+    // Hash the headers in a batch, before taking cs_main
+    const std::vector<uint256> hashes = GetBlockHeaderHashes(headers);
+
     bool received_new_header = false;
     const CBlockIndex *pindexLast = nullptr;
     {
@@ -1833,14 +1932,14 @@ static void ProcessHeadersMessage(CNode& pfrom, CConnman& connman, ChainstateMan
             nodestate->nUnconnectingHeaders++;
             connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexBestHeader), uint256()));
             LogPrint(BCLog::NET, "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
-                    headers[0].GetHash().ToString(),
+                    hashes[0].ToString(),
                     headers[0].hashPrevBlock.ToString(),
                     pindexBestHeader->nHeight,
                     pfrom.GetId(), nodestate->nUnconnectingHeaders);
             // Set hashLastUnknownBlock for this peer, so that if we
             // eventually get the headers - even from a different peer -
             // we can use this peer to download.
-            UpdateBlockAvailability(pfrom.GetId(), headers.back().GetHash());
+            UpdateBlockAvailability(pfrom.GetId(), hashes.back());
 
             if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
                 Misbehaving(pfrom.GetId(), 20, strprintf("%d non-connecting headers", nodestate->nUnconnectingHeaders));
@@ -1849,12 +1948,12 @@ static void ProcessHeadersMessage(CNode& pfrom, CConnman& connman, ChainstateMan
         }
 
         uint256 hashLastBlock;
-        for (const CBlockHeader& header : headers) {
-            if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
+        for (size_t i = 0; i < nCount; ++i) {
+            if (!hashLastBlock.IsNull() && headers[i].hashPrevBlock != hashLastBlock) {
                 Misbehaving(pfrom.GetId(), 20, "non-continuous headers sequence");
                 return;
             }
-            hashLastBlock = header.GetHash();
+            hashLastBlock = hashes[i];
         }
 
         // If we don't have the last header, then they'll have given us
@@ -1865,7 +1964,7 @@ static void ProcessHeadersMessage(CNode& pfrom, CConnman& connman, ChainstateMan
     }
 
     BlockValidationState state;
-    if (!chainman.ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast)) {
+    if (!chainman.ProcessNewBlockHeaders(headers, hashes, state, chainparams, &pindexLast)) {
         if (state.IsInvalid()) {
             MaybePunishNodeForBlock(pfrom.GetId(), state, via_compact_block, "invalid header received");
             return;
@@ -4491,6 +4590,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            // Fill the remaining slots with the blocks background validation needs.
+            // Pruned peers only serve recent blocks.
+            if (CChainState* background = m_chainman.BackgroundValidationChainstate()) {
+                if (!pto->m_limited_node) {
+                    FindNextHistoricalBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload,
+                        background->m_chain.Tip(), m_chainman.SnapshotBase(), consensusParams);
+                }
+            }
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(*pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
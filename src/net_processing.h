@@ -8,6 +8,7 @@
 
 #include <consensus/params.h>
 #include <net.h>
+#include <node/blockservecache.h>
 #include <sync.h>
 #include <validationinterface.h>
 
@@ -99,6 +100,9 @@ struct CNodeStateStats {
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 
+/** Get statistics of the cache of serialized recent blocks served to peers */
+BlockServeCacheStats GetBlockServeCacheStats();
+
 /** Relay transaction to every node */
 void RelayTransaction(const uint256& txid, const uint256& wtxid, const CConnman& connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
@@ -0,0 +1,124 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockprefetch.h>
+
+#include <chain.h>
+#include <primitives/block.h>
+
+#include <set>
+
+void CBlockPrefetcher::Thread()
+{
+    while (true) {
+        uint256 hash;
+        FlatFilePos pos;
+        const Consensus::Params* params;
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            while (m_queue.empty()) {
+                m_cond_worker.wait(lock);
+            }
+            hash = m_queue.front();
+            m_queue.pop_front();
+            auto it = m_entries.find(hash);
+            if (it == m_entries.end() || it->second.in_flight || it->second.done) continue;
+            it->second.in_flight = true;
+            pos = it->second.pos;
+            params = it->second.params;
+        }
+
+        std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+        bool ok = m_read_block(*block, pos, *params) && block->GetHash() == hash;
+
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            // Entries that are in flight are never erased, so this always succeeds.
+            auto it = m_entries.find(hash);
+            assert(it != m_entries.end());
+            it->second.in_flight = false;
+            it->second.done = true;
+            if (ok) it->second.block = std::move(block);
+        }
+        m_cond_done.notify_all();
+    }
+}
+
+void CBlockPrefetcher::Prefetch(const std::vector<const CBlockIndex*>& blocks, const Consensus::Params& params)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    std::set<uint256> wanted;
+    for (const CBlockIndex* pindex : blocks) {
+        if (wanted.size() >= m_max_blocks) break;
+        wanted.insert(pindex->GetBlockHash());
+    }
+
+    // Forget about blocks that left the window (for example after a reorg).
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it->second.in_flight && !wanted.count(it->first)) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    m_queue.clear();
+    for (const CBlockIndex* pindex : blocks) {
+        if (m_entries.size() >= m_max_blocks) break;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) continue;
+        auto res = m_entries.emplace(pindex->GetBlockHash(), Entry{});
+        Entry& entry = res.first->second;
+        if (res.second) {
+            entry.pos = pindex->GetBlockPos();
+            entry.params = &params;
+        }
+        if (!entry.in_flight && !entry.done) {
+            m_queue.push_back(pindex->GetBlockHash());
+        }
+    }
+
+    if (m_queue.size() == 1) {
+        m_cond_worker.notify_one();
+    } else if (m_queue.size() > 1) {
+        m_cond_worker.notify_all();
+    }
+}
+
+std::shared_ptr<const CBlock> CBlockPrefetcher::Take(const CBlockIndex* pindex)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    auto it = m_entries.find(hash);
+    if (it == m_entries.end()) return nullptr;
+    while (it->second.in_flight) {
+        m_cond_done.wait(lock);
+        it = m_entries.find(hash);
+        assert(it != m_entries.end());
+    }
+    // If the block was still queued, the caller reads it itself; the worker
+    // that pops the stale queue entry skips it.
+    std::shared_ptr<const CBlock> block = std::move(it->second.block);
+    m_entries.erase(it);
+    return block;
+}
+
+void CBlockPrefetcher::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_queue.clear();
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it->second.in_flight) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t CBlockPrefetcher::Size()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_entries.size();
+}
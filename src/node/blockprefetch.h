@@ -0,0 +1,100 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKPREFETCH_H
+#define BITCOIN_NODE_BLOCKPREFETCH_H
+
+#include <flatfile.h>
+#include <uint256.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+class CBlockIndex;
+namespace Consensus {
+struct Params;
+}
+
+/**
+ * Reads and deserializes blocks from disk ahead of the validation thread.
+ *
+ * The validation thread announces the blocks it is about to connect with
+ * Prefetch(); worker threads read them from the blk files in the background
+ * so that ConnectTip() can pick them up with Take() instead of reading them
+ * itself. Results are best-effort: a block that could not be read is simply
+ * not returned, and the caller falls back to ReadBlockFromDisk(), which
+ * reports the error.
+ */
+class CBlockPrefetcher
+{
+public:
+    //! Reads and deserializes the block at pos, checking its proof of work.
+    using ReadBlockFn = std::function<bool(CBlock&, const FlatFilePos&, const Consensus::Params&)>;
+
+private:
+    //! A block that was requested, is being read, or has been read.
+    struct Entry {
+        FlatFilePos pos;
+        const Consensus::Params* params{nullptr};
+        bool in_flight{false};
+        bool done{false};
+        std::shared_ptr<const CBlock> block;
+    };
+
+    //! Mutex to protect the inner state
+    boost::mutex m_mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable m_cond_worker;
+
+    //! Take() blocks on this while the requested block is being read
+    boost::condition_variable m_cond_done;
+
+    //! All tracked blocks, by block hash.
+    std::map<uint256, Entry> m_entries;
+
+    //! Blocks that still need to be read, in the order they were requested.
+    std::deque<uint256> m_queue;
+
+    //! Maximum number of blocks tracked at once (queued, in flight or ready).
+    const size_t m_max_blocks;
+
+    const ReadBlockFn m_read_block;
+
+public:
+    CBlockPrefetcher(size_t max_blocks, ReadBlockFn read_block) : m_max_blocks(max_blocks), m_read_block(std::move(read_block)) {}
+
+    //! Worker thread
+    void Thread();
+
+    /**
+     * Replace the prefetch window with the given blocks, in the order they
+     * will be connected. Entries that are not part of the new window are
+     * dropped (unless currently being read). The block positions are read
+     * from the index, so the caller must hold cs_main.
+     */
+    void Prefetch(const std::vector<const CBlockIndex*>& blocks, const Consensus::Params& params);
+
+    /**
+     * Return the prefetched block for pindex and stop tracking it. If the
+     * block is currently being read, wait for the read to finish. Returns
+     * nullptr if the block was not prefetched or could not be read.
+     */
+    std::shared_ptr<const CBlock> Take(const CBlockIndex* pindex);
+
+    //! Drop all entries that are not currently being read.
+    void Clear();
+
+    //! Number of blocks currently tracked.
+    size_t Size();
+};
+
+#endif // BITCOIN_NODE_BLOCKPREFETCH_H
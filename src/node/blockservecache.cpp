@@ -0,0 +1,82 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockservecache.h>
+
+#include <memusage.h>
+
+size_t BlockServeCache::EntryUsage(const Payload& payload)
+{
+    // The payload and its shared_ptr control block, the list node and the index node
+    return memusage::DynamicUsage(*payload) + memusage::MallocUsage(sizeof(*payload) + 2 * sizeof(void*)) +
+        memusage::MallocUsage(sizeof(Entry) + 2 * sizeof(void*)) +
+        memusage::MallocUsage(sizeof(std::pair<const Key, std::list<Entry>::iterator>) + 4 * sizeof(void*));
+}
+
+void BlockServeCache::Trim()
+{
+    while (m_usage > m_max_usage) {
+        const Entry& entry = m_entries.back();
+        m_usage -= EntryUsage(entry.second);
+        m_index.erase(entry.first);
+        m_entries.pop_back();
+        ++m_evictions;
+    }
+}
+
+void BlockServeCache::SetMaxUsage(size_t max_usage)
+{
+    LOCK(m_mutex);
+    m_max_usage = max_usage;
+    Trim();
+}
+
+BlockServeCache::Payload BlockServeCache::Get(const uint256& hash, ServedBlockFormat format)
+{
+    LOCK(m_mutex);
+    const auto it = m_index.find(Key{hash, format});
+    if (it == m_index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->second;
+}
+
+void BlockServeCache::Insert(const uint256& hash, ServedBlockFormat format, Payload payload)
+{
+    const size_t usage = EntryUsage(payload);
+    LOCK(m_mutex);
+    if (usage > m_max_usage) return;
+    const Key key{hash, format};
+    if (m_index.count(key)) return;
+    m_entries.emplace_front(key, std::move(payload));
+    m_index.emplace(key, m_entries.begin());
+    m_usage += usage;
+    ++m_inserts;
+    Trim();
+}
+
+void BlockServeCache::Clear()
+{
+    LOCK(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_usage = 0;
+}
+
+BlockServeCacheStats BlockServeCache::GetStats() const
+{
+    LOCK(m_mutex);
+    BlockServeCacheStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.inserts = m_inserts;
+    stats.evictions = m_evictions;
+    stats.entries = m_entries.size();
+    stats.usage = m_usage;
+    stats.max_usage = m_max_usage;
+    return stats;
+}
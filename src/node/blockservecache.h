@@ -0,0 +1,87 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKSERVECACHE_H
+#define BITCOIN_NODE_BLOCKSERVECACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/** Default for -blockservecache, the memory budget of the serialized block cache in MiB */
+static const int64_t DEFAULT_BLOCK_SERVE_CACHE_SIZE = 32;
+
+/** Serializations of a block that are sent to peers. */
+enum class ServedBlockFormat : uint8_t {
+    BLOCK,                  //!< block message with witnesses
+    BLOCK_NO_WITNESS,       //!< block message without witnesses
+    CMPCT_BLOCK,            //!< cmpctblock message with wtxid short ids and witnesses
+    CMPCT_BLOCK_NO_WITNESS, //!< cmpctblock message with txid short ids, without witnesses
+};
+
+struct BlockServeCacheStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t inserts{0};
+    uint64_t evictions{0};
+    size_t entries{0};
+    size_t usage{0};
+    size_t max_usage{0};
+};
+
+/**
+ * Least recently used cache of serialized block and compact block message
+ * payloads, for the recent blocks that many peers request at about the same
+ * time. Payloads are shared, so that they can be sent from the cache without
+ * copying them (see CSerializedNetMsg::external_owner). Payloads that are
+ * still queued for sending stay alive after being evicted, and no longer
+ * count towards the memory budget.
+ */
+class BlockServeCache
+{
+public:
+    using Payload = std::shared_ptr<const std::vector<unsigned char>>;
+
+    explicit BlockServeCache(size_t max_usage) : m_max_usage(max_usage) {}
+
+    /** Set the memory budget in bytes, evicting entries beyond it. */
+    void SetMaxUsage(size_t max_usage);
+
+    /** Get the cached payload of the block with hash in format, or nullptr. */
+    Payload Get(const uint256& hash, ServedBlockFormat format);
+
+    /** Add a payload, unless it is cached already or larger than the memory budget. */
+    void Insert(const uint256& hash, ServedBlockFormat format, Payload payload);
+
+    void Clear();
+
+    BlockServeCacheStats GetStats() const;
+
+private:
+    using Key = std::pair<uint256, ServedBlockFormat>;
+    using Entry = std::pair<Key, Payload>;
+
+    static size_t EntryUsage(const Payload& payload);
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    mutable Mutex m_mutex;
+    //! Entries from most to least recently used
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    std::map<Key, std::list<Entry>::iterator> m_index GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    size_t m_max_usage GUARDED_BY(m_mutex);
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+    uint64_t m_inserts GUARDED_BY(m_mutex){0};
+    uint64_t m_evictions GUARDED_BY(m_mutex){0};
+};
+
+#endif // BITCOIN_NODE_BLOCKSERVECACHE_H
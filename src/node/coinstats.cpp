@@ -123,3 +123,22 @@ static void FinalizeHash(CHashWriter& ss, CCoinsStats& stats)
     stats.hashSerialized = ss.GetHash();
 }
 static void FinalizeHash(std::nullptr_t, CCoinsStats& stats) {}
+
+CoinsStatsHasher::CoinsStatsHasher(const uint256& best_block, int height) : m_ss(SER_GETHASH, PROTOCOL_VERSION)
+{
+    m_stats.hashBlock = best_block;
+    m_stats.nHeight = height;
+    PrepareHash(m_ss, m_stats);
+}
+
+void CoinsStatsHasher::Add(const uint256& txid, const std::map<uint32_t, Coin>& outputs)
+{
+    ApplyStats(m_stats, m_ss, txid, outputs);
+    m_stats.coins_count += outputs.size();
+}
+
+CCoinsStats CoinsStatsHasher::Finalize()
+{
+    FinalizeHash(m_ss, m_stats);
+    return m_stats;
+}
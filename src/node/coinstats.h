@@ -7,12 +7,15 @@
 #define BITCOIN_NODE_COINSTATS_H
 
 #include <amount.h>
+#include <hash.h>
 #include <uint256.h>
 
 #include <cstdint>
 #include <functional>
+#include <map>
 
 class CCoinsView;
+class Coin;
 
 enum class CoinStatsHashType {
     HASH_SERIALIZED,
@@ -34,6 +37,27 @@ struct CCoinsStats
     uint64_t coins_count{0};
 };
 
+/**
+ * Calculates the statistics, including the HASH_SERIALIZED hash, of a UTXO set
+ * whose transactions are added one at a time in txid order, the order in which
+ * GetUTXOStats() finds them in the coins database.
+ */
+class CoinsStatsHasher
+{
+public:
+    CoinsStatsHasher(const uint256& best_block, int height);
+
+    //! Add the unspent outputs of the transaction txid.
+    void Add(const uint256& txid, const std::map<uint32_t, Coin>& outputs);
+
+    //! @returns the statistics of the transactions added. Call only once.
+    CCoinsStats Finalize();
+
+private:
+    CCoinsStats m_stats;
+    CHashWriter m_ss;
+};
+
 //! Calculate statistics about the unspent transaction output set
 bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, const CoinStatsHashType hash_type, const std::function<void()>& interruption_point = {});
 
@@ -0,0 +1,219 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <clientversion.h>
+#include <coins.h>
+#include <logging.h>
+#include <node/coinstats.h>
+#include <streams.h>
+#include <sync.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <thread>
+
+//! Number of coins after which WriteUTXOSnapshot starts a new chunk.
+static constexpr uint64_t SNAPSHOT_CHUNK_COINS{5000};
+//! Maximum number of encoder threads of WriteUTXOSnapshot.
+static constexpr int MAX_SNAPSHOT_ENCODE_THREADS{4};
+//! Number of chunks per encoder thread WriteUTXOSnapshot buffers at most.
+static constexpr size_t SNAPSHOT_CHUNKS_PER_THREAD{4};
+
+uint64_t SnapshotChunk::CoinsCount() const
+{
+    uint64_t count{0};
+    for (const SnapshotTxOutputs& tx : m_txs) {
+        count += tx.second.size();
+    }
+    return count;
+}
+
+namespace {
+
+//! A chunk on its way from the cursor walk to the file.
+struct PendingChunk {
+    SnapshotChunk chunk;
+    std::vector<unsigned char> encoded;
+    bool is_encoded{false};
+};
+
+/**
+ * The chunks WriteUTXOSnapshot has read from the cursor but not written yet,
+ * in cursor order. Chunk number seq is at m_chunks[seq - m_front_seq].
+ */
+class SnapshotWriteQueue
+{
+public:
+    explicit SnapshotWriteQueue(size_t max_chunks) : m_max_chunks(max_chunks) {}
+
+    //! Queue the next chunk of the cursor walk, waiting for room if needed.
+    //! @returns false if the pipeline failed.
+    bool Push(SnapshotChunk&& chunk)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&] { return m_failed || m_chunks.size() < m_max_chunks; });
+        if (m_failed) return false;
+        m_chunks.emplace_back();
+        m_chunks.back().chunk = std::move(chunk);
+        m_cv.notify_all();
+        return true;
+    }
+
+    //! Signal that there are no more chunks, or that the pipeline failed.
+    void Finish(bool failed)
+    {
+        LOCK(m_mutex);
+        m_done = true;
+        m_failed |= failed;
+        m_cv.notify_all();
+    }
+
+    bool Failed()
+    {
+        LOCK(m_mutex);
+        return m_failed;
+    }
+
+    void EncodeLoop()
+    {
+        while (true) {
+            PendingChunk* pending;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cv.wait(lock, [&] { return m_failed || m_done || m_next_encode_seq < m_front_seq + m_chunks.size(); });
+                if (m_failed || m_next_encode_seq == m_front_seq + m_chunks.size()) return;
+                // References to deque elements survive push_back, and the
+                // writer does not pop this one before it is encoded.
+                pending = &m_chunks[m_next_encode_seq++ - m_front_seq];
+            }
+            CVectorWriter writer(SER_DISK, CLIENT_VERSION, pending->encoded, 0);
+            writer << pending->chunk;
+            LOCK(m_mutex);
+            pending->is_encoded = true;
+            m_cv.notify_all();
+        }
+    }
+
+    void WriteLoop(CAutoFile& file, CoinsStatsHasher& hasher)
+    {
+        while (true) {
+            PendingChunk pending;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cv.wait(lock, [&] { return m_failed || (m_chunks.empty() ? m_done : m_chunks.front().is_encoded); });
+                if (m_failed || m_chunks.empty()) return;
+                pending = std::move(m_chunks.front());
+                m_chunks.pop_front();
+                ++m_front_seq;
+                m_cv.notify_all();
+            }
+            for (const SnapshotTxOutputs& tx : pending.chunk.m_txs) {
+                hasher.Add(tx.first, tx.second);
+            }
+            try {
+                WriteCompactSize(file, pending.chunk.CoinsCount());
+                file << pending.encoded;
+            } catch (const std::ios_base::failure& e) {
+                LogPrintf("[snapshot] failed to write snapshot chunk: %s\n", e.what());
+                Finish(/* failed */ true);
+                return;
+            }
+        }
+    }
+
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    const size_t m_max_chunks;
+    std::deque<PendingChunk> m_chunks GUARDED_BY(m_mutex);
+    uint64_t m_front_seq GUARDED_BY(m_mutex){0};
+    uint64_t m_next_encode_seq GUARDED_BY(m_mutex){0};
+    bool m_done GUARDED_BY(m_mutex){false};
+    bool m_failed GUARDED_BY(m_mutex){false};
+};
+
+} // namespace
+
+bool WriteUTXOSnapshot(CCoinsViewCursor& cursor, int base_height, CAutoFile& file, SnapshotMetadata& metadata,
+                       CCoinsStats& stats, const std::function<void()>& interruption_point)
+{
+    metadata.m_version = SNAPSHOT_VERSION_COMPACT;
+    metadata.m_coins_count = 0;
+    // Written again below once the number of coins is known.
+    file << metadata;
+
+    const int num_encoders = std::max(1, std::min(GetNumCores() - 2, MAX_SNAPSHOT_ENCODE_THREADS));
+    SnapshotWriteQueue queue(num_encoders * SNAPSHOT_CHUNKS_PER_THREAD);
+    CoinsStatsHasher hasher(cursor.GetBestBlock(), base_height);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_encoders; ++i) {
+        threads.emplace_back([&queue, i] {
+            util::ThreadRename(strprintf("snapenc.%i", i));
+            queue.EncodeLoop();
+        });
+    }
+    threads.emplace_back([&] {
+        util::ThreadRename("snapwrite");
+        queue.WriteLoop(file, hasher);
+    });
+    auto join = [&](bool failed) {
+        queue.Finish(failed);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    };
+
+    bool read_ok = true;
+    try {
+        SnapshotChunk chunk;
+        uint64_t chunk_coins{0};
+        uint64_t coins_count{0};
+        COutPoint key;
+        Coin coin;
+        while (cursor.Valid()) {
+            if (coins_count % 5000 == 0 && interruption_point) interruption_point();
+            if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+                read_ok = false;
+                break;
+            }
+            if (chunk.m_txs.empty() || chunk.m_txs.back().first != key.hash) {
+                // Never split the outputs of a transaction across chunks.
+                if (chunk_coins >= SNAPSHOT_CHUNK_COINS) {
+                    if (!queue.Push(std::move(chunk))) break;
+                    chunk.m_txs.clear();
+                    chunk_coins = 0;
+                }
+                chunk.m_txs.emplace_back(key.hash, std::map<uint32_t, Coin>{});
+            }
+            chunk.m_txs.back().second.emplace(key.n, std::move(coin));
+            ++chunk_coins;
+            ++coins_count;
+            cursor.Next();
+        }
+        if (read_ok && !chunk.m_txs.empty()) queue.Push(std::move(chunk));
+    } catch (...) {
+        join(/* failed */ true);
+        throw;
+    }
+    join(/* failed */ !read_ok);
+    if (!read_ok || queue.Failed()) return false;
+
+    stats = hasher.Finalize();
+    metadata.m_coins_count = stats.coins_count;
+    try {
+        if (std::fseek(file.Get(), 0, SEEK_SET) != 0) return false;
+        file << metadata;
+    } catch (const std::ios_base::failure& e) {
+        LogPrintf("[snapshot] failed to write snapshot metadata: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
@@ -6,14 +6,40 @@
 #ifndef BITCOIN_NODE_UTXO_SNAPSHOT_H
 #define BITCOIN_NODE_UTXO_SNAPSHOT_H
 
-#include <uint256.h>
+#include <coins.h>
 #include <serialize.h>
+#include <uint256.h>
+
+#include <array>
+#include <cstring>
+#include <functional>
+#include <ios>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+class CAutoFile;
+class CCoinsViewCursor;
+struct CCoinsStats;
+
+//! Magic bytes at the start of the metadata of versioned snapshots. Snapshots
+//! without them are of SNAPSHOT_VERSION_LEGACY.
+static constexpr std::array<uint8_t, 5> SNAPSHOT_MAGIC_BYTES{{'u', 't', 'x', 'o', 0xff}};
+//! One (COutPoint, Coin) record per coin, and no magic bytes or version.
+static constexpr uint16_t SNAPSHOT_VERSION_LEGACY{1};
+//! Coins grouped by transaction in chunks that can be decoded independently,
+//! see SnapshotChunk.
+static constexpr uint16_t SNAPSHOT_VERSION_COMPACT{2};
 
 //! Metadata describing a serialized version of a UTXO set from which an
 //! assumeutxo CChainState can be constructed.
 class SnapshotMetadata
 {
 public:
+    //! The layout of the coins following the metadata.
+    uint16_t m_version = SNAPSHOT_VERSION_COMPACT;
+
     //! The hash of the block that reflects the tip of the chain for the
     //! UTXO set contained in this snapshot.
     uint256 m_base_blockhash;
@@ -30,12 +56,131 @@ public:
     SnapshotMetadata(
         const uint256& base_blockhash,
         uint64_t coins_count,
-        unsigned int nchaintx) :
+        unsigned int nchaintx,
+        uint16_t version = SNAPSHOT_VERSION_COMPACT) :
+            m_version(version),
             m_base_blockhash(base_blockhash),
             m_coins_count(coins_count),
             m_nchaintx(nchaintx) { }
 
-    SERIALIZE_METHODS(SnapshotMetadata, obj) { READWRITE(obj.m_base_blockhash, obj.m_coins_count, obj.m_nchaintx); }
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        if (m_version != SNAPSHOT_VERSION_LEGACY) {
+            s.write((const char*)SNAPSHOT_MAGIC_BYTES.data(), SNAPSHOT_MAGIC_BYTES.size());
+            s << m_version;
+        }
+        s << m_base_blockhash << m_coins_count << m_nchaintx;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        // Legacy snapshots start with the base block hash, whose first bytes
+        // are (about) as unlikely to match the magic bytes as any other hash.
+        std::array<uint8_t, SNAPSHOT_MAGIC_BYTES.size()> magic;
+        s.read((char*)magic.data(), magic.size());
+        if (magic == SNAPSHOT_MAGIC_BYTES) {
+            s >> m_version;
+            if (m_version != SNAPSHOT_VERSION_COMPACT) {
+                throw std::ios_base::failure("Unsupported snapshot version");
+            }
+            s >> m_base_blockhash;
+        } else {
+            m_version = SNAPSHOT_VERSION_LEGACY;
+            std::memcpy(m_base_blockhash.begin(), magic.data(), magic.size());
+            s.read((char*)m_base_blockhash.begin() + magic.size(), m_base_blockhash.size() - magic.size());
+        }
+        s >> m_coins_count >> m_nchaintx;
+    }
+};
+
+//! The unspent outputs of a transaction, by output index.
+using SnapshotTxOutputs = std::pair<uint256, std::map<uint32_t, Coin>>;
+
+/**
+ * A run of whole transactions of a SNAPSHOT_VERSION_COMPACT snapshot, in txid
+ * order. In the snapshot, a chunk is its number of coins followed by its
+ * serialization as a byte vector, so that a loader can hand chunks to several
+ * threads without decoding them first. The serialization is
+ *
+ * - CompactSize number of transactions, and for each of them
+ *   - txid
+ *   - CompactSize number of unspent outputs, and for each of them
+ *     - VARINT output index
+ *     - Coin (height, coinbase flag and the output, with its script and amount
+ *       compressed as in compressor.h)
+ */
+class SnapshotChunk
+{
+public:
+    std::vector<SnapshotTxOutputs> m_txs;
+
+    //! @returns the number of coins in the chunk.
+    uint64_t CoinsCount() const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, m_txs.size());
+        for (const SnapshotTxOutputs& tx : m_txs) {
+            s << tx.first;
+            WriteCompactSize(s, tx.second.size());
+            for (const auto& output : tx.second) {
+                s << VARINT(output.first);
+                s << output.second;
+            }
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        m_txs.clear();
+        const uint64_t num_txs = ReadCompactSize(s);
+        for (uint64_t i = 0; i < num_txs; ++i) {
+            m_txs.emplace_back();
+            SnapshotTxOutputs& tx = m_txs.back();
+            s >> tx.first;
+            if (i > 0 && !(m_txs[i - 1].first < tx.first)) {
+                throw std::ios_base::failure("Snapshot transactions out of order");
+            }
+            const uint64_t num_outputs = ReadCompactSize(s);
+            for (uint64_t j = 0; j < num_outputs; ++j) {
+                uint32_t n;
+                s >> VARINT(n);
+                // Avoid integer wrap-around in coinstats.cpp:ApplyHash
+                if (n == std::numeric_limits<uint32_t>::max()) {
+                    throw std::ios_base::failure("Snapshot output index out of range");
+                }
+                Coin coin;
+                s >> coin;
+                if (!tx.second.emplace(n, std::move(coin)).second) {
+                    throw std::ios_base::failure("Duplicate snapshot output");
+                }
+            }
+            if (tx.second.empty()) {
+                throw std::ios_base::failure("Snapshot transaction without outputs");
+            }
+        }
+    }
 };
 
+/**
+ * Write the metadata and the coins of the UTXO set cursor walks over to file,
+ * in SNAPSHOT_VERSION_COMPACT format.
+ *
+ * The cursor walk, the encoding of the chunks and the hashing and writing of
+ * the encoded chunks run concurrently on the calling thread, a few encoder
+ * threads and a writer thread. The number of coins in metadata is filled in
+ * once they have all been written.
+ *
+ * @param[in]     base_height  Height of the block the cursor's UTXO set is at.
+ * @param[in,out] metadata     Base block and transaction count of the snapshot.
+ * @param[out]    stats        Statistics and HASH_SERIALIZED hash of the UTXO set.
+ * @returns false if the coins could not be read or written.
+ */
+bool WriteUTXOSnapshot(CCoinsViewCursor& cursor, int base_height, CAutoFile& file, SnapshotMetadata& metadata,
+                       CCoinsStats& stats, const std::function<void()>& interruption_point = {});
+
 #endif // BITCOIN_NODE_UTXO_SNAPSHOT_H
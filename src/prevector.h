@@ -12,6 +12,8 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <memory>
+#include <stdexcept>
 #include <type_traits>
 #include <utility>
 
@@ -173,7 +175,7 @@ private:
                 T* indirect = indirect_ptr(0);
                 T* src = indirect;
                 T* dst = direct_ptr(0);
-                memcpy(dst, src, size() * sizeof(T));
+                memcpy(static_cast<void*>(dst), src, size() * sizeof(T));
                 free(indirect);
                 _size -= N + 1;
             }
@@ -190,7 +192,7 @@ private:
                 assert(new_indirect);
                 T* src = direct_ptr(0);
                 T* dst = reinterpret_cast<T*>(new_indirect);
-                memcpy(dst, src, size() * sizeof(T));
+                memcpy(static_cast<void*>(dst), src, size() * sizeof(T));
                 _union.indirect_contents.indirect = new_indirect;
                 _union.indirect_contents.capacity = new_capacity;
                 _size += N + 1;
@@ -202,7 +204,7 @@ private:
     const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
 
     void fill(T* dst, ptrdiff_t count, const T& value = T{}) {
-        std::fill_n(dst, count, value);
+        std::uninitialized_fill_n(dst, count, value);
     }
 
     template<typename InputIterator>
@@ -313,6 +315,16 @@ public:
         return *item_ptr(pos);
     }
 
+    T& at(size_type pos) {
+        if (pos >= size()) throw std::out_of_range("prevector::at");
+        return *item_ptr(pos);
+    }
+
+    const T& at(size_type pos) const {
+        if (pos >= size()) throw std::out_of_range("prevector::at");
+        return *item_ptr(pos);
+    }
+
     void resize(size_type new_size) {
         size_type cur_size = size();
         if (cur_size == new_size) {
@@ -351,7 +363,7 @@ public:
             change_capacity(new_size + (new_size >> 1));
         }
         T* ptr = item_ptr(p);
-        memmove(ptr + 1, ptr, (size() - p) * sizeof(T));
+        memmove(static_cast<void*>(ptr + 1), ptr, (size() - p) * sizeof(T));
         _size++;
         new(static_cast<void*>(ptr)) T(value);
         return iterator(ptr);
@@ -364,7 +376,7 @@ public:
             change_capacity(new_size + (new_size >> 1));
         }
         T* ptr = item_ptr(p);
-        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        memmove(static_cast<void*>(ptr + count), ptr, (size() - p) * sizeof(T));
         _size += count;
         fill(item_ptr(p), count, value);
     }
@@ -378,7 +390,7 @@ public:
             change_capacity(new_size + (new_size >> 1));
         }
         T* ptr = item_ptr(p);
-        memmove(ptr + count, ptr, (size() - p) * sizeof(T));
+        memmove(static_cast<void*>(ptr + count), ptr, (size() - p) * sizeof(T));
         _size += count;
         fill(ptr, first, last);
     }
@@ -420,7 +432,7 @@ public:
         } else {
             _size -= last - p;
         }
-        memmove(&(*first), &(*last), endp - ((char*)(&(*last))));
+        memmove(static_cast<void*>(&(*first)), &(*last), endp - ((char*)(&(*last))));
         return first;
     }
 
@@ -5,14 +5,34 @@
 
 #include <primitives/block.h>
 
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <streams.h>
 #include <tinyformat.h>
 
+#include <assert.h>
+
 uint256 CBlockHeader::GetHash() const
 {
     return SerializeHash(*this);
 }
 
+std::vector<uint256> GetBlockHeaderHashes(const std::vector<CBlockHeader>& headers)
+{
+    static constexpr size_t HEADER_SIZE{80};
+    std::vector<unsigned char> data;
+    data.reserve(headers.size() * HEADER_SIZE);
+    CVectorWriter writer(SER_GETHASH, PROTOCOL_VERSION, data, 0);
+    for (const CBlockHeader& header : headers) {
+        writer << header;
+    }
+    assert(data.size() == headers.size() * HEADER_SIZE);
+
+    std::vector<uint256> hashes(headers.size());
+    if (!hashes.empty()) SHA256D80(hashes[0].begin(), data.data(), hashes.size());
+    return hashes;
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -58,6 +58,10 @@ public:
     }
 };
 
+/** Compute the hashes of a batch of block headers, several at a time where
+ *  the hardware allows, which is faster than calling GetHash() on each. */
+std::vector<uint256> GetBlockHeaderHashes(const std::vector<CBlockHeader>& headers);
+
 
 class CBlock : public CBlockHeader
 {
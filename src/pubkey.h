@@ -9,6 +9,7 @@
 
 #include <hash.h>
 #include <serialize.h>
+#include <span.h>
 #include <uint256.h>
 
 #include <stdexcept>
@@ -71,7 +72,7 @@ private:
 
 public:
 
-    bool static ValidSize(const std::vector<unsigned char> &vch) {
+    bool static ValidSize(Span<const unsigned char> vch) {
       return vch.size() > 0 && GetLen(vch[0]) == vch.size();
     }
 
@@ -189,12 +190,12 @@ public:
      * Verify a DER signature (~72 bytes).
      * If this public key is not fully valid, the return value will be false.
      */
-    bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
+    bool Verify(const uint256& hash, Span<const unsigned char> vchSig) const;
 
     /**
      * Check whether a signature is normalized (lower-S).
      */
-    static bool CheckLowS(const std::vector<unsigned char>& vchSig);
+    static bool CheckLowS(Span<const unsigned char> vchSig);
 
     //! Recover a public key from a compact signature.
     bool RecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig);
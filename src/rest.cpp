@@ -244,6 +244,10 @@ static bool rest_block(HTTPRequest* req,
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
     CBlockIndex* tip = nullptr;
+    // The serialized block is served from the block file as is, unless witnesses
+    // must be stripped from a block that may have them.
+    Span<const uint8_t> block_data;
+    std::shared_ptr<const void> block_owner;
     {
         LOCK(cs_main);
         tip = ::ChainActive().Tip();
@@ -255,8 +259,24 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if ((rf == RetFormat::BINARY || rf == RetFormat::HEX) &&
+            (!(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS) || !IsWitnessEnabled(pblockindex->pprev, Params().GetConsensus()))) {
+            if (!MapRawBlockFromDisk(block_data, block_owner, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
+    }
+
+    if (block_owner) {
+        if (rf == RetFormat::BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, block_data, std::move(block_owner));
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(block_data) + "\n");
+        }
+        return true;
     }
 
     switch (rf) {
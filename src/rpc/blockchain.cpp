@@ -24,6 +24,7 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <script/sigcache.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -462,10 +463,8 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     info.pushKV("depends", depends);
 
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries& setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetHash().ToString());
+    for (const CTxMemPoolEntry* child : e.GetMemPoolChildrenConst()) {
+        spent.push_back(child->GetTx().GetHash().ToString());
     }
 
     info.pushKV("spentby", spent);
@@ -1347,7 +1346,7 @@ static UniValue getchaintips(const JSONRPCRequest& request)
     std::set<const CBlockIndex*> setOrphans;
     std::set<const CBlockIndex*> setPrevs;
 
-    for (const std::pair<const uint256, CBlockIndex*>& item : chainman.BlockIndex()) {
+    for (const auto& item : chainman.BlockIndex()) {
         if (!chainman.ActiveChain().Contains(item.second)) {
             setOrphans.insert(item.second);
             setPrevs.insert(item.second->pprev);
@@ -1444,6 +1443,67 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return MempoolInfoToJSON(EnsureMemPool(request.context));
 }
 
+static UniValue SignatureCacheStatsToJSON(const std::vector<SignatureCacheShardStats>& shards_stats)
+{
+    SignatureCacheShardStats total;
+    UniValue shards(UniValue::VARR);
+    for (const SignatureCacheShardStats& stats : shards_stats) {
+        UniValue shard(UniValue::VOBJ);
+        shard.pushKV("hits", stats.hits);
+        shard.pushKV("misses", stats.misses);
+        shard.pushKV("inserts", stats.inserts);
+        shard.pushKV("evictions", stats.evictions);
+        shard.pushKV("max_entries", uint64_t{stats.max_entries});
+        shards.push_back(shard);
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.inserts += stats.inserts;
+        total.evictions += stats.evictions;
+        total.max_entries += stats.max_entries;
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("hits", total.hits);
+    ret.pushKV("misses", total.misses);
+    ret.pushKV("inserts", total.inserts);
+    ret.pushKV("evictions", total.evictions);
+    ret.pushKV("max_entries", uint64_t{total.max_entries});
+    ret.pushKV("shards", shards);
+    return ret;
+}
+
+static UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+    const std::vector<RPCResult> cache_stats{
+        {RPCResult::Type::NUM, "hits", "Number of lookups that found their entry"},
+        {RPCResult::Type::NUM, "misses", "Number of lookups that did not find their entry"},
+        {RPCResult::Type::NUM, "inserts", "Number of entries added"},
+        {RPCResult::Type::NUM, "evictions", "Number of entries dropped to make room for others"},
+        {RPCResult::Type::NUM, "max_entries", "Number of entries the cache can hold"},
+    };
+    std::vector<RPCResult> cache_result{cache_stats};
+    cache_result.push_back({RPCResult::Type::ARR, "shards", "The same statistics for each of the independently locked shards of the cache",
+        {{RPCResult::Type::OBJ, "", "", cache_stats}}});
+            RPCHelpMan{"getsigcacheinfo",
+                "\nReturns statistics about the signature cache and the script execution cache since startup.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "signatures", "The cache of valid signatures", cache_result},
+                        {RPCResult::Type::OBJ, "script_executions", "The cache of transactions whose scripts are valid", cache_result},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+                },
+            }.Check(request);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("signatures", SignatureCacheStatsToJSON(GetSignatureCacheStats()));
+    ret.pushKV("script_executions", SignatureCacheStatsToJSON(GetScriptExecutionCacheStats()));
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
             RPCHelpMan{"preciousblock",
@@ -2283,6 +2343,7 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
                     {RPCResult::Type::NUM, "coins_written", "the number of coins written in the snapshot"},
                     {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
                     {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR_HEX, "txoutset_hash", "the hash of the UTXO set, as hash_serialized_2 in gettxoutsetinfo"},
                     {RPCResult::Type::STR, "path", "the absolute path that the snapshot was written to"},
                 }
         },
@@ -2312,9 +2373,8 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
 
     {
         // We need to lock cs_main to ensure that the coinsdb isn't written to
-        // between (i) flushing coins cache to disk (coinsdb), (ii) getting stats
-        // based upon the coinsdb, and (iii) constructing a cursor to the
-        // coinsdb for use below this block.
+        // between (i) flushing coins cache to disk (coinsdb) and (ii)
+        // constructing a cursor to the coinsdb for use below this block.
         //
         // Cursors returned by leveldb iterate over snapshots, so the contents
         // of the pcursor will not be affected by simultaneous writes during
@@ -2327,32 +2387,17 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
 
         ::ChainstateActive().ForceFlushStateToDisk();
 
-        if (!GetUTXOStats(&::ChainstateActive().CoinsDB(), stats, CoinStatsHashType::NONE, node.rpc_interruption_point)) {
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
-        }
-
         pcursor = std::unique_ptr<CCoinsViewCursor>(::ChainstateActive().CoinsDB().Cursor());
-        tip = LookupBlockIndex(stats.hashBlock);
+        tip = LookupBlockIndex(pcursor->GetBestBlock());
         CHECK_NONFATAL(tip);
     }
 
-    SnapshotMetadata metadata{tip->GetBlockHash(), stats.coins_count, tip->nChainTx};
-
-    afile << metadata;
-
-    COutPoint key;
-    Coin coin;
-    unsigned int iter{0};
-
-    while (pcursor->Valid()) {
-        if (iter % 5000 == 0) node.rpc_interruption_point();
-        ++iter;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            afile << key;
-            afile << coin;
-        }
+    SnapshotMetadata metadata{tip->GetBlockHash(), /* coins_count */ 0, tip->nChainTx};
 
-        pcursor->Next();
+    if (!WriteUTXOSnapshot(*pcursor, tip->nHeight, afile, metadata, stats, node.rpc_interruption_point)) {
+        afile.fclose();
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to write UTXO snapshot");
     }
 
     afile.fclose();
@@ -2362,6 +2407,87 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
     result.pushKV("coins_written", stats.coins_count);
     result.pushKV("base_hash", tip->GetBlockHash().ToString());
     result.pushKV("base_height", tip->nHeight);
+    result.pushKV("txoutset_hash", stats.hashSerialized.GetHex());
+    result.pushKV("path", path.string());
+    return result;
+}
+
+/**
+ * Load a serialized UTXO set from a file and activate a chainstate based on it.
+ *
+ * @see ChainstateManager::ActivateSnapshot
+ */
+static UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    RPCHelpMan{
+        "loadtxoutset",
+        "\nLoad the serialized UTXO set from disk.\n"
+        "Once this snapshot is loaded, its contents will be "
+        "deserialized into a second chainstate data structure, which is then used to sync to "
+        "the network's tip. The header of the snapshot base block must be known, and the "
+        "contents of the snapshot must match the assumeutxo data of its height.\n"
+        "Meanwhile, the blocks up to the snapshot base are downloaded and validated in the "
+        "background, after which the snapshot is considered fully validated.\n"
+        "The snapshot does not survive a restart: its chainstate is deleted on startup, "
+        "and the node resumes syncing from the chainstate it had validated itself.\n",
+        {
+            {"path",
+                RPCArg::Type::STR,
+                RPCArg::Optional::NO,
+                /* default_val */ "",
+                "path to the snapshot file. If relative, will be prefixed by datadir."},
+        },
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::NUM, "coins_loaded", "the number of coins loaded from the snapshot"},
+                    {RPCResult::Type::STR_HEX, "tip_hash", "the hash of the base of the snapshot"},
+                    {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR, "path", "the absolute path that the snapshot was loaded from"},
+                }
+        },
+        RPCExamples{
+            HelpExampleCli("loadtxoutset", "utxo.dat")
+        }
+    }.Check(request);
+
+    ChainstateManager& chainman = EnsureChainman(request.context);
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+
+    FILE* file{fsbridge::fopen(path, "rb")};
+    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
+    if (afile.IsNull()) {
+        throw JSONRPCError(
+            RPC_INVALID_PARAMETER,
+            "Couldn't open file " + path.string() + " for reading.");
+    }
+
+    SnapshotMetadata metadata;
+    try {
+        afile >> metadata;
+    } catch (const std::ios_base::failure&) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Unable to read snapshot metadata from " + path.string());
+    }
+
+    if (!chainman.ActivateSnapshot(afile, metadata, /* in_memory */ false)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to load UTXO snapshot " + path.string() + ", see debug.log for details");
+    }
+
+    // Connect the blocks on top of the snapshot base that we already have.
+    BlockValidationState state;
+    if (!::ChainstateActive().ActivateBestChain(state, Params(), nullptr)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, state.ToString());
+    }
+
+    // Validate the chain up to the snapshot base as its blocks come in.
+    chainman.StartBackgroundValidation();
+
+    const CBlockIndex* base = WITH_LOCK(::cs_main, return LookupBlockIndex(metadata.m_base_blockhash));
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_loaded", metadata.m_coins_count);
+    result.pushKV("tip_hash", base->GetBlockHash().ToString());
+    result.pushKV("base_height", base->nHeight);
     result.pushKV("path", path.string());
     return result;
 }
@@ -2387,6 +2513,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getsigcacheinfo",        &getsigcacheinfo,        {} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
@@ -2405,6 +2532,7 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitforblockheight",     &waitforblockheight,     {"height","timeout"} },
     { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, {} },
     { "hidden",             "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "hidden",             "loadtxoutset",           &loadtxoutset,           {"path"} },
 };
 // clang-format on
 
@@ -706,6 +706,22 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    static std::chrono::seconds template_updated;
+    if (pindexPrev && pindexPrev == ::ChainActive().Tip() &&
+        mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
+        GetTime() - nStart < gArgs.GetArg("-blocktemplateupdate", DEFAULT_BLOCK_TEMPLATE_UPDATE))
+    {
+        // Bring the template up to date with the mempool rather than selecting
+        // its transactions again, until it is old enough to be rebuilt
+        CBlockIndex* pindexPrevNew = pindexPrev;
+        pindexPrev = nullptr;
+        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        const std::chrono::seconds now = GetTime<std::chrono::seconds>();
+        if (BlockAssembler(mempool, Params()).UpdateBlock(*pblocktemplate, template_updated)) {
+            pindexPrev = pindexPrevNew;
+            template_updated = now;
+        }
+    }
     if (pindexPrev != ::ChainActive().Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
@@ -716,6 +732,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
         CBlockIndex* pindexPrevNew = ::ChainActive().Tip();
         nStart = GetTime();
+        template_updated = std::chrono::seconds{nStart};
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
@@ -447,6 +447,44 @@ static UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+static UniValue getblockservecacheinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getblockservecacheinfo",
+                "\nReturns statistics since startup about the cache of serialized recent blocks and compact blocks\n"
+                "that are served to peers.\n",
+                {},
+                RPCResult{
+                   RPCResult::Type::OBJ, "", "",
+                   {
+                       {RPCResult::Type::NUM, "hits", "Number of block requests that were served from the cache"},
+                       {RPCResult::Type::NUM, "misses", "Number of block requests for recent blocks that were not in the cache"},
+                       {RPCResult::Type::NUM, "hit_rate", "hits divided by hits plus misses, 0 without requests"},
+                       {RPCResult::Type::NUM, "inserts", "Number of serialized messages added"},
+                       {RPCResult::Type::NUM, "evictions", "Number of serialized messages dropped to stay within the memory budget"},
+                       {RPCResult::Type::NUM, "entries", "Number of serialized messages in the cache"},
+                       {RPCResult::Type::NUM, "usage", "Memory used by the cache in bytes"},
+                       {RPCResult::Type::NUM, "max_usage", "Memory budget of the cache in bytes (-blockservecache)"},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getblockservecacheinfo", "")
+            + HelpExampleRpc("getblockservecacheinfo", "")
+                },
+            }.Check(request);
+
+    const BlockServeCacheStats stats = GetBlockServeCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    obj.pushKV("hit_rate", stats.hits + stats.misses ? double(stats.hits) / (stats.hits + stats.misses) : 0.0);
+    obj.pushKV("inserts", stats.inserts);
+    obj.pushKV("evictions", stats.evictions);
+    obj.pushKV("entries", uint64_t{stats.entries});
+    obj.pushKV("usage", uint64_t{stats.usage});
+    obj.pushKV("max_usage", uint64_t{stats.max_usage});
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -788,6 +826,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getblockservecacheinfo", &getblockservecacheinfo, {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
@@ -12,7 +12,7 @@
 #include <script/script.h>
 #include <uint256.h>
 
-typedef std::vector<unsigned char> valtype;
+typedef ScriptStackElement valtype;
 
 namespace {
 
@@ -32,7 +32,7 @@ inline bool set_error(ScriptError* ret, const ScriptError serror)
 
 } // namespace
 
-bool CastToBool(const valtype& vch)
+bool CastToBool(Span<const unsigned char> vch)
 {
     for (unsigned int i = 0; i < vch.size(); i++)
     {
@@ -53,14 +53,14 @@ bool CastToBool(const valtype& vch)
  */
 #define stacktop(i)  (stack.at(stack.size()+(i)))
 #define altstacktop(i)  (altstack.at(altstack.size()+(i)))
-static inline void popstack(std::vector<valtype>& stack)
+static inline void popstack(ScriptStack& stack)
 {
     if (stack.empty())
         throw std::runtime_error("popstack(): stack empty");
     stack.pop_back();
 }
 
-bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
+bool static IsCompressedOrUncompressedPubKey(Span<const unsigned char> vchPubKey) {
     if (vchPubKey.size() < CPubKey::COMPRESSED_SIZE) {
         //  Non-canonical public key: too short
         return false;
@@ -82,7 +82,7 @@ bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     return true;
 }
 
-bool static IsCompressedPubKey(const valtype &vchPubKey) {
+bool static IsCompressedPubKey(Span<const unsigned char> vchPubKey) {
     if (vchPubKey.size() != CPubKey::COMPRESSED_SIZE) {
         //  Non-canonical public key: invalid length for compressed key
         return false;
@@ -104,7 +104,7 @@ bool static IsCompressedPubKey(const valtype &vchPubKey) {
  *
  * This function is consensus-critical since BIP66.
  */
-bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
+bool static IsValidSignatureEncoding(Span<const unsigned char> sig) {
     // Format: 0x30 [total-length] 0x02 [R-length] [R] 0x02 [S-length] [S] [sighash]
     // * total-length: 1-byte length descriptor of everything that follows,
     //   excluding the sighash byte.
@@ -169,24 +169,23 @@ bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
     return true;
 }
 
-bool static IsLowDERSignature(const valtype &vchSig, ScriptError* serror) {
+bool static IsLowDERSignature(Span<const unsigned char> vchSig, ScriptError* serror) {
     if (!IsValidSignatureEncoding(vchSig)) {
         return set_error(serror, SCRIPT_ERR_SIG_DER);
     }
     // https://bitcoin.stackexchange.com/a/12556:
     //     Also note that inside transaction signatures, an extra hashtype byte
     //     follows the actual signature data.
-    std::vector<unsigned char> vchSigCopy(vchSig.begin(), vchSig.begin() + vchSig.size() - 1);
     // If the S value is above the order of the curve divided by two, its
     // complement modulo the order could have been used instead, which is
     // one byte shorter when encoded correctly.
-    if (!CPubKey::CheckLowS(vchSigCopy)) {
+    if (!CPubKey::CheckLowS(vchSig.first(vchSig.size() - 1))) {
         return set_error(serror, SCRIPT_ERR_SIG_HIGH_S);
     }
     return true;
 }
 
-bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
+bool static IsDefinedHashtypeSignature(Span<const unsigned char> vchSig) {
     if (vchSig.size() == 0) {
         return false;
     }
@@ -197,7 +196,7 @@ bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
     return true;
 }
 
-bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror) {
+bool CheckSignatureEncoding(Span<const unsigned char> vchSig, unsigned int flags, ScriptError* serror) {
     // Empty signature. Not strictly DER encoded, but allowed to provide a
     // compact way to provide an invalid signature for use with CHECK(MULTI)SIG
     if (vchSig.size() == 0) {
@@ -214,7 +213,7 @@ bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned i
     return true;
 }
 
-bool static CheckPubKeyEncoding(const valtype &vchPubKey, unsigned int flags, const SigVersion &sigversion, ScriptError* serror) {
+bool static CheckPubKeyEncoding(Span<const unsigned char> vchPubKey, unsigned int flags, const SigVersion &sigversion, ScriptError* serror) {
     if ((flags & SCRIPT_VERIFY_STRICTENC) != 0 && !IsCompressedOrUncompressedPubKey(vchPubKey)) {
         return set_error(serror, SCRIPT_ERR_PUBKEYTYPE);
     }
@@ -225,7 +224,7 @@ bool static CheckPubKeyEncoding(const valtype &vchPubKey, unsigned int flags, co
     return true;
 }
 
-bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
+bool static CheckMinimalPush(Span<const unsigned char> data, opcodetype opcode) {
     // Excludes OP_1NEGATE, OP_1-16 since they are by definition minimal
     assert(0 <= opcode && opcode <= OP_PUSHDATA4);
     if (data.size() == 0) {
@@ -342,19 +341,30 @@ public:
 };
 }
 
+/** FindAndDelete(scriptCode, CScript() << vchSig), for pre-segwit signature checks. */
+static int FindAndDeleteSig(CScript& scriptCode, Span<const unsigned char> vchSig)
+{
+    // The push of a signature is longer than the signature, so it cannot be
+    // found in a script code that is not longer than the signature. That is
+    // the case for the usual single key script codes, which saves building
+    // the push.
+    if (vchSig.size() >= scriptCode.size()) return 0;
+    return FindAndDelete(scriptCode, CScript() << vchSig);
+}
+
 /** Helper for OP_CHECKSIG and OP_CHECKSIGVERIFY
  *
  * A return value of false means the script fails entirely. When true is returned, the
  * fSuccess variable indicates whether the signature check itself succeeded.
  */
-static bool EvalChecksig(const valtype& vchSig, const valtype& vchPubKey, CScript::const_iterator pbegincodehash, CScript::const_iterator pend, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror, bool& fSuccess)
+static bool EvalChecksig(Span<const unsigned char> vchSig, Span<const unsigned char> vchPubKey, CScript::const_iterator pbegincodehash, CScript::const_iterator pend, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror, bool& fSuccess)
 {
     // Subset of script starting at the most recent codeseparator
     CScript scriptCode(pbegincodehash, pend);
 
     // Drop the signature in pre-segwit scripts but not segwit scripts
     if (sigversion == SigVersion::BASE) {
-        int found = FindAndDelete(scriptCode, CScript() << vchSig);
+        int found = FindAndDeleteSig(scriptCode, vchSig);
         if (found > 0 && (flags & SCRIPT_VERIFY_CONST_SCRIPTCODE))
             return set_error(serror, SCRIPT_ERR_SIG_FINDANDDELETE);
     }
@@ -371,7 +381,7 @@ static bool EvalChecksig(const valtype& vchSig, const valtype& vchPubKey, CScrip
     return true;
 }
 
-bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+bool EvalScript(ScriptStack& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -379,15 +389,15 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     // static const CScriptNum bnTrue(1);
     static const valtype vchFalse(0);
     // static const valtype vchZero(0);
-    static const valtype vchTrue(1, 1);
+    static const valtype vchTrue(1, (unsigned char)1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
     CScript::const_iterator pbegincodehash = script.begin();
     opcodetype opcode;
-    valtype vchPushValue;
+    Span<const unsigned char> vchPushValue;
     ConditionStack vfExec;
-    std::vector<valtype> altstack;
+    ScriptStack altstack;
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > MAX_SCRIPT_SIZE)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -437,7 +447,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 if (fRequireMinimal && !CheckMinimalPush(vchPushValue, opcode)) {
                     return set_error(serror, SCRIPT_ERR_MINIMALDATA);
                 }
-                stack.push_back(vchPushValue);
+                stack.emplace_back(vchPushValue.begin(), vchPushValue.end());
             } else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))
             switch (opcode)
             {
@@ -464,7 +474,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -707,8 +717,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 -- x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-4), stacktop(-2));
-                    swap(stacktop(-3), stacktop(-1));
+                    std::swap(stacktop(-4), stacktop(-2));
+                    std::swap(stacktop(-3), stacktop(-1));
                 }
                 break;
 
@@ -727,7 +737,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -794,8 +804,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     //  x2 x3 x1  after second swap
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-3), stacktop(-2));
-                    swap(stacktop(-2), stacktop(-1));
+                    std::swap(stacktop(-3), stacktop(-2));
+                    std::swap(stacktop(-2), stacktop(-1));
                 }
                 break;
 
@@ -804,7 +814,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    swap(stacktop(-2), stacktop(-1));
+                    std::swap(stacktop(-2), stacktop(-1));
                 }
                 break;
 
@@ -825,7 +835,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -887,7 +897,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     default:            assert(!"invalid opcode"); break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
                 }
                 break;
 
@@ -936,7 +946,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    stack.push_back(bn.getvch<valtype>());
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -1068,7 +1078,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     {
                         valtype& vchSig = stacktop(-isig-k);
                         if (sigversion == SigVersion::BASE) {
-                            int found = FindAndDelete(scriptCode, CScript() << vchSig);
+                            int found = FindAndDeleteSig(scriptCode, vchSig);
                             if (found > 0 && (flags & SCRIPT_VERIFY_CONST_SCRIPTCODE))
                                 return set_error(serror, SCRIPT_ERR_SIG_FINDANDDELETE);
                         }
@@ -1159,6 +1169,22 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     return set_success(serror);
 }
 
+bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+{
+    ScriptStack script_stack;
+    script_stack.reserve(stack.size());
+    for (const std::vector<unsigned char>& elem : stack) {
+        script_stack.emplace_back(elem.begin(), elem.end());
+    }
+    bool ret = EvalScript(script_stack, script, flags, checker, sigversion, serror);
+    // Callers may inspect the stack of a failed evaluation too.
+    stack.clear();
+    for (const valtype& elem : script_stack) {
+        stack.emplace_back(elem.begin(), elem.end());
+    }
+    return ret;
+}
+
 namespace {
 
 /**
@@ -1305,6 +1331,14 @@ void PrecomputedTransactionData::Init(const T& txTo)
     m_ready = true;
 }
 
+template <class T>
+void PrecomputedTransactionData::InitOnce(const T& txTo)
+{
+    std::call_once(m_init_once, [&] {
+        if (!m_ready) Init(txTo);
+    });
+}
+
 template <class T>
 PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
 {
@@ -1314,6 +1348,8 @@ PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
 // explicit instantiation
 template void PrecomputedTransactionData::Init(const CTransaction& txTo);
 template void PrecomputedTransactionData::Init(const CMutableTransaction& txTo);
+template void PrecomputedTransactionData::InitOnce(const CTransaction& txTo);
+template void PrecomputedTransactionData::InitOnce(const CMutableTransaction& txTo);
 template PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo);
 template PrecomputedTransactionData::PrecomputedTransactionData(const CMutableTransaction& txTo);
 
@@ -1386,24 +1422,23 @@ uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn
 }
 
 template <class T>
-bool GenericTransactionSignatureChecker<T>::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+bool GenericTransactionSignatureChecker<T>::VerifySignature(Span<const unsigned char> vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     return pubkey.Verify(sighash, vchSig);
 }
 
 template <class T>
-bool GenericTransactionSignatureChecker<T>::CheckSig(const std::vector<unsigned char>& vchSigIn, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
+bool GenericTransactionSignatureChecker<T>::CheckSig(Span<const unsigned char> vchSigIn, Span<const unsigned char> vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
 {
-    CPubKey pubkey(vchPubKey);
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
     if (!pubkey.IsValid())
         return false;
 
     // Hash type is one byte tacked on to the end of the signature
-    std::vector<unsigned char> vchSig(vchSigIn);
-    if (vchSig.empty())
+    if (vchSigIn.empty())
         return false;
-    int nHashType = vchSig.back();
-    vchSig.pop_back();
+    int nHashType = vchSigIn.back();
+    Span<const unsigned char> vchSig = vchSigIn.first(vchSigIn.size() - 1);
 
     uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, this->txdata);
 
@@ -1501,14 +1536,24 @@ bool GenericTransactionSignatureChecker<T>::CheckSequence(const CScriptNum& nSeq
 template class GenericTransactionSignatureChecker<CTransaction>;
 template class GenericTransactionSignatureChecker<CMutableTransaction>;
 
-static bool ExecuteWitnessScript(const Span<const valtype>& stack_span, const CScript& scriptPubKey, unsigned int flags, SigVersion sigversion, const BaseSignatureChecker& checker, ScriptError* serror)
+/** Disallow stack item size > MAX_SCRIPT_ELEMENT_SIZE in witness stack */
+static bool CheckWitnessElementSizes(Span<const std::vector<unsigned char>> stack, ScriptError* serror)
 {
-    std::vector<valtype> stack{stack_span.begin(), stack_span.end()};
-
-    // Disallow stack item size > MAX_SCRIPT_ELEMENT_SIZE in witness stack
-    for (const valtype& elem : stack) {
+    for (const std::vector<unsigned char>& elem : stack) {
         if (elem.size() > MAX_SCRIPT_ELEMENT_SIZE) return set_error(serror, SCRIPT_ERR_PUSH_SIZE);
     }
+    return true;
+}
+
+static bool ExecuteWitnessScript(const Span<const std::vector<unsigned char>>& stack_span, const CScript& scriptPubKey, unsigned int flags, SigVersion sigversion, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    if (!CheckWitnessElementSizes(stack_span, serror)) return false;
+
+    ScriptStack stack;
+    stack.reserve(stack_span.size());
+    for (const std::vector<unsigned char>& elem : stack_span) {
+        stack.emplace_back(elem.begin(), elem.end());
+    }
 
     // Run the script interpreter.
     if (!EvalScript(stack, scriptPubKey, flags, checker, sigversion, serror)) return false;
@@ -1519,10 +1564,106 @@ static bool ExecuteWitnessScript(const Span<const valtype>& stack_span, const CS
     return true;
 }
 
-static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion, const std::vector<unsigned char>& program, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+/*
+ * Template fast paths.
+ *
+ * The functions below verify spends of the common output types without
+ * running the script interpreter. Each one must produce exactly the result
+ * and the error that the interpreter would; VerifyScriptGeneric is kept
+ * around so tests and fuzzers can compare the two.
+ */
+
+/**
+ * Verify <sig> <pubkey> against OP_DUP OP_HASH160 <keyhash> OP_EQUALVERIFY
+ * OP_CHECKSIG, where scriptCode is that script. Like the interpreter, this
+ * fails with SCRIPT_ERR_EVAL_FALSE if the signature check fails.
+ */
+static bool VerifyKeyHashSpend(Span<const unsigned char> sig, Span<const unsigned char> pubkey, Span<const unsigned char> keyhash, const CScript& scriptCode, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+{
+    uint160 hash;
+    CHash160().Write(pubkey.data(), pubkey.size()).Finalize(hash.begin());
+    if (keyhash.size() != hash.size() || memcmp(hash.begin(), keyhash.data(), hash.size()) != 0) {
+        return set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+    }
+    bool success = true;
+    if (!EvalChecksig(sig, pubkey, scriptCode.begin(), scriptCode.end(), flags, checker, sigversion, serror, success)) return false;
+    if (!success) return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return true;
+}
+
+/**
+ * Match a scriptSig of exactly two data pushes that the interpreter would
+ * accept as they are: no larger than MAX_SCRIPT_ELEMENT_SIZE, and minimal if
+ * SCRIPT_VERIFY_MINIMALDATA is set.
+ */
+static bool MatchTwoPushes(const CScript& scriptSig, unsigned int flags, Span<const unsigned char>& first, Span<const unsigned char>& second)
+{
+    CScript::const_iterator pc = scriptSig.begin();
+    opcodetype opcode;
+    for (Span<const unsigned char>* data : {&first, &second}) {
+        if (!scriptSig.GetOp(pc, opcode, *data) || opcode > OP_PUSHDATA4) return false;
+        if (data->size() > MAX_SCRIPT_ELEMENT_SIZE) return false;
+        if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(*data, opcode)) return false;
+    }
+    return pc == scriptSig.end();
+}
+
+/**
+ * Verify a witness stack of <dummy> <sig>... against a standard multisig
+ * witness script. The caller makes sure the script matches MatchMultisig,
+ * consists of direct pushes only, and that there is one signature per
+ * required key. The signatures are checked in the same order as
+ * OP_CHECKMULTISIG does, so the same encoding errors are hit first.
+ */
+static bool ExecuteWitnessMultisig(Span<const std::vector<unsigned char>> stack, const std::vector<Span<const unsigned char>>& pubkeys, const CScript& scriptCode, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    if (!CheckWitnessElementSizes(stack, serror)) return false;
+
+    size_t sigs = stack.size() - 1;
+    size_t keys = pubkeys.size();
+    bool success = true;
+    while (success && sigs > 0) {
+        const std::vector<unsigned char>& sig = stack[sigs];
+        Span<const unsigned char> pubkey = pubkeys[keys - 1];
+        if (!CheckSignatureEncoding(sig, flags, serror) || !CheckPubKeyEncoding(pubkey, flags, SigVersion::WITNESS_V0, serror)) {
+            // serror is set
+            return false;
+        }
+        if (checker.CheckSig(sig, pubkey, scriptCode, SigVersion::WITNESS_V0)) {
+            --sigs;
+        }
+        --keys;
+        if (sigs > keys) success = false;
+    }
+
+    if (!success && (flags & SCRIPT_VERIFY_NULLFAIL)) {
+        for (const std::vector<unsigned char>& sig : stack.subspan(1)) {
+            if (sig.size()) return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+        }
+    }
+    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stack[0].size()) {
+        return set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+    }
+    if (!success) return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return true;
+}
+
+/** Whether all public keys of a MatchMultisig script are pushed with direct pushes, as the template fast path requires. */
+static bool IsDirectPushMultisig(const CScript& script, const std::vector<Span<const unsigned char>>& pubkeys)
+{
+    // OP_m, OP_n and OP_CHECKMULTISIG, plus one opcode byte per key. Any
+    // OP_PUSHDATA would make the script longer.
+    size_t size = 3;
+    for (const Span<const unsigned char>& pubkey : pubkeys) {
+        size += 1 + pubkey.size();
+    }
+    return script.size() == size;
+}
+
+static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion, Span<const unsigned char> program, unsigned int flags, const BaseSignatureChecker& checker, bool use_templates, ScriptError* serror)
 {
     CScript scriptPubKey;
-    Span<const valtype> stack{witness.stack};
+    Span<const std::vector<unsigned char>> stack{witness.stack};
 
     if (witversion == 0) {
         if (program.size() == WITNESS_V0_SCRIPTHASH_SIZE) {
@@ -1530,13 +1671,20 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
             if (stack.size() == 0) {
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_WITNESS_EMPTY);
             }
-            const valtype& script_bytes = SpanPopBack(stack);
+            const std::vector<unsigned char>& script_bytes = SpanPopBack(stack);
             scriptPubKey = CScript(script_bytes.begin(), script_bytes.end());
             uint256 hashScriptPubKey;
             CSHA256().Write(&scriptPubKey[0], scriptPubKey.size()).Finalize(hashScriptPubKey.begin());
             if (memcmp(hashScriptPubKey.begin(), program.data(), 32)) {
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH);
             }
+            if (use_templates) {
+                unsigned int required;
+                std::vector<Span<const unsigned char>> pubkeys;
+                if (MatchMultisig(scriptPubKey, required, pubkeys) && IsDirectPushMultisig(scriptPubKey, pubkeys) && stack.size() == required + 1) {
+                    return ExecuteWitnessMultisig(stack, pubkeys, scriptPubKey, flags, checker, serror);
+                }
+            }
             return ExecuteWitnessScript(stack, scriptPubKey, flags, SigVersion::WITNESS_V0, checker, serror);
         } else if (program.size() == WITNESS_V0_KEYHASH_SIZE) {
             // Special case for pay-to-pubkeyhash; signature + pubkey in witness
@@ -1544,6 +1692,10 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH); // 2 items in witness
             }
             scriptPubKey << OP_DUP << OP_HASH160 << program << OP_EQUALVERIFY << OP_CHECKSIG;
+            if (use_templates) {
+                if (!CheckWitnessElementSizes(stack, serror)) return false;
+                return VerifyKeyHashSpend(stack[0], stack[1], program, scriptPubKey, flags, checker, SigVersion::WITNESS_V0, serror);
+            }
             return ExecuteWitnessScript(stack, scriptPubKey, flags, SigVersion::WITNESS_V0, checker, serror);
         } else {
             return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_WRONG_LENGTH);
@@ -1558,7 +1710,7 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
     // There is intentionally no return statement here, to be able to use "control reaches end of non-void function" warnings to detect gaps in the logic above.
 }
 
-bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+static bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, bool use_templates, ScriptError* serror)
 {
     static const CScriptWitness emptyWitness;
     if (witness == nullptr) {
@@ -1572,9 +1724,54 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    int witnessversion;
+    Span<const unsigned char> witnessprogram;
+
+    if (use_templates) {
+        // Pay-to-pubkey-hash: the scriptSig pushes a signature and a public key.
+        Span<const unsigned char> sig, pubkey;
+        if (scriptPubKey.IsPayToPubKeyHash() && MatchTwoPushes(scriptSig, flags, sig, pubkey)) {
+            if (!VerifyKeyHashSpend(sig, pubkey, Span<const unsigned char>(scriptPubKey.data() + 3, 20), scriptPubKey, flags, checker, SigVersion::BASE, serror)) {
+                return false;
+            }
+            if ((flags & SCRIPT_VERIFY_WITNESS) && !witness->IsNull()) {
+                return set_error(serror, SCRIPT_ERR_WITNESS_UNEXPECTED);
+            }
+            return set_success(serror);
+        }
+
+        // Bare witness programs. Evaluating the scriptPubKey leaves the
+        // program on top of the stack, so it must not be false.
+        if ((flags & SCRIPT_VERIFY_WITNESS) && scriptSig.empty() && scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram)) {
+            if (!CastToBool(witnessprogram)) return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+            if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, use_templates, serror)) {
+                return false;
+            }
+            return set_success(serror);
+        }
+
+        // P2SH witness programs, with a scriptSig of exactly one push of the
+        // redeemScript.
+        if ((flags & SCRIPT_VERIFY_P2SH) && (flags & SCRIPT_VERIFY_WITNESS) && scriptPubKey.IsPayToScriptHash() && scriptSig.size() > 1 && scriptSig[0] == scriptSig.size() - 1) {
+            const CScript redeemScript(scriptSig.begin() + 1, scriptSig.end());
+            if (redeemScript.IsWitnessProgram(witnessversion, witnessprogram)) {
+                uint160 hash;
+                CHash160().Write(redeemScript.data(), redeemScript.size()).Finalize(hash.begin());
+                if (memcmp(hash.begin(), scriptPubKey.data() + 2, hash.size()) != 0) {
+                    return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+                }
+                if (!CastToBool(witnessprogram)) return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+                if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, use_templates, serror)) {
+                    return false;
+                }
+                return set_success(serror);
+            }
+        }
+    }
+
     // scriptSig and scriptPubKey must be evaluated sequentially on the same stack
     // rather than being simply concatenated (see CVE-2010-5141)
-    std::vector<std::vector<unsigned char> > stack, stackCopy;
+    ScriptStack stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, SigVersion::BASE, serror))
         // serror is set
         return false;
@@ -1589,8 +1786,6 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
 
     // Bare witness programs
-    int witnessversion;
-    std::vector<unsigned char> witnessprogram;
     if (flags & SCRIPT_VERIFY_WITNESS) {
         if (scriptPubKey.IsWitnessProgram(witnessversion, witnessprogram)) {
             hadWitness = true;
@@ -1598,7 +1793,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
                 // The scriptSig must be _exactly_ CScript(), otherwise we reintroduce malleability.
                 return set_error(serror, SCRIPT_ERR_WITNESS_MALLEATED);
             }
-            if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, serror)) {
+            if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, use_templates, serror)) {
                 return false;
             }
             // Bypass the cleanstack check at the end. The actual stack is obviously not clean
@@ -1615,7 +1810,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
             return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
 
         // Restore stack.
-        swap(stack, stackCopy);
+        stack.swap(stackCopy);
 
         // stack cannot be empty here, because if it was the
         // P2SH  HASH <> EQUAL  scriptPubKey would be evaluated with
@@ -1623,7 +1818,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         assert(!stack.empty());
 
         const valtype& pubKeySerialized = stack.back();
-        CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
+        CScript pubKey2(pubKeySerialized.data(), pubKeySerialized.data() + pubKeySerialized.size());
         popstack(stack);
 
         if (!EvalScript(stack, pubKey2, flags, checker, SigVersion::BASE, serror))
@@ -1643,7 +1838,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
                     // reintroduce malleability.
                     return set_error(serror, SCRIPT_ERR_WITNESS_MALLEATED_P2SH);
                 }
-                if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, serror)) {
+                if (!VerifyWitnessProgram(*witness, witnessversion, witnessprogram, flags, checker, use_templates, serror)) {
                     return false;
                 }
                 // Bypass the cleanstack check at the end. The actual stack is obviously not clean
@@ -1679,6 +1874,16 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
     return set_success(serror);
 }
 
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    return VerifyScript(scriptSig, scriptPubKey, witness, flags, checker, /* use_templates */ true, serror);
+}
+
+bool VerifyScriptGeneric(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    return VerifyScript(scriptSig, scriptPubKey, witness, flags, checker, /* use_templates */ false, serror);
+}
+
 size_t static WitnessSigOps(int witversion, const std::vector<unsigned char>& witprogram, const CScriptWitness& witness)
 {
     if (witversion == 0) {
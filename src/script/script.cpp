@@ -5,6 +5,7 @@
 
 #include <script/script.h>
 
+#include <pubkey.h>
 #include <util/strencodings.h>
 
 #include <string>
@@ -195,6 +196,17 @@ unsigned int CScript::GetSigOpCount(const CScript& scriptSig) const
     return subscript.GetSigOpCount(true);
 }
 
+bool CScript::IsPayToPubKeyHash() const
+{
+    // Extra-fast test for pay-to-pubkey-hash CScripts:
+    return (this->size() == 25 &&
+            (*this)[0] == OP_DUP &&
+            (*this)[1] == OP_HASH160 &&
+            (*this)[2] == 0x14 &&
+            (*this)[23] == OP_EQUALVERIFY &&
+            (*this)[24] == OP_CHECKSIG);
+}
+
 bool CScript::IsPayToScriptHash() const
 {
     // Extra-fast test for pay-to-script-hash CScripts:
@@ -214,7 +226,7 @@ bool CScript::IsPayToWitnessScriptHash() const
 
 // A witness program is any valid CScript that consists of a 1-byte push opcode
 // followed by a data push between 2 and 40 bytes.
-bool CScript::IsWitnessProgram(int& version, std::vector<unsigned char>& program) const
+bool CScript::IsWitnessProgram(int& version, Span<const unsigned char>& program) const
 {
     if (this->size() < 4 || this->size() > 42) {
         return false;
@@ -224,12 +236,20 @@ bool CScript::IsWitnessProgram(int& version, std::vector<unsigned char>& program
     }
     if ((size_t)((*this)[1] + 2) == this->size()) {
         version = DecodeOP_N((opcodetype)(*this)[0]);
-        program = std::vector<unsigned char>(this->begin() + 2, this->end());
+        program = Span<const unsigned char>(this->data() + 2, this->size() - 2);
         return true;
     }
     return false;
 }
 
+bool CScript::IsWitnessProgram(int& version, std::vector<unsigned char>& program) const
+{
+    Span<const unsigned char> program_span;
+    if (!IsWitnessProgram(version, program_span)) return false;
+    program.assign(program_span.begin(), program_span.end());
+    return true;
+}
+
 bool CScript::IsPushOnly(const_iterator pc) const
 {
     while (pc < end())
@@ -277,11 +297,10 @@ bool CScript::HasValidOps() const
     return true;
 }
 
-bool GetScriptOp(CScriptBase::const_iterator& pc, CScriptBase::const_iterator end, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet)
+bool GetScriptOp(CScriptBase::const_iterator& pc, CScriptBase::const_iterator end, opcodetype& opcodeRet, Span<const unsigned char>& dataRet)
 {
     opcodeRet = OP_INVALIDOPCODE;
-    if (pvchRet)
-        pvchRet->clear();
+    dataRet = Span<const unsigned char>();
     if (pc >= end)
         return false;
 
@@ -320,11 +339,44 @@ bool GetScriptOp(CScriptBase::const_iterator& pc, CScriptBase::const_iterator en
         }
         if (end - pc < 0 || (unsigned int)(end - pc) < nSize)
             return false;
-        if (pvchRet)
-            pvchRet->assign(pc, pc + nSize);
+        if (nSize > 0)
+            dataRet = Span<const unsigned char>(&pc[0], nSize);
         pc += nSize;
     }
 
     opcodeRet = static_cast<opcodetype>(opcode);
     return true;
 }
+
+bool GetScriptOp(CScriptBase::const_iterator& pc, CScriptBase::const_iterator end, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet)
+{
+    Span<const unsigned char> data;
+    bool ret = GetScriptOp(pc, end, opcodeRet, data);
+    if (pvchRet)
+        pvchRet->assign(data.begin(), data.end());
+    return ret;
+}
+
+/** Test for "small positive integer" script opcodes - OP_1 through OP_16. */
+static constexpr bool IsSmallInteger(opcodetype opcode)
+{
+    return opcode >= OP_1 && opcode <= OP_16;
+}
+
+bool MatchMultisig(const CScript& script, unsigned int& required, std::vector<Span<const unsigned char>>& pubkeys)
+{
+    opcodetype opcode;
+    Span<const unsigned char> data;
+    CScript::const_iterator it = script.begin();
+    if (script.size() < 1 || script.back() != OP_CHECKMULTISIG) return false;
+
+    if (!script.GetOp(it, opcode, data) || !IsSmallInteger(opcode)) return false;
+    required = CScript::DecodeOP_N(opcode);
+    while (script.GetOp(it, opcode, data) && CPubKey::ValidSize(data)) {
+        pubkeys.push_back(data);
+    }
+    if (!IsSmallInteger(opcode)) return false;
+    unsigned int keys = CScript::DecodeOP_N(opcode);
+    if (pubkeys.size() != keys || keys < required) return false;
+    return (it + 1 == script.end());
+}
@@ -9,6 +9,7 @@
 #include <crypto/common.h>
 #include <prevector.h>
 #include <serialize.h>
+#include <span.h>
 
 #include <assert.h>
 #include <climits>
@@ -220,7 +221,7 @@ public:
 
     static const size_t nDefaultMaxNumSize = 4;
 
-    explicit CScriptNum(const std::vector<unsigned char>& vch, bool fRequireMinimal,
+    explicit CScriptNum(Span<const unsigned char> vch, bool fRequireMinimal,
                         const size_t nMaxNumSize = nDefaultMaxNumSize)
     {
         if (vch.size() > nMaxNumSize) {
@@ -317,17 +318,20 @@ public:
         return m_value;
     }
 
-    std::vector<unsigned char> getvch() const
+    /** @tparam T the byte container to return, such as a script stack element */
+    template <typename T = std::vector<unsigned char>>
+    T getvch() const
     {
-        return serialize(m_value);
+        return serialize<T>(m_value);
     }
 
-    static std::vector<unsigned char> serialize(const int64_t& value)
+    template <typename T = std::vector<unsigned char>>
+    static T serialize(const int64_t& value)
     {
         if(value == 0)
-            return std::vector<unsigned char>();
+            return T();
 
-        std::vector<unsigned char> result;
+        T result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? ~static_cast<uint64_t>(value) + 1 : static_cast<uint64_t>(value);
 
@@ -356,7 +360,7 @@ public:
     }
 
 private:
-    static int64_t set_vch(const std::vector<unsigned char>& vch)
+    static int64_t set_vch(Span<const unsigned char> vch)
     {
       if (vch.empty())
           return 0;
@@ -385,6 +389,8 @@ private:
 typedef prevector<28, unsigned char> CScriptBase;
 
 bool GetScriptOp(CScriptBase::const_iterator& pc, CScriptBase::const_iterator end, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet);
+/** Like GetScriptOp, but returns a view of the pushed data in the script instead of a copy of it. */
+bool GetScriptOp(CScriptBase::const_iterator& pc, CScriptBase::const_iterator end, opcodetype& opcodeRet, Span<const unsigned char>& dataRet);
 
 /** Serialized script, used inside transaction inputs and outputs */
 class CScript : public CScriptBase
@@ -440,7 +446,7 @@ public:
         return *this;
     }
 
-    CScript& operator<<(const std::vector<unsigned char>& b)
+    CScript& operator<<(Span<const unsigned char> b)
     {
         if (b.size() < OP_PUSHDATA1)
         {
@@ -474,6 +480,11 @@ public:
         return GetScriptOp(pc, end(), opcodeRet, &vchRet);
     }
 
+    bool GetOp(const_iterator& pc, opcodetype& opcodeRet, Span<const unsigned char>& dataRet) const
+    {
+        return GetScriptOp(pc, end(), opcodeRet, dataRet);
+    }
+
     bool GetOp(const_iterator& pc, opcodetype& opcodeRet) const
     {
         return GetScriptOp(pc, end(), opcodeRet, nullptr);
@@ -510,9 +521,12 @@ public:
      */
     unsigned int GetSigOpCount(const CScript& scriptSig) const;
 
+    bool IsPayToPubKeyHash() const;
     bool IsPayToScriptHash() const;
     bool IsPayToWitnessScriptHash() const;
     bool IsWitnessProgram(int& version, std::vector<unsigned char>& program) const;
+    /** IsWitnessProgram, returning a Span of the program inside this script. */
+    bool IsWitnessProgram(int& version, Span<const unsigned char>& program) const;
 
     /** Called by IsStandardTx and P2SH/BIP62 VerifyScript (which makes it consensus-critical). */
     bool IsPushOnly(const_iterator pc) const;
@@ -539,6 +553,13 @@ public:
     }
 };
 
+/**
+ * Match a bare multisig script: OP_m <pubkey>... OP_n OP_CHECKMULTISIG, with
+ * 1 <= m <= n <= 16 and public keys of valid size. The returned Spans point
+ * into the script.
+ */
+bool MatchMultisig(const CScript& script, unsigned int& required, std::vector<Span<const unsigned char>>& pubkeys);
+
 struct CScriptWitness
 {
     // Note that this encodes the data elements being pushed, rather than
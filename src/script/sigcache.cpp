@@ -10,8 +10,63 @@
 #include <uint256.h>
 #include <util/system.h>
 
-#include <cuckoocache.h>
-#include <boost/thread/shared_mutex.hpp>
+uint32_t ShardedSignatureCache::setup_bytes(size_t bytes)
+{
+    uint32_t entries{0};
+    for (Shard& shard : m_shards) {
+        boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+        shard.max_entries = shard.cache.setup_bytes(bytes / SIG_CACHE_SHARDS);
+        entries += shard.max_entries;
+    }
+    return entries;
+}
+
+bool ShardedSignatureCache::contains(const uint256& entry, bool erase)
+{
+    Shard& shard = GetShard(entry);
+    bool found;
+    {
+        boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+        found = shard.cache.contains(entry, erase);
+    }
+    ++(found ? shard.hits : shard.misses);
+    return found;
+}
+
+void ShardedSignatureCache::insert(const uint256& entry)
+{
+    Shard& shard = GetShard(entry);
+    bool evicted;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+        evicted = shard.cache.insert(entry);
+    }
+    ++shard.inserts;
+    if (evicted) ++shard.evictions;
+}
+
+std::vector<uint256> ShardedSignatureCache::GetEntries() const
+{
+    std::vector<uint256> entries;
+    for (const Shard& shard : m_shards) {
+        boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+        shard.cache.for_each([&](const uint256& entry) { entries.push_back(entry); });
+    }
+    return entries;
+}
+
+std::vector<SignatureCacheShardStats> ShardedSignatureCache::GetStats() const
+{
+    std::vector<SignatureCacheShardStats> stats(m_shards.size());
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        stats[i].hits = m_shards[i].hits;
+        stats[i].misses = m_shards[i].misses;
+        stats[i].inserts = m_shards[i].inserts;
+        stats[i].evictions = m_shards[i].evictions;
+        stats[i].max_entries = m_shards[i].max_entries;
+    }
+    return stats;
+}
 
 namespace {
 /**
@@ -23,15 +78,20 @@ class CSignatureCache
 {
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
+    uint256 m_nonce;
     CSHA256 m_salted_hasher;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    ShardedSignatureCache setValid;
 
 public:
     CSignatureCache()
     {
-        uint256 nonce = GetRandHash();
+        SetNonce(GetRandHash());
+    }
+
+    void SetNonce(const uint256& nonce)
+    {
+        m_nonce = nonce;
+        m_salted_hasher.Reset();
         // We want the nonce to be 64 bytes long to force the hasher to process
         // this chunk, which makes later hash computations more efficient. We
         // just write our 32-byte entropy twice to fill the 64 bytes.
@@ -39,29 +99,37 @@ public:
         m_salted_hasher.Write(nonce.begin(), 32);
     }
 
+    const uint256& GetNonce() const { return m_nonce; }
+
     void
-    ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+    ComputeEntry(uint256& entry, const uint256 &hash, Span<const unsigned char> vchSig, const CPubKey& pubkey)
     {
         CSHA256 hasher = m_salted_hasher;
-        hasher.Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
+        hasher.Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
     }
 
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
         return setValid.contains(entry, erase);
     }
 
     void Set(uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
     }
     uint32_t setup_bytes(size_t n)
     {
         return setValid.setup_bytes(n);
     }
+    std::vector<SignatureCacheShardStats> GetStats() const
+    {
+        return setValid.GetStats();
+    }
+    std::vector<uint256> GetEntries() const
+    {
+        return setValid.GetEntries();
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -85,7 +153,26 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
-bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+std::vector<SignatureCacheShardStats> GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
+std::vector<uint256> GetSignatureCacheEntries(uint256& nonce)
+{
+    nonce = signatureCache.GetNonce();
+    return signatureCache.GetEntries();
+}
+
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.SetNonce(nonce);
+    for (uint256 entry : entries) {
+        signatureCache.Set(entry);
+    }
+}
+
+bool CachingTransactionSignatureChecker::VerifySignature(Span<const unsigned char> vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
@@ -6,16 +6,24 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <cuckoocache.h>
 #include <script/interpreter.h>
 
+#include <array>
+#include <atomic>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
 // systems). Due to how we count cache size, actual memory usage is slightly
 // more (~32.25 MB)
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+// Number of independently locked shards of the signature and script
+// execution caches
+static const int SIG_CACHE_SHARDS = 16;
 
 class CPubKey;
 
@@ -40,6 +48,53 @@ public:
     }
 };
 
+/** Lookup and eviction counts of a shard of a ShardedSignatureCache. */
+struct SignatureCacheShardStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t inserts{0};
+    uint64_t evictions{0};
+    uint32_t max_entries{0};
+};
+
+/**
+ * A cache of salted hashes, split into SIG_CACHE_SHARDS CuckooCaches with a
+ * lock each, so that script check threads rarely contend on a lock. The shard
+ * of an entry is selected by the low bits of its first byte, which
+ * SignatureCacheHasher's hashes hardly depend on.
+ */
+class ShardedSignatureCache
+{
+public:
+    //! Size the shards to use at most bytes together, dropping their entries.
+    //! @returns the number of entries the cache can hold.
+    uint32_t setup_bytes(size_t bytes);
+
+    //! @returns whether entry is in the cache, and erases it if erase is set.
+    bool contains(const uint256& entry, bool erase);
+
+    void insert(const uint256& entry);
+
+    //! @returns the entries of all shards that are not marked for deletion.
+    std::vector<uint256> GetEntries() const;
+
+    std::vector<SignatureCacheShardStats> GetStats() const;
+
+private:
+    struct Shard {
+        mutable boost::shared_mutex mutex;
+        CuckooCache::cache<uint256, SignatureCacheHasher> cache;
+        uint32_t max_entries{0};
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> inserts{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+    std::array<Shard, SIG_CACHE_SHARDS> m_shards;
+
+    Shard& GetShard(const uint256& entry) { return m_shards[*entry.begin() % SIG_CACHE_SHARDS]; }
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -48,9 +103,19 @@ private:
 public:
     CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {}
 
-    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
+    bool VerifySignature(Span<const unsigned char> vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
 void InitSignatureCache();
 
+//! @returns the statistics of the signature cache, by shard.
+std::vector<SignatureCacheShardStats> GetSignatureCacheStats();
+
+//! @returns the salt of the signature cache and its entries, which are only
+//! meaningful with that salt.
+std::vector<uint256> GetSignatureCacheEntries(uint256& nonce);
+
+//! Switch the signature cache to salt nonce, and add entries computed with it.
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -75,35 +75,21 @@ static bool MatchPayToPubkey(const CScript& script, valtype& pubkey)
 
 static bool MatchPayToPubkeyHash(const CScript& script, valtype& pubkeyhash)
 {
-    if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 && script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+    if (script.IsPayToPubKeyHash()) {
         pubkeyhash = valtype(script.begin () + 3, script.begin() + 23);
         return true;
     }
     return false;
 }
 
-/** Test for "small positive integer" script opcodes - OP_1 through OP_16. */
-static constexpr bool IsSmallInteger(opcodetype opcode)
-{
-    return opcode >= OP_1 && opcode <= OP_16;
-}
-
 static bool MatchMultisig(const CScript& script, unsigned int& required, std::vector<valtype>& pubkeys)
 {
-    opcodetype opcode;
-    valtype data;
-    CScript::const_iterator it = script.begin();
-    if (script.size() < 1 || script.back() != OP_CHECKMULTISIG) return false;
-
-    if (!script.GetOp(it, opcode, data) || !IsSmallInteger(opcode)) return false;
-    required = CScript::DecodeOP_N(opcode);
-    while (script.GetOp(it, opcode, data) && CPubKey::ValidSize(data)) {
-        pubkeys.emplace_back(std::move(data));
+    std::vector<Span<const unsigned char>> pubkey_spans;
+    if (!MatchMultisig(script, required, pubkey_spans)) return false;
+    for (const Span<const unsigned char>& pubkey : pubkey_spans) {
+        pubkeys.emplace_back(pubkey.begin(), pubkey.end());
     }
-    if (!IsSmallInteger(opcode)) return false;
-    unsigned int keys = CScript::DecodeOP_N(opcode);
-    if (pubkeys.size() != keys || keys < required) return false;
-    return (it + 1 == script.end());
+    return true;
 }
 
 TxoutType Solver(const CScript& scriptPubKey, std::vector<std::vector<unsigned char>>& vSolutionsRet)
@@ -0,0 +1,83 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockmap.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+BOOST_FIXTURE_TEST_SUITE(blockmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockmap_insert_find)
+{
+    BlockMap map;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(InsecureRand256()) == map.end());
+    BOOST_CHECK(map.begin() == map.end());
+
+    // Enough entries for several chunks and table resizes.
+    std::map<uint256, CBlockIndex*> expected;
+    for (int i = 0; i < 5000; ++i) {
+        const uint256 hash = InsecureRand256();
+        CBlockHeader header;
+        header.nNonce = i;
+        const auto inserted = map.try_emplace(hash, header);
+        BOOST_CHECK(inserted.second);
+        BOOST_CHECK(inserted.first->first == hash);
+        CBlockIndex* pindex = inserted.first->second;
+        BOOST_CHECK(pindex->phashBlock == &inserted.first->first);
+        BOOST_CHECK_EQUAL(pindex->nNonce, (uint32_t)i);
+        pindex->nHeight = i;
+        expected.emplace(hash, pindex);
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+
+    // Entries stay in place as the map grows, and adding one again returns it.
+    for (const auto& item : expected) {
+        const auto it = map.find(item.first);
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK(it->second == item.second);
+        BOOST_CHECK_EQUAL(map.count(item.first), 1U);
+        const auto inserted = map.try_emplace(item.first);
+        BOOST_CHECK(!inserted.second);
+        BOOST_CHECK(inserted.first->second == item.second);
+        BOOST_CHECK_EQUAL(item.second->GetBlockHash(), item.first);
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    BOOST_CHECK_EQUAL(map.count(InsecureRand256()), 0U);
+
+    // Iteration visits every entry once.
+    std::map<uint256, CBlockIndex*> visited;
+    for (const auto& item : map) {
+        BOOST_CHECK(visited.emplace(item.first, item.second).second);
+    }
+    BOOST_CHECK(visited == expected);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(expected.begin()->first) == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(blockmap_reserve)
+{
+    BlockMap map;
+    map.reserve(3000);
+    CBlockIndex* first = map.try_emplace(InsecureRand256()).first->second;
+    CBlockIndex* prev = first;
+    for (int i = 1; i < 3000; ++i) {
+        CBlockIndex* pindex = map.try_emplace(InsecureRand256()).first->second;
+        BOOST_CHECK(pindex->phashBlock != nullptr);
+        BOOST_CHECK_EQUAL(pindex->nHeight, 0);
+        prev = pindex;
+    }
+    BOOST_CHECK_EQUAL(map.size(), 3000U);
+    // Reserved entries are allocated together.
+    BOOST_CHECK(std::less<CBlockIndex*>()(first, prev));
+    BOOST_CHECK_LT((size_t)((char*)prev - (char*)first), 3000 * (sizeof(CBlockIndex) + sizeof(uint256) + 64));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
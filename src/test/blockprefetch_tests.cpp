@@ -0,0 +1,90 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <node/blockprefetch.h>
+#include <primitives/block.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+
+#include <atomic>
+#include <chrono>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockprefetch_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(prefetch_and_take)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    std::atomic<int> reads{0};
+    CBlockPrefetcher prefetcher(8, [&reads](CBlock& block, const FlatFilePos& pos, const Consensus::Params& params) {
+        ++reads;
+        return ReadBlockFromDisk(block, pos, params);
+    });
+    // A block whose read has started is in flight until it is done, which
+    // Take() waits for. Wait for the reads with a deadline, so that a
+    // prefetcher that stops reading fails the test instead of hanging it.
+    auto wait_for_reads = [&reads](int count) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{30};
+        while (reads < count && std::chrono::steady_clock::now() < deadline) {
+            UninterruptibleSleep(std::chrono::milliseconds{1});
+        }
+        return reads == count;
+    };
+
+    std::vector<const CBlockIndex*> window;
+    {
+        LOCK(cs_main);
+        for (int height = 1; height <= 10; ++height) {
+            window.push_back(::ChainActive()[height]);
+        }
+        prefetcher.Prefetch(window, params);
+    }
+    // The window is capped at the configured maximum.
+    BOOST_CHECK_EQUAL(prefetcher.Size(), 8U);
+
+    boost::thread_group workers;
+    for (int i = 0; i < 2; ++i) {
+        workers.create_thread([&prefetcher] { prefetcher.Thread(); });
+    }
+
+    // Blocks beyond the window are not prefetched.
+    BOOST_CHECK(!prefetcher.Take(window[9]));
+
+    // Every block in the window is read and returned.
+    BOOST_CHECK(wait_for_reads(8));
+    for (int i = 0; i < 8; ++i) {
+        std::shared_ptr<const CBlock> block = prefetcher.Take(window[i]);
+        BOOST_CHECK(block && block->GetHash() == window[i]->GetBlockHash());
+    }
+    BOOST_CHECK_EQUAL(prefetcher.Size(), 0U);
+
+    // Blocks that were taken are read again when they are requested again.
+    {
+        LOCK(cs_main);
+        prefetcher.Prefetch({window.begin(), window.begin() + 4}, params);
+    }
+    BOOST_CHECK(wait_for_reads(8 + 4));
+    for (int i = 0; i < 4; ++i) {
+        std::shared_ptr<const CBlock> block = prefetcher.Take(window[i]);
+        BOOST_CHECK(block && block->GetHash() == window[i]->GetBlockHash());
+    }
+    BOOST_CHECK_EQUAL(prefetcher.Size(), 0U);
+
+    // Moving the window drops entries that fell out of it.
+    {
+        LOCK(cs_main);
+        prefetcher.Prefetch({window[5], window[6]}, params);
+        prefetcher.Prefetch({window[6]}, params);
+    }
+    BOOST_CHECK(prefetcher.Size() <= 2U);
+    prefetcher.Clear();
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockservecache.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockservecache_tests, BasicTestingSetup)
+
+static BlockServeCache::Payload MakePayload(size_t size)
+{
+    return std::make_shared<const std::vector<unsigned char>>(size, 0x42);
+}
+
+BOOST_AUTO_TEST_CASE(blockservecache_lookup)
+{
+    BlockServeCache cache(1 << 20);
+    const uint256 hash = InsecureRand256();
+    BOOST_CHECK(!cache.Get(hash, ServedBlockFormat::BLOCK));
+
+    const BlockServeCache::Payload block = MakePayload(1000);
+    const BlockServeCache::Payload cmpct = MakePayload(100);
+    cache.Insert(hash, ServedBlockFormat::BLOCK, block);
+    cache.Insert(hash, ServedBlockFormat::CMPCT_BLOCK, cmpct);
+    // A second insert for the same key keeps the first payload.
+    cache.Insert(hash, ServedBlockFormat::BLOCK, MakePayload(1000));
+
+    BOOST_CHECK(cache.Get(hash, ServedBlockFormat::BLOCK) == block);
+    BOOST_CHECK(cache.Get(hash, ServedBlockFormat::CMPCT_BLOCK) == cmpct);
+    BOOST_CHECK(!cache.Get(hash, ServedBlockFormat::BLOCK_NO_WITNESS));
+    BOOST_CHECK(!cache.Get(InsecureRand256(), ServedBlockFormat::BLOCK));
+
+    BlockServeCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.hits, 2U);
+    BOOST_CHECK_EQUAL(stats.misses, 3U);
+    BOOST_CHECK_EQUAL(stats.inserts, 2U);
+    BOOST_CHECK_EQUAL(stats.evictions, 0U);
+    BOOST_CHECK_EQUAL(stats.entries, 2U);
+    BOOST_CHECK(stats.usage >= 1100 && stats.usage <= stats.max_usage);
+
+    cache.Clear();
+    BOOST_CHECK(!cache.Get(hash, ServedBlockFormat::BLOCK));
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockservecache_eviction)
+{
+    BlockServeCache cache(10000);
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 4; ++i) {
+        hashes.push_back(InsecureRand256());
+        cache.Insert(hashes.back(), ServedBlockFormat::BLOCK, MakePayload(2000));
+    }
+    // Using the oldest entry makes the second one the least recently used.
+    BOOST_CHECK(cache.Get(hashes[0], ServedBlockFormat::BLOCK));
+    cache.Insert(InsecureRand256(), ServedBlockFormat::BLOCK, MakePayload(2000));
+    cache.Insert(InsecureRand256(), ServedBlockFormat::BLOCK, MakePayload(2000));
+    BOOST_CHECK(cache.Get(hashes[0], ServedBlockFormat::BLOCK));
+    BOOST_CHECK(!cache.Get(hashes[1], ServedBlockFormat::BLOCK));
+    BlockServeCacheStats stats = cache.GetStats();
+    BOOST_CHECK(stats.evictions > 0);
+    BOOST_CHECK(stats.usage <= 10000);
+
+    // Evicted payloads stay valid for their holders.
+    const BlockServeCache::Payload held = cache.Get(hashes[0], ServedBlockFormat::BLOCK);
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 0U);
+    BOOST_CHECK_EQUAL(held->size(), 2000U);
+
+    // Payloads larger than the budget are not cached.
+    cache.Insert(hashes[0], ServedBlockFormat::BLOCK, MakePayload(1));
+    BOOST_CHECK(!cache.Get(hashes[0], ServedBlockFormat::BLOCK));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
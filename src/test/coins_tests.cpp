@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <attributes.h>
+#include <checkqueue.h>
 #include <clientversion.h>
 #include <coins.h>
 #include <script/standard.h>
@@ -17,6 +18,7 @@
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out);
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txundo, int nHeight);
@@ -54,7 +56,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -65,7 +67,11 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (erase) {
+                mapCoins.erase(it++);
+            } else {
+                ++it;
+            }
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -609,7 +615,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
     InsertCoinsMapEntry(map, value, flags);
     BOOST_CHECK(view.BatchWrite(map, {}));
 }
@@ -878,4 +885,130 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_prefetch)
+{
+    CCoinsViewTest base;
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCacheTest writer(&base);
+        for (int i = 0; i < 200; ++i) {
+            COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+            Coin coin;
+            coin.out.nValue = InsecureRandRange(1000) + 1;
+            coin.nHeight = 1;
+            writer.AddCoin(outpoint, std::move(coin), false);
+            outpoints.push_back(outpoint);
+        }
+        BOOST_CHECK(writer.Flush());
+    }
+    // Ask for some outpoints the base does not have, and some duplicates.
+    std::vector<COutPoint> missing;
+    for (int i = 0; i < 20; ++i) {
+        missing.emplace_back(InsecureRand256(), 0);
+    }
+    std::vector<COutPoint> request = outpoints;
+    request.insert(request.end(), missing.begin(), missing.end());
+    request.insert(request.end(), outpoints.begin(), outpoints.begin() + 10);
+
+    CCheckQueue<CCoinsFetch> queue(8);
+    boost::thread_group tg;
+    for (int i = 0; i < 3; ++i) {
+        tg.create_thread([&] { queue.Thread(); });
+    }
+
+    for (CCheckQueue<CCoinsFetch>* q : {static_cast<CCheckQueue<CCoinsFetch>*>(nullptr), &queue}) {
+        CCoinsViewCacheTest cache(&base);
+        // Coins already in the cache are not fetched again.
+        cache.AccessCoin(outpoints[0]);
+        BOOST_CHECK_EQUAL(cache.PrefetchCoins(request, q), outpoints.size() - 1);
+        for (const COutPoint& outpoint : outpoints) {
+            BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+            const auto it = cache.map().find(outpoint);
+            BOOST_CHECK(it != cache.map().end() && it->second.flags == 0);
+        }
+        for (const COutPoint& outpoint : missing) {
+            BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+        }
+        cache.SelfTest();
+        BOOST_CHECK_EQUAL(cache.PrefetchCoins(request, q), 0U);
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync_and_trim)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; ++i) {
+        COutPoint outpoint(InsecureRand256(), 0);
+        Coin coin;
+        coin.out.nValue = i + 1;
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), false);
+        outpoints.push_back(outpoint);
+    }
+
+    // Sync writes the coins to the base but keeps them cached, unmodified.
+    BOOST_CHECK(cache.Sync());
+    for (const COutPoint& outpoint : outpoints) {
+        Coin coin;
+        BOOST_CHECK(base.GetCoin(outpoint, coin) && !coin.IsSpent());
+        const auto it = cache.map().find(outpoint);
+        BOOST_CHECK(it != cache.map().end() && it->second.flags == 0);
+    }
+    cache.SelfTest();
+
+    // Spent coins are written as deletions and dropped from the cache.
+    for (int i = 90; i < 100; ++i) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    BOOST_CHECK(cache.Sync());
+    for (int i = 90; i < 100; ++i) {
+        Coin coin;
+        BOOST_CHECK(!base.GetCoin(outpoints[i], coin) || coin.IsSpent());
+        BOOST_CHECK(cache.map().find(outpoints[i]) == cache.map().end());
+    }
+    BOOST_CHECK_EQUAL(cache.map().size(), 90U);
+    cache.SelfTest();
+
+    // Looking coins up again protects them from the next sweep; modified
+    // coins are never evicted.
+    for (int i = 0; i < 20; ++i) {
+        cache.AccessCoin(outpoints[i]);
+    }
+    Coin dirty_coin;
+    dirty_coin.out.nValue = 1;
+    dirty_coin.nHeight = 2;
+    const COutPoint dirty_outpoint(InsecureRand256(), 0);
+    cache.AddCoin(dirty_outpoint, std::move(dirty_coin), false);
+
+    // The usage Trim() aims for grows by the same amount with every coin.
+    const size_t usage_91 = cache.CompactedMemoryUsage();
+    cache.Uncache(outpoints[89]);
+    const size_t usage_90 = cache.CompactedMemoryUsage();
+    const size_t entry_usage = usage_91 - usage_90;
+    BOOST_CHECK(entry_usage >= sizeof(CCoinsMap::value_type));
+    BOOST_CHECK_EQUAL(cache.Trim(usage_90 - 19 * entry_usage + entry_usage / 2), 19U);
+    BOOST_CHECK_EQUAL(cache.map().size(), 71U);
+    for (int i = 0; i < 20; ++i) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+    }
+    BOOST_CHECK(cache.map().at(dirty_outpoint).flags & CCoinsCacheEntry::DIRTY);
+    cache.SelfTest();
+
+    // Without lookups in between, a second trim can evict any clean coin.
+    BOOST_CHECK_EQUAL(cache.Trim(0), 70U);
+    BOOST_CHECK_EQUAL(cache.map().size(), 1U);
+    BOOST_CHECK(cache.HaveCoinInCache(dirty_outpoint));
+    cache.SelfTest();
+
+    // Evicted coins are still available from the base.
+    for (int i = 0; i < 90; ++i) {
+        BOOST_CHECK(cache.HaveCoin(outpoints[i]));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,7 @@
 // Copyright (c) 2012-2020 The Bitcoin Core developers
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <algorithm>
 #include <boost/test/unit_test.hpp>
 #include <cuckoocache.h>
 #include <deque>
@@ -112,6 +113,69 @@ BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
     }
 }
 
+/** Check that sharding keeps the hit rate, and that the shards count what they see */
+BOOST_AUTO_TEST_CASE(sharded_sigcache_ok)
+{
+    double HitRateThresh = 0.98;
+    size_t megabytes = 4;
+    for (double load = 0.1; load < 2; load *= 2) {
+        double hits = test_cache<ShardedSignatureCache>(megabytes, load);
+        BOOST_CHECK(normalize_hit_rate(hits, load) > HitRateThresh);
+    }
+
+    SeedInsecureRand(SeedRand::ZEROS);
+    ShardedSignatureCache cache;
+    const uint32_t max_entries = cache.setup_bytes(megabytes << 20);
+    std::vector<uint256> entries;
+    for (int i = 0; i < 1000; ++i) {
+        entries.push_back(InsecureRand256());
+        cache.insert(entries.back());
+    }
+    for (const uint256& entry : entries) {
+        BOOST_CHECK(cache.contains(entry, false));
+        BOOST_CHECK(!cache.contains(InsecureRand256(), false));
+    }
+    const std::vector<SignatureCacheShardStats> stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.size(), size_t{SIG_CACHE_SHARDS});
+    SignatureCacheShardStats total;
+    for (const SignatureCacheShardStats& shard : stats) {
+        // Every shard gets about 1/SIG_CACHE_SHARDS of the entries.
+        BOOST_CHECK(shard.inserts > 0);
+        total.hits += shard.hits;
+        total.misses += shard.misses;
+        total.inserts += shard.inserts;
+        total.evictions += shard.evictions;
+        total.max_entries += shard.max_entries;
+    }
+    BOOST_CHECK_EQUAL(total.hits, 1000U);
+    BOOST_CHECK_EQUAL(total.misses, 1000U);
+    BOOST_CHECK_EQUAL(total.inserts, 1000U);
+    BOOST_CHECK_EQUAL(total.evictions, 0U);
+    BOOST_CHECK_EQUAL(total.max_entries, max_entries);
+}
+
+/** Check that GetEntries returns what was inserted and not what was erased */
+BOOST_AUTO_TEST_CASE(sharded_sigcache_entries)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    ShardedSignatureCache cache;
+    cache.setup_bytes(1 << 20);
+    std::vector<uint256> entries;
+    for (int i = 0; i < 1000; ++i) {
+        entries.push_back(InsecureRand256());
+        cache.insert(entries.back());
+    }
+    // Erase the first half.
+    for (int i = 0; i < 500; ++i) {
+        BOOST_CHECK(cache.contains(entries[i], true));
+    }
+    std::vector<uint256> dumped = cache.GetEntries();
+    std::sort(dumped.begin(), dumped.end());
+    std::vector<uint256> expected(entries.begin() + 500, entries.end());
+    std::sort(expected.begin(), expected.end());
+    BOOST_CHECK(dumped == expected);
+}
+
 
 /** This helper checks that erased elements are preferentially inserted onto and
  * that the hit rate of "fresher" keys is reasonable*/
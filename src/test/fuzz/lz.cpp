@@ -0,0 +1,30 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/fuzz/FuzzedDataProvider.h>
+#include <test/fuzz/fuzz.h>
+#include <test/fuzz/util.h>
+#include <util/lz.h>
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+void test_one_input(const std::vector<uint8_t>& buffer)
+{
+    FuzzedDataProvider fuzzed_data_provider(buffer.data(), buffer.size());
+    const size_t max_size = fuzzed_data_provider.ConsumeIntegralInRange<size_t>(0, 1 << 20);
+
+    // Arbitrary input is either rejected or decompresses to at most max_size bytes.
+    const std::vector<uint8_t> input = ConsumeRandomLengthByteVector(fuzzed_data_provider);
+    std::vector<uint8_t> out;
+    if (LZDecompress(input, out, max_size)) {
+        assert(out.size() <= max_size);
+    }
+
+    const std::vector<uint8_t> data = fuzzed_data_provider.ConsumeRemainingBytes<uint8_t>();
+    const std::vector<uint8_t> compressed = LZCompress(data);
+    assert(LZDecompress(compressed, out, data.size()));
+    assert(out == data);
+}
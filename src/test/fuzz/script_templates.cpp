@@ -0,0 +1,189 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/sha256.h>
+#include <hash.h>
+#include <pubkey.h>
+#include <script/interpreter.h>
+#include <script/script.h>
+#include <test/fuzz/FuzzedDataProvider.h>
+#include <test/fuzz/fuzz.h>
+#include <test/fuzz/util.h>
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace {
+/** Signature checker whose result only depends on its arguments, so that both verification paths see the same results. */
+class DeterministicSignatureChecker : public BaseSignatureChecker
+{
+public:
+    bool CheckSig(Span<const unsigned char> sig, Span<const unsigned char> pubkey, const CScript& scriptCode, SigVersion sigversion) const override
+    {
+        if (sig.empty() || pubkey.empty()) return false;
+        return ((sig.back() ^ pubkey.back() ^ scriptCode.size()) & 1) == 0;
+    }
+
+    bool CheckLockTime(const CScriptNum& nLockTime) const override
+    {
+        return nLockTime.getint() & 1;
+    }
+
+    bool CheckSequence(const CScriptNum& nSequence) const override
+    {
+        return nSequence.getint() & 1;
+    }
+};
+
+std::vector<unsigned char> ConsumeSignature(FuzzedDataProvider& fuzzed_data_provider)
+{
+    if (fuzzed_data_provider.ConsumeBool()) {
+        return ConsumeRandomLengthByteVector(fuzzed_data_provider, 600);
+    }
+    // A well-formed DER signature with a fuzzed hash type.
+    std::vector<unsigned char> sig{0x30, 0x06, 0x02, 0x01, 0x01, 0x02, 0x01, 0x01};
+    sig.push_back(fuzzed_data_provider.ConsumeIntegral<unsigned char>());
+    return sig;
+}
+
+std::vector<unsigned char> ConsumePubKey(FuzzedDataProvider& fuzzed_data_provider)
+{
+    if (fuzzed_data_provider.ConsumeBool()) {
+        return ConsumeRandomLengthByteVector(fuzzed_data_provider, 70);
+    }
+    const bool compressed = fuzzed_data_provider.ConsumeBool();
+    std::vector<unsigned char> pubkey = fuzzed_data_provider.ConsumeBytes<unsigned char>(compressed ? CPubKey::COMPRESSED_SIZE : CPubKey::SIZE);
+    pubkey.resize(compressed ? CPubKey::COMPRESSED_SIZE : CPubKey::SIZE);
+    pubkey[0] = compressed ? fuzzed_data_provider.PickValueInArray({0x02, 0x03}) : 0x04;
+    return pubkey;
+}
+
+/** Replace a hash commitment by fuzzed bytes, which are all zero once the input is exhausted. */
+void MaybeCorruptHash(FuzzedDataProvider& fuzzed_data_provider, std::vector<unsigned char>& hash)
+{
+    if (!fuzzed_data_provider.ConsumeBool() || !fuzzed_data_provider.ConsumeBool()) return;
+    const size_t size = hash.size();
+    hash = fuzzed_data_provider.ConsumeBytes<unsigned char>(size);
+    hash.resize(size);
+}
+
+std::vector<unsigned char> KeyHash(FuzzedDataProvider& fuzzed_data_provider, const std::vector<unsigned char>& pubkey)
+{
+    const uint160 hash = Hash160(pubkey.begin(), pubkey.end());
+    std::vector<unsigned char> ret(hash.begin(), hash.end());
+    MaybeCorruptHash(fuzzed_data_provider, ret);
+    return ret;
+}
+
+std::vector<unsigned char> WitnessScriptHash(FuzzedDataProvider& fuzzed_data_provider, const CScript& script)
+{
+    std::vector<unsigned char> ret(CSHA256::OUTPUT_SIZE);
+    CSHA256().Write(script.data(), script.size()).Finalize(ret.data());
+    MaybeCorruptHash(fuzzed_data_provider, ret);
+    return ret;
+}
+
+CScript P2SH(const CScript& redeem_script)
+{
+    const uint160 hash = Hash160(redeem_script.begin(), redeem_script.end());
+    return CScript() << OP_HASH160 << std::vector<unsigned char>(hash.begin(), hash.end()) << OP_EQUAL;
+}
+
+bool IsValidFlagCombination(unsigned flags)
+{
+    if (flags & SCRIPT_VERIFY_CLEANSTACK && ~flags & (SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS)) return false;
+    if (flags & SCRIPT_VERIFY_WITNESS && ~flags & SCRIPT_VERIFY_P2SH) return false;
+    return true;
+}
+} // namespace
+
+void initialize()
+{
+    static const ECCVerifyHandle verify_handle;
+}
+
+/** Compare VerifyScript, which takes the template fast paths, against VerifyScriptGeneric on mostly well-formed spends of the standard templates. */
+void test_one_input(const std::vector<uint8_t>& buffer)
+{
+    FuzzedDataProvider fuzzed_data_provider(buffer.data(), buffer.size());
+    const unsigned int flags = fuzzed_data_provider.ConsumeIntegral<unsigned int>();
+    if (!IsValidFlagCombination(flags)) return;
+
+    CScript script_sig;
+    CScript script_pubkey;
+    CScriptWitness witness;
+
+    const int type = fuzzed_data_provider.ConsumeIntegralInRange<int>(0, 5);
+    switch (type) {
+    case 0: { // P2PKH, with arbitrary pushes in the scriptSig
+        const std::vector<unsigned char> pubkey = ConsumePubKey(fuzzed_data_provider);
+        script_pubkey << OP_DUP << OP_HASH160 << KeyHash(fuzzed_data_provider, pubkey) << OP_EQUALVERIFY << OP_CHECKSIG;
+        if (fuzzed_data_provider.ConsumeBool()) {
+            script_sig << ConsumeSignature(fuzzed_data_provider) << pubkey;
+        } else {
+            const std::vector<unsigned char> bytes = ConsumeRandomLengthByteVector(fuzzed_data_provider);
+            script_sig = CScript(bytes.begin(), bytes.end());
+        }
+        if (fuzzed_data_provider.ConsumeBool()) witness.stack.emplace_back();
+        break;
+    }
+    case 1: // P2WPKH
+    case 2: { // P2SH-P2WPKH
+        const std::vector<unsigned char> pubkey = ConsumePubKey(fuzzed_data_provider);
+        const CScript program = CScript() << OP_0 << KeyHash(fuzzed_data_provider, pubkey);
+        witness.stack.push_back(ConsumeSignature(fuzzed_data_provider));
+        witness.stack.push_back(pubkey);
+        if (fuzzed_data_provider.ConsumeBool()) witness.stack.push_back(ConsumeRandomLengthByteVector(fuzzed_data_provider));
+        if (type == 2) {
+            script_pubkey = P2SH(program);
+            script_sig << std::vector<unsigned char>(program.begin(), program.end());
+        } else {
+            script_pubkey = program;
+        }
+        break;
+    }
+    case 3: // P2WSH multisig
+    case 4: { // P2SH-P2WSH multisig
+        const int keys = fuzzed_data_provider.ConsumeIntegralInRange<int>(1, 16);
+        const int required = fuzzed_data_provider.ConsumeIntegralInRange<int>(1, keys);
+        CScript witness_script;
+        witness_script << CScript::EncodeOP_N(required);
+        for (int i = 0; i < keys; ++i) witness_script << ConsumePubKey(fuzzed_data_provider);
+        witness_script << CScript::EncodeOP_N(keys) << OP_CHECKMULTISIG;
+        witness.stack.push_back(fuzzed_data_provider.ConsumeBool() ? std::vector<unsigned char>{} : ConsumeRandomLengthByteVector(fuzzed_data_provider, 2));
+        const int sigs = fuzzed_data_provider.ConsumeBool() ? required : fuzzed_data_provider.ConsumeIntegralInRange<int>(0, 17);
+        for (int i = 0; i < sigs; ++i) {
+            witness.stack.push_back(fuzzed_data_provider.ConsumeBool() ? std::vector<unsigned char>{} : ConsumeSignature(fuzzed_data_provider));
+        }
+        witness.stack.emplace_back(witness_script.begin(), witness_script.end());
+        const CScript program = CScript() << OP_0 << WitnessScriptHash(fuzzed_data_provider, witness_script);
+        if (type == 4) {
+            script_pubkey = P2SH(program);
+            script_sig << std::vector<unsigned char>(program.begin(), program.end());
+        } else {
+            script_pubkey = program;
+        }
+        break;
+    }
+    case 5: { // Anything
+        const std::vector<unsigned char> sig_bytes = ConsumeRandomLengthByteVector(fuzzed_data_provider);
+        const std::vector<unsigned char> pubkey_bytes = ConsumeRandomLengthByteVector(fuzzed_data_provider);
+        script_sig = CScript(sig_bytes.begin(), sig_bytes.end());
+        script_pubkey = CScript(pubkey_bytes.begin(), pubkey_bytes.end());
+        while (fuzzed_data_provider.ConsumeBool()) {
+            witness.stack.push_back(ConsumeRandomLengthByteVector(fuzzed_data_provider));
+        }
+        break;
+    }
+    }
+
+    const DeterministicSignatureChecker checker{};
+    ScriptError serror;
+    const bool ret = VerifyScript(script_sig, script_pubkey, &witness, flags, checker, &serror);
+    ScriptError serror_generic;
+    const bool ret_generic = VerifyScriptGeneric(script_sig, script_pubkey, &witness, flags, checker, &serror_generic);
+    assert(ret == ret_generic);
+    assert(serror == serror_generic);
+}
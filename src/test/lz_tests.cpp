@@ -0,0 +1,93 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/util/setup_common.h>
+#include <util/lz.h>
+#include <util/strencodings.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(lz_tests, BasicTestingSetup)
+
+static void CheckRoundTrip(const std::vector<uint8_t>& data)
+{
+    const std::vector<uint8_t> compressed = LZCompress(data);
+    std::vector<uint8_t> decompressed;
+    BOOST_CHECK(LZDecompress(compressed, decompressed, data.size()));
+    BOOST_CHECK(decompressed == data);
+    if (!data.empty()) {
+        BOOST_CHECK(!LZDecompress(compressed, decompressed, data.size() - 1));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lz_roundtrip)
+{
+    CheckRoundTrip({});
+    CheckRoundTrip({0x42});
+    CheckRoundTrip({1, 2, 3, 1, 2, 3, 1, 2});
+    for (size_t size : {15, 16, 100, 270, 1000, 70000, 300000}) {
+        CheckRoundTrip(std::vector<uint8_t>(size, 0));
+        CheckRoundTrip(g_insecure_rand_ctx.randbytes(size));
+
+        // Random data with repeats at varying distances, beyond the maximum match offset too
+        std::vector<uint8_t> data = g_insecure_rand_ctx.randbytes(size);
+        for (size_t i = 0; i + 64 < data.size(); i += 1 + InsecureRandRange(64)) {
+            const size_t from = InsecureRandRange(i + 1);
+            const size_t length = std::min<size_t>(InsecureRandRange(600), data.size() - i);
+            for (size_t j = 0; j < length; ++j) data[i + j] = data[from + j];
+            i += length;
+        }
+        CheckRoundTrip(data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lz_compresses)
+{
+    // A serialized transaction output repeated, like the similar scripts in a block
+    const std::vector<uint8_t> output = ParseHex("00f2052a010000001976a914c825a1ecf2a6830c4401620c3a16f1995057c2ab88ac");
+    std::vector<uint8_t> data;
+    for (int i = 0; i < 1000; ++i) data.insert(data.end(), output.begin(), output.end());
+    BOOST_CHECK_LT(LZCompress(data).size(), data.size() / 50);
+
+    const std::vector<uint8_t> random = g_insecure_rand_ctx.randbytes(10000);
+    BOOST_CHECK_LT(LZCompress(random).size(), random.size() + random.size() / 100);
+}
+
+BOOST_AUTO_TEST_CASE(lz_invalid)
+{
+    std::vector<uint8_t> out;
+    // Truncated size
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{}, out, 100));
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{0x80}, out, 100));
+    // Missing literals
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{0x02, 0x20, 0x01}, out, 100));
+    // Fewer bytes than the announced size
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{0x03, 0x20, 0x01, 0x02}, out, 100));
+    // More bytes than the announced size
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{0x01, 0x20, 0x01, 0x02}, out, 100));
+    // Match offsets of zero and before the start of the output
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{0x05, 0x10, 0x01, 0x00, 0x00}, out, 100));
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{0x05, 0x10, 0x01, 0x02, 0x00}, out, 100));
+    // A valid match
+    BOOST_CHECK(LZDecompress(std::vector<uint8_t>{0x05, 0x10, 0x01, 0x01, 0x00, 0x00}, out, 100));
+    BOOST_CHECK(out == std::vector<uint8_t>(5, 0x01));
+    // Above the maximum size
+    BOOST_CHECK(!LZDecompress(std::vector<uint8_t>{0x05, 0x10, 0x01, 0x01, 0x00, 0x00}, out, 4));
+
+    // Truncations and bit flips of valid data are rejected or decompress to the announced size
+    const std::vector<uint8_t> data = g_insecure_rand_ctx.randbytes(1000);
+    std::vector<uint8_t> repeated = data;
+    repeated.insert(repeated.end(), data.begin(), data.end());
+    const std::vector<uint8_t> compressed = LZCompress(repeated);
+    for (size_t i = 0; i < compressed.size(); ++i) {
+        BOOST_CHECK(!LZDecompress(Span<const uint8_t>(compressed.data(), i), out, repeated.size()));
+        std::vector<uint8_t> corrupt = compressed;
+        corrupt[i] ^= 1 << InsecureRandRange(8);
+        if (LZDecompress(corrupt, out, 1 << 20)) {
+            BOOST_CHECK(out.size() <= (1 << 20));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,78 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <fs.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/mappedfile.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mappedfile_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(mappedfile_contents)
+{
+    const fs::path path = GetDataDir() / "mappedfile";
+    BOOST_CHECK(MappedFile(path).IsNull());
+
+    FILE* file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    fclose(file);
+    BOOST_CHECK(MappedFile(path).IsNull());
+
+    const std::vector<uint8_t> data = g_insecure_rand_ctx.randbytes(10000);
+    file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+    const MappedFile mapping(path);
+#ifndef WIN32
+    BOOST_REQUIRE(!mapping.IsNull());
+    BOOST_CHECK(std::vector<uint8_t>(mapping.Data().begin(), mapping.Data().end()) == data);
+#else
+    BOOST_CHECK(mapping.IsNull());
+#endif
+}
+
+static void CheckMappedBlock(const CBlockIndex* pindex)
+{
+    std::vector<uint8_t> expected;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(expected, pindex, Params().MessageStart()));
+    Span<const uint8_t> block;
+    std::shared_ptr<const void> owner;
+    BOOST_REQUIRE(MapRawBlockFromDisk(block, owner, pindex, Params().MessageStart()));
+    BOOST_CHECK(owner);
+    BOOST_CHECK(std::vector<uint8_t>(block.begin(), block.end()) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(map_raw_block)
+{
+    std::vector<const CBlockIndex*> blocks;
+    {
+        LOCK(cs_main);
+        for (int height = 0; height <= ::ChainActive().Height(); ++height) {
+            blocks.push_back(::ChainActive()[height]);
+        }
+    }
+    for (const CBlockIndex* pindex : blocks) CheckMappedBlock(pindex);
+
+    // A block appended to the mapped file is served from a new mapping, and a
+    // block in a compressed file, whose record may need decompressing, too.
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    g_compress_blocks = true;
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    g_compress_blocks = false;
+    {
+        LOCK(cs_main);
+        blocks.push_back(::ChainActive()[::ChainActive().Height() - 1]);
+        blocks.push_back(::ChainActive().Tip());
+    }
+    CheckMappedBlock(blocks[blocks.size() - 2]);
+    CheckMappedBlock(blocks.back());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -200,7 +200,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK_EQUAL(pool.CalculateMemPoolAncestors(entry.Fee(2000000LL).FromTx(tx7), setAncestorsCalculated, 100, 1000000, 1000, 1000000, dummy), true);
     BOOST_CHECK(setAncestorsCalculated == setAncestors);
 
-    pool.addUnchecked(entry.FromTx(tx7), setAncestors);
+    pool.addUnchecked(entry.FromTx(tx7), CTxMemPool::vecEntries(setAncestors.begin(), setAncestors.end()));
     BOOST_CHECK_EQUAL(pool.size(), 7U);
 
     // Now tx6 should be sorted higher (high fee child): tx7, tx6, tx2, ...
@@ -218,7 +218,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     tx8.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx8.vout[0].nValue = 10 * COIN;
     setAncestors.insert(pool.mapTx.find(tx7.GetHash()));
-    pool.addUnchecked(entry.Fee(0LL).Time(2).FromTx(tx8), setAncestors);
+    pool.addUnchecked(entry.Fee(0LL).Time(2).FromTx(tx8), CTxMemPool::vecEntries(setAncestors.begin(), setAncestors.end()));
 
     // Now tx8 should be sorted low, but tx6/tx both high
     sortedOrder.insert(sortedOrder.begin(), tx8.GetHash().ToString());
@@ -232,7 +232,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     tx9.vout.resize(1);
     tx9.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
     tx9.vout[0].nValue = 1 * COIN;
-    pool.addUnchecked(entry.Fee(0LL).Time(3).FromTx(tx9), setAncestors);
+    pool.addUnchecked(entry.Fee(0LL).Time(3).FromTx(tx9), CTxMemPool::vecEntries(setAncestors.begin(), setAncestors.end()));
 
     // tx9 should be sorted low
     BOOST_CHECK_EQUAL(pool.size(), 9U);
@@ -258,7 +258,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK_EQUAL(pool.CalculateMemPoolAncestors(entry.Fee(200000LL).Time(4).FromTx(tx10), setAncestorsCalculated, 100, 1000000, 1000, 1000000, dummy), true);
     BOOST_CHECK(setAncestorsCalculated == setAncestors);
 
-    pool.addUnchecked(entry.FromTx(tx10), setAncestors);
+    pool.addUnchecked(entry.FromTx(tx10), CTxMemPool::vecEntries(setAncestors.begin(), setAncestors.end()));
 
     /**
      *  tx8 and tx9 should both now be sorted higher
@@ -788,4 +788,103 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolLinksTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // A parent with four children, one of which spends two of its outputs
+    CTransactionRef parent = make_tx(/* output_values */ {COIN, COIN, COIN, COIN, COIN});
+    pool.addUnchecked(entry.FromTx(parent));
+    std::vector<CTransactionRef> children;
+    for (uint32_t i = 0; i < 4; i++) {
+        children.push_back(i < 3 ? make_tx(/* output_values */ {COIN / 2}, /* inputs */ {parent}, /* input_indices */ {i}) :
+                                   make_tx(/* output_values */ {COIN / 2}, /* inputs */ {parent, parent}, /* input_indices */ {3, 4}));
+        pool.addUnchecked(entry.FromTx(children.back()));
+    }
+
+    const CTxMemPool::txiter parent_it = *pool.GetIter(parent->GetHash());
+    const CTxMemPoolEntry::Links& links = pool.GetMemPoolChildren(parent_it);
+    BOOST_CHECK(pool.GetMemPoolParents(parent_it).empty());
+    BOOST_CHECK_EQUAL(links.size(), 4U);
+    for (size_t i = 1; i < links.size(); i++) {
+        BOOST_CHECK(links[i - 1]->GetTx().GetHash() < links[i]->GetTx().GetHash());
+    }
+    for (const CTransactionRef& child : children) {
+        const CTxMemPoolEntry::Links& parents = pool.GetMemPoolParents(*pool.GetIter(child->GetHash()));
+        BOOST_CHECK_EQUAL(parents.size(), 1U);
+        BOOST_CHECK(parents[0] == &*parent_it);
+    }
+
+    // Removing the children unlinks them from the parent
+    pool.removeRecursive(*children[3], REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(parent_it).size(), 3U);
+    for (uint32_t i = 0; i < 3; i++) {
+        pool.removeRecursive(*children[i], REMOVAL_REASON_DUMMY);
+    }
+    BOOST_CHECK(pool.GetMemPoolChildren(parent_it).empty());
+    BOOST_CHECK_EQUAL(parent_it->GetCountWithDescendants(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolGraphWalkTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // Random transactions spending up to three outputs of earlier ones, so
+    // that ancestors are reachable along several paths.
+    std::vector<CTransactionRef> txs;
+    std::vector<std::vector<uint32_t>> spent;
+    for (int i = 0; i < 60; i++) {
+        std::vector<CTransactionRef> inputs;
+        std::vector<uint32_t> indices;
+        for (int j = InsecureRandRange(4); j > 0 && !txs.empty(); j--) {
+            const size_t parent = InsecureRandRange(txs.size());
+            if (spent[parent].size() == 5) continue;
+            inputs.push_back(txs[parent]);
+            indices.push_back(spent[parent].size());
+            spent[parent].push_back(i);
+        }
+        txs.push_back(make_tx(/* output_values */ {COIN + i, COIN, COIN, COIN, COIN}, std::move(inputs), std::move(indices)));
+        spent.emplace_back();
+        pool.addUnchecked(entry.FromTx(txs.back()));
+    }
+
+    const uint64_t no_limit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    for (const CTransactionRef& tx : txs) {
+        const CTxMemPool::txiter it = *pool.GetIter(tx->GetHash());
+
+        CTxMemPool::vecEntries ancestors;
+        CTxMemPool::setEntries set_ancestors;
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(*it, ancestors, no_limit, no_limit, no_limit, no_limit, dummy, false));
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(*it, set_ancestors, no_limit, no_limit, no_limit, no_limit, dummy, true));
+        BOOST_CHECK_EQUAL(ancestors.size(), set_ancestors.size());
+        BOOST_CHECK(CTxMemPool::setEntries(ancestors.begin(), ancestors.end()) == set_ancestors);
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), ancestors.size() + 1);
+
+        CTxMemPool::vecEntries descendants;
+        CTxMemPool::setEntries set_descendants;
+        pool.CalculateDescendants(it, descendants);
+        pool.CalculateDescendants(it, set_descendants);
+        BOOST_CHECK(descendants.front() == it);
+        BOOST_CHECK_EQUAL(descendants.size(), set_descendants.size());
+        BOOST_CHECK(CTxMemPool::setEntries(descendants.begin(), descendants.end()) == set_descendants);
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), descendants.size());
+    }
+
+    // Limits are enforced on the number of distinct ancestors
+    CTxMemPool::txiter most = pool.mapTx.begin();
+    for (CTxMemPool::txiter it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+        if (it->GetCountWithAncestors() > most->GetCountWithAncestors()) most = it;
+    }
+    const uint64_t count = most->GetCountWithAncestors();
+    BOOST_CHECK(count > 2);
+    CTxMemPool::vecEntries ancestors;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*most, ancestors, count, no_limit, no_limit, no_limit, dummy, false));
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*most, ancestors, count - 1, no_limit, no_limit, no_limit, dummy, false));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
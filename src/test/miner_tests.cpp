@@ -26,6 +26,7 @@
 namespace miner_tests {
 struct MinerTestingSetup : public TestingSetup {
     void TestPackageSelection(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs);
+    void TestBlockUpdate(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs);
     bool TestSequenceLocks(const CTransaction& tx, int flags) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_node.mempool->cs)
     {
         return CheckSequenceLocks(*m_node.mempool, tx, flags);
@@ -205,6 +206,68 @@ void MinerTestingSetup::TestPackageSelection(const CChainParams& chainparams, co
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
 }
 
+// Test updating a block template in place as the mempool changes, reusing the
+// blockchain created in CreateNewBlock_validity like TestPackageSelection.
+void MinerTestingSetup::TestBlockUpdate(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst)
+{
+    TestMemPoolEntryHelper entry;
+    const CAmount BLOCKSUBSIDY = 50 * COIN;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+    const std::chrono::seconds since = GetTime<std::chrono::seconds>();
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = txFirst[0]->GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1;
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    const uint256 hashParentTx = tx.GetHash();
+    m_node.mempool->addUnchecked(entry.Fee(10000).Time(since.count()).SpendsCoinbase(true).FromTx(tx));
+
+    // A child of the new transaction
+    tx.vin[0].prevout.hash = hashParentTx;
+    tx.vout[0].nValue -= 10000;
+    const uint256 hashChildTx = tx.GetHash();
+    m_node.mempool->addUnchecked(entry.Fee(10000).Time(since.count()).SpendsCoinbase(false).FromTx(tx));
+
+    // Below the minimum feerate for blocks
+    tx.vin[0].prevout.hash = txFirst[1]->GetHash();
+    tx.vout[0].nValue = 5000000000LL;
+    m_node.mempool->addUnchecked(entry.Fee(0).Time(since.count()).SpendsCoinbase(true).FromTx(tx));
+
+    // Entered the mempool before the template was last updated
+    tx.vin[0].prevout.hash = txFirst[2]->GetHash();
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    m_node.mempool->addUnchecked(entry.Fee(10000).Time(since.count() - 1).SpendsCoinbase(true).FromTx(tx));
+
+    BOOST_CHECK(AssemblerForTest(chainparams).UpdateBlock(*pblocktemplate, since));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashParentTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashChildTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[0]->vout[0].scriptPubKey == scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, BLOCKSUBSIDY + 20000);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -20000);
+
+    // Updating again keeps the transactions without adding them twice
+    BOOST_CHECK(AssemblerForTest(chainparams).UpdateBlock(*pblocktemplate, since));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+
+    // Removing the parent from the mempool drops both from the template
+    m_node.mempool->removeRecursive(CTransaction(*pblocktemplate->block.vtx[1]), MemPoolRemovalReason::CONFLICT);
+    BOOST_CHECK(AssemblerForTest(chainparams).UpdateBlock(*pblocktemplate, GetTime<std::chrono::seconds>()));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, BLOCKSUBSIDY);
+
+    // A template on top of another block cannot be updated
+    pblocktemplate->block.hashPrevBlock = uint256();
+    BOOST_CHECK(!AssemblerForTest(chainparams).UpdateBlock(*pblocktemplate, since));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+}
+
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
@@ -522,6 +585,8 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     m_node.mempool->clear();
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
+    m_node.mempool->clear();
+    TestBlockUpdate(chainparams, scriptPubKey, txFirst);
 
     fCheckpointsEnabled = true;
 }
@@ -0,0 +1,151 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <support/allocators/pool.h>
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocating)
+{
+    PoolResource<8, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    // first chunk is allocated on the first request
+    void* block = resource.Allocate(8, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // a freed block is handed out again
+    resource.Deallocate(block, 8, 8);
+    void* b = resource.Allocate(8, 8);
+    BOOST_CHECK_EQUAL(b, block);
+    resource.Deallocate(b, 8, 8);
+
+    // smaller sizes are rounded up to the alignment and share the freelist
+    void* c = resource.Allocate(1, 1);
+    BOOST_CHECK_EQUAL(c, block);
+    resource.Deallocate(c, 1, 1);
+
+    // zero sized allocations still get their own block
+    void* zero1 = resource.Allocate(0, 1);
+    void* zero2 = resource.Allocate(0, 1);
+    BOOST_CHECK(zero1 != zero2);
+    resource.Deallocate(zero1, 0, 1);
+    resource.Deallocate(zero2, 0, 1);
+
+    // blocks that are too large or too aligned for the pool bypass it
+    void* large = resource.Allocate(16, 8);
+    void* aligned = resource.Allocate(8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    resource.Deallocate(large, 16, 8);
+    resource.Deallocate(aligned, 8, 16);
+
+    // exhausting the chunk allocates another one
+    std::set<void*> blocks;
+    for (int i = 0; i < 1024 / 8 + 1; ++i) {
+        BOOST_CHECK(blocks.insert(resource.Allocate(8, 8)).second);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    for (void* p : blocks) {
+        resource.Deallocate(p, 8, 8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(release_chunks_while_emptying)
+{
+    PoolResource<16, 8> resource(64);
+    std::vector<std::pair<void*, size_t>> blocks;
+    for (int i = 0; i < 16; ++i) {
+        const size_t bytes = i % 2 ? 16 : 5;
+        blocks.emplace_back(resource.Allocate(bytes, 8), bytes);
+    }
+    // sizes are counted rounded up to the alignment, blocks that bypass the pool are not counted
+    BOOST_CHECK_EQUAL(resource.BytesInUse(), 8U * 8 + 8 * 16);
+    void* large = resource.Allocate(32, 8);
+    BOOST_CHECK_EQUAL(resource.BytesInUse(), 8U * 8 + 8 * 16);
+    resource.Deallocate(large, 32, 8);
+    const size_t num_chunks = resource.NumAllocatedChunks();
+    BOOST_CHECK(num_chunks > 2);
+
+    // deallocating in the order of the addresses empties the chunks one by one
+    std::sort(blocks.begin(), blocks.end(), [](const std::pair<void*, size_t>& a, const std::pair<void*, size_t>& b) {
+        return std::less<void*>()(a.first, b.first);
+    });
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        resource.Deallocate(blocks[i].first, blocks[i].second, 8);
+        if (i + 1 < blocks.size()) {
+            resource.ReleaseChunksBelow(blocks[i + 1].first);
+        }
+        // a chunk holds at most 64 / 8 blocks, so the lowest one is empty by now
+        if (i == 64 / 8 - 1) BOOST_CHECK(resource.NumAllocatedChunks() < num_chunks);
+    }
+    // only the chunk of the last block is left
+    BOOST_CHECK_EQUAL(resource.BytesInUse(), 0U);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(leftover_memory_is_reused)
+{
+    // 24 bytes per block leaves 16 bytes at the end of a 64 byte chunk, which
+    // go into the 16 byte freelist when the next chunk is allocated.
+    PoolResource<24, 8> resource(64);
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(24, 8);
+    void* c = resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    void* leftover = resource.Allocate(16, 8);
+    BOOST_CHECK_EQUAL(static_cast<unsigned char*>(leftover), static_cast<unsigned char*>(b) + 24);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    for (void* p : {a, b, c}) {
+        resource.Deallocate(p, 24, 8);
+    }
+    resource.Deallocate(leftover, 16, 8);
+}
+
+BOOST_AUTO_TEST_CASE(unordered_map_with_pool_allocator)
+{
+    using Map = std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                   PoolAllocator<std::pair<const uint64_t, uint64_t>, sizeof(std::pair<const uint64_t, uint64_t>) + sizeof(void*) * 4, alignof(void*)>>;
+    Map::allocator_type::ResourceType resource(4096);
+    {
+        Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+        const size_t empty_usage = memusage::DynamicUsage(map);
+        for (uint64_t i = 0; i < 1000; ++i) {
+            map[i] = i * 2;
+        }
+        for (uint64_t i = 0; i < 1000; i += 2) {
+            map.erase(i);
+        }
+        BOOST_CHECK_EQUAL(map.size(), 500U);
+        for (uint64_t i = 1; i < 1000; i += 2) {
+            BOOST_CHECK_EQUAL(map.at(i), i * 2);
+        }
+
+        // Memory usage is the chunks plus the bucket array, however many nodes were freed.
+        const size_t chunks = resource.NumAllocatedChunks();
+        BOOST_CHECK(chunks > 0);
+        BOOST_CHECK(memusage::DynamicUsage(map) > empty_usage);
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(map),
+            chunks * (memusage::MallocUsage(resource.ChunkSizeBytes()) + memusage::MallocUsage(sizeof(void*) * 3)) +
+            memusage::MallocUsage(sizeof(void*) * map.bucket_count()));
+
+        // Freed nodes are reused, so refilling the map does not need new chunks.
+        for (uint64_t i = 0; i < 1000; i += 2) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
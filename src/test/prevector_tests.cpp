@@ -292,4 +292,72 @@ BOOST_AUTO_TEST_CASE(PrevectorTestInt)
     }
 }
 
+/** prevector of prevectors, as used for the script stack: elements are not trivially constructible or destructible */
+BOOST_AUTO_TEST_CASE(PrevectorTestNested)
+{
+    typedef prevector<8, unsigned char> elemtype;
+    std::vector<std::vector<unsigned char>> real_vector;
+    prevector<4, elemtype> pre_vector;
+
+    auto check = [&]() {
+        BOOST_REQUIRE_EQUAL(real_vector.size(), pre_vector.size());
+        for (size_t i = 0; i < real_vector.size(); ++i) {
+            BOOST_REQUIRE_EQUAL(real_vector[i].size(), pre_vector[i].size());
+            BOOST_CHECK(std::equal(real_vector[i].begin(), real_vector[i].end(), pre_vector[i].begin()));
+        }
+    };
+    auto random_element = [&]() -> std::vector<unsigned char> {
+        // Both directly and indirectly stored elements.
+        std::vector<unsigned char> elem(InsecureRandRange(16));
+        for (unsigned char& c : elem) c = InsecureRandBits(8);
+        return elem;
+    };
+
+    for (int i = 0; i < 1000; ++i) {
+        switch (InsecureRandRange(6)) {
+        case 0: {
+            std::vector<unsigned char> elem = random_element();
+            real_vector.push_back(elem);
+            pre_vector.emplace_back(elem.begin(), elem.end());
+            break;
+        }
+        case 1: {
+            std::vector<unsigned char> elem = random_element();
+            size_t pos = InsecureRandRange(real_vector.size() + 1);
+            real_vector.insert(real_vector.begin() + pos, elem);
+            pre_vector.insert(pre_vector.begin() + pos, elemtype(elem.begin(), elem.end()));
+            break;
+        }
+        case 2:
+            if (!real_vector.empty()) {
+                size_t pos = InsecureRandRange(real_vector.size());
+                real_vector.erase(real_vector.begin() + pos);
+                pre_vector.erase(pre_vector.begin() + pos);
+            }
+            break;
+        case 3: {
+            size_t size = InsecureRandRange(12);
+            real_vector.resize(size);
+            pre_vector.resize(size);
+            break;
+        }
+        case 4: {
+            prevector<4, elemtype> copy(pre_vector);
+            pre_vector.clear();
+            pre_vector = copy;
+            break;
+        }
+        case 5:
+            if (real_vector.size() >= 2) {
+                std::swap(real_vector.front(), real_vector.back());
+                std::swap(pre_vector.front(), pre_vector.back());
+            }
+            break;
+        }
+        check();
+    }
+
+    BOOST_CHECK_THROW(pre_vector.at(pre_vector.size()), std::out_of_range);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
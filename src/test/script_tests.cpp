@@ -136,6 +136,11 @@ void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, const CScript
     BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, &scriptWitness, flags, MutableTransactionSignatureChecker(&tx, 0, txCredit.vout[0].nValue), &err) == expect, message);
     BOOST_CHECK_MESSAGE(err == scriptError, FormatScriptError(err) + " where " + FormatScriptError((ScriptError_t)scriptError) + " expected: " + message);
 
+    // The template fast paths must agree with the script interpreter.
+    ScriptError err_generic;
+    BOOST_CHECK_MESSAGE(VerifyScriptGeneric(scriptSig, scriptPubKey, &scriptWitness, flags, MutableTransactionSignatureChecker(&tx, 0, txCredit.vout[0].nValue), &err_generic) == expect, message + " (generic)");
+    BOOST_CHECK_MESSAGE(err_generic == err, FormatScriptError(err_generic) + " where " + FormatScriptError(err) + " expected: " + message + " (generic)");
+
     // Verify that removing flags from a passing test or adding flags to a failing test does not change the result.
     for (int i = 0; i < 16; ++i) {
         int extra_flags = InsecureRandBits(16);
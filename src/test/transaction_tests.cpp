@@ -423,8 +423,10 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction)
     ssout << mtx;
     CTransaction tx(deserialize, ssout);
 
-    // check all inputs concurrently, with the cache
+    // check all inputs concurrently, with the cache, and once more with a
+    // cache the checks initialize themselves
     PrecomputedTransactionData txdata(tx);
+    PrecomputedTransactionData lazy_txdata;
     boost::thread_group threadGroup;
     CCheckQueue<CScriptCheck> scriptcheckqueue(128);
     CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
@@ -442,16 +444,22 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction)
         coins.emplace_back(std::move(coin));
     }
 
-    for(uint32_t i = 0; i < mtx.vin.size(); i++) {
-        std::vector<CScriptCheck> vChecks;
-        CScriptCheck check(coins[tx.vin[i].prevout.n].out, tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, &txdata);
-        vChecks.push_back(CScriptCheck());
-        check.swap(vChecks.back());
-        control.Add(vChecks);
+    for (PrecomputedTransactionData* data : {&txdata, &lazy_txdata}) {
+        for(uint32_t i = 0; i < mtx.vin.size(); i++) {
+            std::vector<CScriptCheck> vChecks;
+            CScriptCheck check(coins[tx.vin[i].prevout.n].out, tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, data);
+            vChecks.push_back(CScriptCheck());
+            check.swap(vChecks.back());
+            control.Add(vChecks);
+        }
     }
 
     bool controlCheck = control.Wait();
     assert(controlCheck);
+    BOOST_CHECK(lazy_txdata.m_ready);
+    BOOST_CHECK(lazy_txdata.hashPrevouts == txdata.hashPrevouts);
+    BOOST_CHECK(lazy_txdata.hashSequence == txdata.hashSequence);
+    BOOST_CHECK(lazy_txdata.hashOutputs == txdata.hashOutputs);
 
     threadGroup.interrupt_all();
     threadGroup.join_all();
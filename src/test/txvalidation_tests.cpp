@@ -3,8 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <consensus/validation.h>
+#include <key.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
+#include <txmempool.h>
 #include <test/util/setup_common.h>
 #include <validation.h>
 
@@ -52,4 +55,87 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
 
+/**
+ * Ensure that a package is accepted as if its transactions were accepted one
+ * by one, whatever order they are given in.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_package, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const auto Sign = [&](CMutableTransaction& tx) {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig = CScript() << vchSig;
+    };
+
+    // A parent spending a mature coinbase, into two outputs
+    CMutableTransaction parent;
+    parent.nVersion = 1;
+    parent.vin.resize(1);
+    parent.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    parent.vout.resize(2);
+    parent.vout[0].nValue = 20 * COIN;
+    parent.vout[0].scriptPubKey = scriptPubKey;
+    parent.vout[1].nValue = 20 * COIN;
+    parent.vout[1].scriptPubKey = scriptPubKey;
+    Sign(parent);
+
+    const auto Spend = [&](const COutPoint& prevout, CAmount value) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = value;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        Sign(tx);
+        return MakeTransactionRef(tx);
+    };
+    const CTransactionRef child1 = Spend(COutPoint(parent.GetHash(), 0), 19 * COIN);
+    const CTransactionRef child2 = Spend(COutPoint(parent.GetHash(), 1), 19 * COIN);
+    const CTransactionRef grandchild = Spend(COutPoint(child1->GetHash(), 0), 18 * COIN);
+    // Spends the same output as child1, without signalling replaceability
+    const CTransactionRef conflict = Spend(COutPoint(parent.GetHash(), 0), 18 * COIN);
+    const CTransactionRef orphan = Spend(COutPoint(InsecureRand256(), 0), 1 * COIN);
+    // child2 with a signature for other outputs, checked in the same batch as child1
+    CMutableTransaction bad_child(*child2);
+    bad_child.vout[0].nValue -= 1;
+    bad_child.vin[0].scriptSig = child2->vin[0].scriptSig;
+
+    std::vector<CTransactionRef> txns{grandchild, child1, MakeTransactionRef(parent), conflict, MakeTransactionRef(bad_child), orphan};
+    std::vector<TxValidationState> states;
+
+    LOCK(cs_main);
+
+    BOOST_CHECK_EQUAL(AcceptPackageToMemoryPool(*m_node.mempool, txns, states, nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */), 3U);
+    BOOST_CHECK_EQUAL(states.size(), txns.size());
+    BOOST_CHECK(states[0].IsValid());
+    BOOST_CHECK(states[1].IsValid());
+    BOOST_CHECK(states[2].IsValid());
+    BOOST_CHECK_EQUAL(states[3].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK(states[4].GetResult() == TxValidationResult::TX_CONSENSUS);
+    BOOST_CHECK(states[5].GetResult() == TxValidationResult::TX_MISSING_INPUTS);
+
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 3U);
+    for (const CTransactionRef& tx : {grandchild, child1}) {
+        BOOST_CHECK(m_node.mempool->exists(tx->GetHash()));
+    }
+    BOOST_CHECK(m_node.mempool->exists(parent.GetHash()));
+
+    // The valid child is accepted, once
+    txns = {child2, child2};
+    BOOST_CHECK_EQUAL(AcceptPackageToMemoryPool(*m_node.mempool, txns, states, nullptr, false, 0), 1U);
+    BOOST_CHECK(states[0].IsValid());
+    BOOST_CHECK_EQUAL(states[1].GetRejectReason(), "txn-already-in-mempool");
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 4U);
+
+    // Reloading the mempool from disk accepts the transactions in batches
+    BOOST_CHECK(DumpMempool(*m_node.mempool));
+    m_node.mempool->clear();
+    BOOST_CHECK(LoadMempool(*m_node.mempool));
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 4U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -95,6 +95,57 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain100Setup)
+{
+    // Transactions with several inputs have their scripts checked by the
+    // script check threads; a single bad signature must still be caught and
+    // reported like a serial check would.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Let the coinbases to spend mature
+    for (int i = 0; i < 4; i++) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(5);
+    for (size_t i = 0; i < spend.vin.size(); i++) {
+        spend.vin[i].prevout.hash = m_coinbase_txns[i]->GetHash();
+        spend.vin[i].prevout.n = 0;
+    }
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 200 * COIN;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    const auto Sign = [&](CMutableTransaction& tx, size_t bad_input) {
+        for (size_t i = 0; i < tx.vin.size(); i++) {
+            std::vector<unsigned char> vchSig;
+            uint256 hash = SignatureHash(scriptPubKey, tx, i, SIGHASH_ALL, 0, SigVersion::BASE);
+            if (i == bad_input) hash = uint256S("1");
+            BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+            vchSig.push_back((unsigned char)SIGHASH_ALL);
+            tx.vin[i].scriptSig = CScript() << vchSig;
+        }
+    };
+
+    LOCK(cs_main);
+
+    CMutableTransaction bad_spend = spend;
+    Sign(bad_spend, 3);
+    TxValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(*m_node.mempool, state, MakeTransactionRef(bad_spend), nullptr, false, 0));
+    BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
+    BOOST_CHECK(state.GetRejectReason().find("mandatory-script-verify-flag-failed") == 0);
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+    Sign(spend, spend.vin.size());
+    state = TxValidationState();
+    BOOST_CHECK(AcceptToMemoryPool(*m_node.mempool, state, MakeTransactionRef(spend), nullptr, false, 0));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 1U);
+}
+
 // Run CheckInputScripts (using CoinsTip()) on the given transaction, for all script
 // flags.  Test that CheckInputScripts passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
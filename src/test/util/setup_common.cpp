@@ -160,6 +160,13 @@ TestingSetup::TestingSetup(const std::string& chainName, const std::vector<const
     }
     g_parallel_script_checks = true;
 
+    // Start coins fetch threads, so blocks' inputs are looked up concurrently.
+    constexpr int coins_fetch_threads = 2;
+    for (int i = 0; i < coins_fetch_threads; ++i) {
+        threadGroup.create_thread([i]() { return ThreadCoinsFetch(i); });
+    }
+    g_parallel_coins_fetch = true;
+
     m_node.mempool = &::mempool;
     m_node.mempool->setSanityCheck(1.0);
     m_node.banman = MakeUnique<BanMan>(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
@@ -190,7 +197,8 @@ TestingSetup::~TestingSetup()
     pblocktree.reset();
 }
 
-TestChain100Setup::TestChain100Setup()
+TestChain100Setup::TestChain100Setup(bool deterministic)
+    : m_deterministic(deterministic)
 {
     // CreateAndProcessBlock() does not support building SegWit blocks, so don't activate in these tests.
     // TODO: fix the code to support SegWit blocks.
@@ -199,7 +207,13 @@ TestChain100Setup::TestChain100Setup()
     SelectParams(CBaseChainParams::REGTEST);
 
     // Generate a 100-block chain:
-    coinbaseKey.MakeNewKey(true);
+    if (m_deterministic) {
+        SetMockTime(1598887952);
+        const std::vector<unsigned char> key_data(32, 0x01);
+        coinbaseKey.Set(key_data.begin(), key_data.end(), true);
+    } else {
+        coinbaseKey.MakeNewKey(true);
+    }
     CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
     for (int i = 0; i < COINBASE_MATURITY; i++)
     {
@@ -240,6 +254,7 @@ CBlock TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransa
 TestChain100Setup::~TestChain100Setup()
 {
     gArgs.ForceSetArg("-segwitheight", "0");
+    if (m_deterministic) SetMockTime(0);
 }
 
 
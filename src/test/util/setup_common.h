@@ -107,7 +107,11 @@ class CScript;
 // 100-block REGTEST-mode block chain
 //
 struct TestChain100Setup : public RegTestingSetup {
-    TestChain100Setup();
+    /**
+     * @param deterministic  If true, use a fixed coinbase key and mock time so
+     *                       that the same chain is built on every run.
+     */
+    explicit TestChain100Setup(bool deterministic = false);
 
     // Create a new block with just given transactions, coinbase paying to
     // scriptPubKey, and try to add it to the current chain.
@@ -116,10 +120,19 @@ struct TestChain100Setup : public RegTestingSetup {
 
     ~TestChain100Setup();
 
+    bool m_deterministic;
     std::vector<CTransactionRef> m_coinbase_txns; // For convenience, coinbase transactions
     CKey coinbaseKey; // private/public key needed to spend coinbase transactions
 };
 
+//
+// Same as TestChain100Setup, but the chain (and so the UTXO set) is the same
+// on every run, e.g. to match the assumeutxo data in chainparams.
+//
+struct TestChain100DeterministicSetup : public TestChain100Setup {
+    TestChain100DeterministicSetup() : TestChain100Setup(true) {}
+};
+
 class CTxMemPoolEntry;
 
 struct TestMemPoolEntryHelper
@@ -4,7 +4,11 @@
 //
 #include <chainparams.h>
 #include <consensus/validation.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <random.h>
+#include <shutdown.h>
+#include <streams.h>
 #include <sync.h>
 #include <test/util/setup_common.h>
 #include <uint256.h>
@@ -14,6 +18,7 @@
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(validation_chainstatemanager_tests, TestingSetup)
 
@@ -150,4 +155,222 @@ BOOST_AUTO_TEST_CASE(chainstatemanager_rebalance_caches)
 
 }
 
+//! Write the UTXO set of the active chainstate to path, in the given snapshot
+//! format. malleation is called on each coin before it is written.
+static SnapshotMetadata WriteSnapshot(const fs::path& path, uint16_t version, std::function<void(COutPoint&, Coin&)> malleation = {})
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    CCoinsStats stats;
+    CBlockIndex* tip;
+    {
+        LOCK(::cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        BOOST_REQUIRE(GetUTXOStats(&::ChainstateActive().CoinsDB(), stats, CoinStatsHashType::NONE, [] {}));
+        pcursor.reset(::ChainstateActive().CoinsDB().Cursor());
+        tip = LookupBlockIndex(stats.hashBlock);
+    }
+    SnapshotMetadata metadata{tip->GetBlockHash(), stats.coins_count, tip->nChainTx, version};
+
+    CAutoFile afile{fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION};
+    afile << metadata;
+    SnapshotChunk chunk;
+    COutPoint key;
+    Coin coin;
+    while (pcursor->Valid()) {
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (malleation) malleation(key, coin);
+            if (version == SNAPSHOT_VERSION_LEGACY) {
+                afile << key;
+                afile << coin;
+            } else {
+                if (chunk.m_txs.empty() || chunk.m_txs.back().first != key.hash) {
+                    chunk.m_txs.emplace_back(key.hash, std::map<uint32_t, Coin>{});
+                }
+                chunk.m_txs.back().second.emplace(key.n, coin);
+            }
+        }
+        pcursor->Next();
+    }
+    if (version == SNAPSHOT_VERSION_COMPACT) {
+        std::vector<unsigned char> encoded;
+        CVectorWriter{SER_DISK, CLIENT_VERSION, encoded, 0, chunk};
+        WriteCompactSize(afile, chunk.CoinsCount());
+        afile << encoded;
+    }
+    return metadata;
+}
+
+//! Try to activate the snapshot at path, optionally replacing its metadata.
+static bool LoadSnapshot(ChainstateManager& chainman, const fs::path& path, const SnapshotMetadata* metadata_override = nullptr)
+{
+    CAutoFile afile{fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION};
+    SnapshotMetadata metadata;
+    afile >> metadata;
+    if (metadata_override) metadata = *metadata_override;
+    return chainman.ActivateSnapshot(afile, metadata, /* in_memory */ true);
+}
+
+//! Test loading a UTXO snapshot into a second chainstate and activating it.
+BOOST_FIXTURE_TEST_CASE(chainstatemanager_activate_snapshot, TestChain100DeterministicSetup)
+{
+    ChainstateManager& chainman = *Assert(m_node.chainman);
+    chainman.m_total_coinstip_cache = 1 << 23;
+    chainman.m_total_coinsdb_cache = 1 << 23;
+    CChainState& ibd_chainstate = WITH_LOCK(::cs_main, return std::ref(chainman.ActiveChainstate()));
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Mine up to a height with assumeutxo data; snapshots are only accepted there.
+    const fs::path path = GetDataDir() / "snapshot.dat";
+    for (int i = 0; i < 10; ++i) {
+        CreateAndProcessBlock({}, script_pub_key);
+    }
+    BOOST_CHECK_EQUAL(WITH_LOCK(::cs_main, return chainman.ActiveHeight()), 110);
+    BOOST_REQUIRE(ExpectedAssumeutxo(110, Params()));
+    BOOST_CHECK(!ExpectedAssumeutxo(109, Params()));
+
+    // An unknown base block is rejected.
+    SnapshotMetadata bad_metadata = WriteSnapshot(path, SNAPSHOT_VERSION_LEGACY);
+    bad_metadata.m_base_blockhash = InsecureRand256();
+    BOOST_CHECK(!LoadSnapshot(chainman, path, &bad_metadata));
+
+    for (const uint16_t version : {SNAPSHOT_VERSION_LEGACY, SNAPSHOT_VERSION_COMPACT}) {
+        // So is a wrong number of coins, in either direction.
+        bad_metadata = WriteSnapshot(path, version);
+        bad_metadata.m_coins_count -= 1;
+        BOOST_CHECK(!LoadSnapshot(chainman, path, &bad_metadata));
+        bad_metadata.m_coins_count += 2;
+        BOOST_CHECK(!LoadSnapshot(chainman, path, &bad_metadata));
+
+        // And content that does not hash to the assumeutxo value.
+        WriteSnapshot(path, version, [](COutPoint& outpoint, Coin& coin) {
+            coin.out.nValue -= 1;
+        });
+        BOOST_CHECK(!LoadSnapshot(chainman, path));
+        WriteSnapshot(path, version, [](COutPoint& outpoint, Coin& coin) {
+            coin.nHeight = 200;
+        });
+        BOOST_CHECK(!LoadSnapshot(chainman, path));
+    }
+
+    // A snapshot written by WriteUTXOSnapshot loads like one written coin by
+    // coin, and WriteUTXOSnapshot hashes the UTXO set like GetUTXOStats.
+    {
+        std::unique_ptr<CCoinsViewCursor> pcursor;
+        CCoinsStats expected_stats;
+        CBlockIndex* tip;
+        {
+            LOCK(::cs_main);
+            BOOST_REQUIRE(GetUTXOStats(&ibd_chainstate.CoinsDB(), expected_stats, CoinStatsHashType::HASH_SERIALIZED, [] {}));
+            pcursor.reset(ibd_chainstate.CoinsDB().Cursor());
+            tip = LookupBlockIndex(expected_stats.hashBlock);
+        }
+        SnapshotMetadata metadata{tip->GetBlockHash(), 0, tip->nChainTx};
+        CCoinsStats stats;
+        CAutoFile afile{fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION};
+        BOOST_REQUIRE(WriteUTXOSnapshot(*pcursor, tip->nHeight, afile, metadata, stats));
+        afile.fclose();
+        BOOST_CHECK(stats.hashSerialized == expected_stats.hashSerialized);
+        BOOST_CHECK_EQUAL(stats.coins_count, expected_stats.coins_count);
+        BOOST_CHECK_EQUAL(metadata.m_coins_count, expected_stats.coins_count);
+
+        CAutoFile written{fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION};
+        SnapshotMetadata written_metadata;
+        written >> written_metadata;
+        BOOST_CHECK_EQUAL(written_metadata.m_version, SNAPSHOT_VERSION_COMPACT);
+        BOOST_CHECK_EQUAL(written_metadata.m_coins_count, expected_stats.coins_count);
+        BOOST_CHECK(written_metadata.m_base_blockhash == tip->GetBlockHash());
+    }
+
+    // Unknown snapshot versions are refused.
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << SnapshotMetadata{InsecureRand256(), 1, 1, static_cast<uint16_t>(SNAPSHOT_VERSION_COMPACT + 1)};
+        SnapshotMetadata metadata;
+        BOOST_CHECK_THROW(ss >> metadata, std::ios_base::failure);
+    }
+
+    // None of the failed attempts changed the active chainstate.
+    BOOST_CHECK(!chainman.IsSnapshotActive());
+    BOOST_CHECK_EQUAL(&chainman.ActiveChainstate(), &ibd_chainstate);
+
+    // Snapshots in the legacy format still load.
+    const SnapshotMetadata metadata = WriteSnapshot(path, SNAPSHOT_VERSION_LEGACY);
+    BOOST_REQUIRE(LoadSnapshot(chainman, path));
+    BOOST_CHECK(chainman.IsSnapshotActive());
+    BOOST_CHECK(chainman.IsBackgroundIBD(&ibd_chainstate));
+    {
+        LOCK(::cs_main);
+        CChainState& snapshot_chainstate = chainman.ActiveChainstate();
+        BOOST_CHECK(&snapshot_chainstate != &ibd_chainstate);
+        BOOST_CHECK(snapshot_chainstate.m_from_snapshot_blockhash == metadata.m_base_blockhash);
+        BOOST_CHECK(chainman.ActiveTip()->GetBlockHash() == metadata.m_base_blockhash);
+        BOOST_CHECK(snapshot_chainstate.CoinsTip().GetBestBlock() == metadata.m_base_blockhash);
+
+        // The loaded UTXO set is the one it was dumped from.
+        CCoinsStats ibd_stats;
+        CCoinsStats snapshot_stats;
+        ibd_chainstate.ForceFlushStateToDisk();
+        BOOST_CHECK(GetUTXOStats(&ibd_chainstate.CoinsDB(), ibd_stats, CoinStatsHashType::HASH_SERIALIZED, [] {}));
+        BOOST_CHECK(GetUTXOStats(&snapshot_chainstate.CoinsDB(), snapshot_stats, CoinStatsHashType::HASH_SERIALIZED, [] {}));
+        BOOST_CHECK(ibd_stats.hashSerialized == snapshot_stats.hashSerialized);
+        BOOST_CHECK_EQUAL(snapshot_stats.coins_count, metadata.m_coins_count);
+    }
+
+    // A second snapshot cannot be activated.
+    BOOST_CHECK(!LoadSnapshot(chainman, path));
+
+    // New blocks extend the snapshot chainstate.
+    CreateAndProcessBlock({}, script_pub_key);
+    {
+        LOCK(::cs_main);
+        BOOST_CHECK_EQUAL(chainman.ActiveHeight(), 111);
+        BOOST_CHECK_EQUAL(ibd_chainstate.m_chain.Height(), 110);
+        BOOST_CHECK_EQUAL(chainman.ActiveTip()->nChainTx, 112U);
+        BOOST_CHECK_EQUAL(chainman.BackgroundValidationChainstate(), &ibd_chainstate);
+        BOOST_CHECK_EQUAL(chainman.GetAll().size(), 2U);
+    }
+
+    // Only the active chainstate reads blocks ahead: the prefetcher keeps a
+    // single window, which background validation would keep replacing.
+    const int prefetch_depth = g_block_prefetch_depth;
+    g_block_prefetch_depth = 8;
+    boost::thread prefetch_thread([] { ThreadBlockPrefetch(0); });
+    {
+        LOCK(::cs_main);
+        BOOST_CHECK_EQUAL(chainman.ActiveChainstate().BlockPrefetchDepth(), 8);
+        BOOST_CHECK_EQUAL(ibd_chainstate.BlockPrefetchDepth(), 0);
+    }
+    CreateAndProcessBlock({}, script_pub_key);
+    BlockValidationState state;
+    BOOST_CHECK(ibd_chainstate.ActivateBestChain(state, Params(), nullptr));
+    {
+        LOCK(::cs_main);
+        BOOST_CHECK_EQUAL(chainman.ActiveHeight(), 112);
+        BOOST_CHECK_EQUAL(ibd_chainstate.m_chain.Height(), 110);
+    }
+    prefetch_thread.interrupt();
+    prefetch_thread.join();
+    g_block_prefetch_depth = prefetch_depth;
+
+    // Hashing the UTXO set stops when the node shuts down.
+    StartShutdown();
+    BOOST_CHECK(!chainman.MaybeCompleteSnapshotValidation());
+    BOOST_CHECK(!chainman.IsSnapshotValidated());
+    AbortShutdown();
+
+    // The IBD chainstate already is at the snapshot base, which completes
+    // background validation.
+    BOOST_CHECK(chainman.MaybeCompleteSnapshotValidation());
+    BOOST_CHECK(chainman.IsSnapshotValidated());
+    {
+        LOCK(::cs_main);
+        BOOST_CHECK(!chainman.BackgroundValidationChainstate());
+        BOOST_CHECK_EQUAL(chainman.GetAll().size(), 1U);
+        BOOST_CHECK_EQUAL(&chainman.ValidatedChainstate(), &chainman.ActiveChainstate());
+    }
+
+    // Let scheduler events finish running to avoid accessing memory that is going to be unloaded
+    SyncWithValidationInterfaceQueue();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
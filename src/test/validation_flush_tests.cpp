@@ -52,7 +52,10 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
         BOOST_TEST_MESSAGE("CCoinsViewCache memory usage: " << view.DynamicMemoryUsage());
     };
 
-    constexpr size_t MAX_COINS_CACHE_BYTES = 1024;
+    // The coins cache allocates its entries from 256 KiB chunks (see
+    // PoolResource), so the first coin already accounts for one full chunk.
+    // Leave a little room on top of that.
+    constexpr size_t MAX_COINS_CACHE_BYTES = 262144 + 512;
 
     // Without any coins in the cache, we shouldn't need to flush.
     BOOST_CHECK_EQUAL(
@@ -91,9 +94,11 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
         COutPoint res = add_coin(view);
         print_view_mem_usage(view);
         BOOST_CHECK_EQUAL(view.AccessCoin(res).DynamicMemoryUsage(), COIN_SIZE);
+        // The first coin allocates a whole chunk, which is over 90% of the
+        // limit right away.
         BOOST_CHECK_EQUAL(
             chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
-            CoinsCacheSizeState::OK);
+            CoinsCacheSizeState::LARGE);
     }
 
     // Adding some additional coins will push us over the edge to CRITICAL.
@@ -110,21 +115,21 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
         chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
         CoinsCacheSizeState::CRITICAL);
 
-    // Passing non-zero max mempool usage should allow us more headroom.
+    // Passing non-zero max mempool usage (512 KiB) should allow us more headroom.
     BOOST_CHECK_EQUAL(
-        chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+        chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 19),
         CoinsCacheSizeState::OK);
 
     for (int i{0}; i < 3; ++i) {
         add_coin(view);
         print_view_mem_usage(view);
         BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+            chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 19),
             CoinsCacheSizeState::OK);
     }
 
-    // Adding another coin with the additional mempool room will put us >90%
-    // but not yet critical.
+    // Adding another coin with a little additional mempool room will put us
+    // >90% but not yet critical.
     add_coin(view);
     print_view_mem_usage(view);
 
@@ -147,20 +152,74 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
             CoinsCacheSizeState::OK);
     }
 
-    // Flushing the view doesn't take us back to OK because cacheCoins has
-    // preallocated memory that doesn't get reclaimed even after flush.
-
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, 0),
         CoinsCacheSizeState::CRITICAL);
 
+    // Flushing the view releases the memory of the cache, taking us back to OK.
     view.SetBestBlock(InsecureRand256());
     BOOST_CHECK(view.Flush());
     print_view_mem_usage(view);
 
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(&tx_pool, MAX_COINS_CACHE_BYTES, 0),
+        CoinsCacheSizeState::OK);
+}
+
+//! Spent coins dropped by Sync() stay in the pool of the coins cache until
+//! Trim() compacts it, even when it has nothing to evict.
+BOOST_AUTO_TEST_CASE(sync_then_trim_releases_memory)
+{
+    BlockManager blockman{};
+    CChainState chainstate{blockman};
+    chainstate.InitCoinsDB(/*cache_size_bytes*/ 1 << 10, /*in_memory*/ true, /*should_wipe*/ false);
+    WITH_LOCK(::cs_main, chainstate.InitCoinsCache(1 << 10));
+    CTxMemPool tx_pool{};
+
+    LOCK(::cs_main);
+    auto& view = chainstate.CoinsTip();
+
+    std::vector<COutPoint> outpoints;
+    for (int i{0}; i < 20000; ++i) {
+        Coin newcoin;
+        COutPoint outp{InsecureRand256(), 0};
+        newcoin.nHeight = 1;
+        newcoin.out.nValue = InsecureRand32();
+        newcoin.out.scriptPubKey.assign((uint32_t)56, 1);
+        view.AddCoin(outp, std::move(newcoin), false);
+        outpoints.push_back(outp);
+    }
+    view.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(view.Sync());
+
+    // Limit the cache to half of what the full set of coins takes.
+    const size_t max_coins_cache_bytes = view.DynamicMemoryUsage() / 2;
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(&tx_pool, max_coins_cache_bytes, /*max_mempool_size_bytes*/ 0),
         CoinsCacheSizeState::CRITICAL);
+
+    // Spend nine out of ten coins: what remains fits well under the target,
+    // but the memory of the spent coins is still held.
+    for (size_t i{0}; i < outpoints.size(); ++i) {
+        if (i % 10 != 0) BOOST_CHECK(view.SpendCoin(outpoints[i]));
+    }
+    BOOST_CHECK(view.Sync());
+    const size_t target_usage = max_coins_cache_bytes / 2;
+    BOOST_CHECK(view.CompactedMemoryUsage() < target_usage);
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(&tx_pool, max_coins_cache_bytes, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::CRITICAL);
+
+    BOOST_CHECK_EQUAL(view.Trim(target_usage), 0U);
+    BOOST_TEST_MESSAGE("CCoinsViewCache memory usage after trim: " << view.DynamicMemoryUsage());
+    BOOST_CHECK(view.DynamicMemoryUsage() < max_coins_cache_bytes * 9 / 10);
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(&tx_pool, max_coins_cache_bytes, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::OK);
+    BOOST_CHECK_EQUAL(view.GetCacheSize(), outpoints.size() / 10);
+    for (size_t i{0}; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(view.HaveCoinInCache(outpoints[i]), i % 10 == 0);
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -27,6 +27,8 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_INDEX_CACHE = 'I';
+static const char DB_BLOCK_FILE_REWRITE = 'W';
 
 namespace {
 
@@ -47,11 +49,15 @@ CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, b
 
 void CCoinsViewDB::ResizeCache(size_t new_cache_size)
 {
-    // Have to do a reset first to get the original `m_db` state to release its
-    // filesystem lock.
-    m_db.reset();
-    m_db = MakeUnique<CDBWrapper>(
-        m_ldb_path, new_cache_size, m_is_memory, /*fWipe*/ false, /*obfuscate*/ true);
+    // We can't do this operation with an in-memory DB since we'll lose all the coins upon
+    // reset.
+    if (!m_is_memory) {
+        // Have to do a reset first to get the original `m_db` state to release its
+        // filesystem lock.
+        m_db.reset();
+        m_db = MakeUnique<CDBWrapper>(
+            m_ldb_path, new_cache_size, m_is_memory, /*fWipe*/ false, /*obfuscate*/ true);
+    }
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
@@ -77,7 +83,7 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
@@ -112,8 +118,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        it = erase ? mapCoins.erase(it) : std::next(it);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             m_db->WriteBatch(batch);
@@ -138,6 +143,15 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::WriteCoins(const std::vector<std::pair<COutPoint, Coin>>& coins)
+{
+    CDBBatch batch(*m_db);
+    for (const std::pair<COutPoint, Coin>& coin : coins) {
+        batch.Write(CoinEntry(&coin.first), coin.second);
+    }
+    return m_db->WriteBatch(batch);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return m_db->EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -228,9 +242,39 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    // Any block index cache file no longer matches the entries.
+    batch.Erase(DB_BLOCK_INDEX_CACHE);
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadBlockIndexCacheHash(uint256& hash) {
+    return Read(DB_BLOCK_INDEX_CACHE, hash);
+}
+
+bool CBlockTreeDB::WriteBlockIndexCacheHash(const uint256& hash) {
+    return Write(DB_BLOCK_INDEX_CACHE, hash, true);
+}
+
+bool CBlockTreeDB::WriteBlockFileRewrite(int nFile, const CBlockFileInfo& info, const std::vector<const CBlockIndex*>& blockinfo) {
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_BLOCK_FILES, nFile), info);
+    for (const CBlockIndex* pindex : blockinfo) {
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, pindex->GetBlockHash()), CDiskBlockIndex(pindex));
+    }
+    batch.Erase(DB_BLOCK_INDEX_CACHE);
+    batch.Write(std::make_pair(DB_FLAG, std::string("blockfilesrewritten")), '1');
+    batch.Write(DB_BLOCK_FILE_REWRITE, nFile);
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::ReadBlockFileRewrite(int& nFile) {
+    return Read(DB_BLOCK_FILE_REWRITE, nFile);
+}
+
+bool CBlockTreeDB::EraseBlockFileRewrite() {
+    return Erase(DB_BLOCK_FILE_REWRITE, true);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -59,9 +59,14 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Write unspent coins straight to the database, bypassing any cache and
+    //! leaving the best block untouched. Used to bulk-load a UTXO snapshot
+    //! into a fresh database; may be called from several threads at once.
+    bool WriteCoins(const std::vector<std::pair<COutPoint, Coin>>& coins);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -106,6 +111,17 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! Hash of the block index cache file matching the block index entries,
+    //! erased by every WriteBatchSync.
+    bool ReadBlockIndexCacheHash(uint256& hash);
+    bool WriteBlockIndexCacheHash(const uint256& hash);
+    //! Commit the rewritten blk and rev file nFile (see RewriteBlockFiles):
+    //! its info and the entries of the blocks stored in it, with a marker
+    //! that the rewritten files still have to be moved into place. Also sets
+    //! the "blockfilesrewritten" flag.
+    bool WriteBlockFileRewrite(int nFile, const CBlockFileInfo& info, const std::vector<const CBlockIndex*>& blockinfo);
+    bool ReadBlockFileRewrite(int& nFile);
+    bool EraseBlockFileRewrite();
 };
 
 #endif // BITCOIN_TXDB_H
@@ -0,0 +1,158 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/lz.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/** Shortest match that is encoded as a match rather than as literals. */
+constexpr size_t MIN_MATCH = 4;
+/** Largest distance a match can refer back. */
+constexpr size_t MAX_OFFSET = 0xffff;
+/** Number of hash table entries, as a power of two, used to find matches. */
+constexpr int HASH_BITS = 16;
+/** Length nibble value meaning that extra length bytes follow. */
+constexpr uint8_t EXTENDED_LENGTH = 15;
+
+uint32_t HashSequence(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+void WriteVarInt(std::vector<uint8_t>& out, uint64_t n)
+{
+    while (n >= 0x80) {
+        out.push_back(static_cast<uint8_t>(n) | 0x80);
+        n >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(n));
+}
+
+bool ReadVarInt(Span<const uint8_t> data, size_t& pos, uint64_t& n)
+{
+    n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos == data.size()) return false;
+        const uint8_t byte = data[pos++];
+        n |= uint64_t{byte & 0x7fU} << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/** Write the part of a length that did not fit in its token nibble. */
+void WriteExtraLength(std::vector<uint8_t>& out, size_t length)
+{
+    length -= EXTENDED_LENGTH;
+    while (length >= 0xff) {
+        out.push_back(0xff);
+        length -= 0xff;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+/** Add the extra length bytes that follow a token nibble of EXTENDED_LENGTH, failing beyond limit. */
+bool ReadExtraLength(Span<const uint8_t> data, size_t& pos, size_t& length, size_t limit)
+{
+    uint8_t byte;
+    do {
+        if (pos == data.size()) return false;
+        byte = data[pos++];
+        length += byte;
+        if (length > limit) return false;
+    } while (byte == 0xff);
+    return true;
+}
+
+/** Write literals, followed by a match unless match_length is zero. */
+void WriteSequence(std::vector<uint8_t>& out, Span<const uint8_t> literals, size_t offset, size_t match_length)
+{
+    const size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+    const uint8_t token = (std::min<size_t>(literals.size(), EXTENDED_LENGTH) << 4) | std::min<size_t>(match_code, EXTENDED_LENGTH);
+    out.push_back(token);
+    if (literals.size() >= EXTENDED_LENGTH) WriteExtraLength(out, literals.size());
+    out.insert(out.end(), literals.begin(), literals.end());
+    if (!match_length) return;
+    out.push_back(static_cast<uint8_t>(offset));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (match_code >= EXTENDED_LENGTH) WriteExtraLength(out, match_code);
+}
+
+} // namespace
+
+std::vector<uint8_t> LZCompress(Span<const uint8_t> data)
+{
+    std::vector<uint8_t> out;
+    out.reserve(data.size() + data.size() / 255 + 16);
+    WriteVarInt(out, data.size());
+
+    // Positions of the most recent occurrence of each hashed 4-byte sequence.
+    // Entries that were never set point at the start of the data, which is
+    // harmless as every candidate match is compared.
+    std::vector<uint32_t> table(size_t{1} << HASH_BITS, 0);
+    const uint8_t* const begin = data.data();
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + MIN_MATCH <= data.size()) {
+        const uint32_t sequence = ReadLE32(begin + pos);
+        uint32_t& entry = table[HashSequence(sequence)];
+        const size_t candidate = entry;
+        entry = pos;
+        if (candidate >= pos || pos - candidate > MAX_OFFSET || ReadLE32(begin + candidate) != sequence) {
+            // Step faster through data that does not compress.
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (pos + length < data.size() && begin[candidate + length] == begin[pos + length]) ++length;
+        WriteSequence(out, data.subspan(anchor, pos - anchor), pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+    WriteSequence(out, data.subspan(anchor), 0, 0);
+    return out;
+}
+
+bool LZDecompress(Span<const uint8_t> data, std::vector<uint8_t>& out, size_t max_size)
+{
+    size_t pos = 0;
+    uint64_t size;
+    if (!ReadVarInt(data, pos, size) || size > max_size) return false;
+    out.resize(size);
+    size_t written = 0;
+    while (true) {
+        if (pos == data.size()) return false;
+        const uint8_t token = data[pos++];
+
+        size_t literals = token >> 4;
+        if (literals == EXTENDED_LENGTH && !ReadExtraLength(data, pos, literals, size - written)) return false;
+        if (literals > size - written || literals > data.size() - pos) return false;
+        if (literals) memcpy(out.data() + written, data.data() + pos, literals);
+        written += literals;
+        pos += literals;
+
+        // The last sequence has no match.
+        if (pos == data.size()) break;
+
+        if (data.size() - pos < 2) return false;
+        const size_t offset = data[pos] | (size_t{data[pos + 1]} << 8);
+        pos += 2;
+        if (offset == 0 || offset > written) return false;
+        size_t length = token & 0x0f;
+        if (length == EXTENDED_LENGTH && !ReadExtraLength(data, pos, length, size - written)) return false;
+        length += MIN_MATCH;
+        if (length > size - written) return false;
+        // Matches may overlap the bytes they produce, so copy forwards.
+        uint8_t* const dst = out.data() + written;
+        const uint8_t* const src = dst - offset;
+        for (size_t i = 0; i < length; ++i) dst[i] = src[i];
+        written += length;
+    }
+    return written == size;
+}
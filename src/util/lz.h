@@ -0,0 +1,32 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_LZ_H
+#define BITCOIN_UTIL_LZ_H
+
+#include <span.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A small LZ77 codec in the spirit of LZ4, used for block storage.
+ *
+ * The compressed data starts with the size of the uncompressed data as a
+ * LEB128 varint, followed by sequences of a token byte (literal length in
+ * the high nibble, match length minus 4 in the low nibble, 15 meaning that
+ * more length bytes follow), the literals, a 2-byte little endian match
+ * offset and the extra match length bytes. The last sequence consists of
+ * literals only.
+ */
+std::vector<uint8_t> LZCompress(Span<const uint8_t> data);
+
+/**
+ * Decompress the output of LZCompress into out. Fails on malformed input,
+ * and on input that would decompress to more than max_size bytes.
+ */
+bool LZDecompress(Span<const uint8_t> data, std::vector<uint8_t>& out, size_t max_size);
+
+#endif // BITCOIN_UTIL_LZ_H
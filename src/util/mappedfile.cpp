@@ -0,0 +1,39 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/mappedfile.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const fs::path& path)
+{
+#ifndef WIN32
+    const int fd = open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            m_data = static_cast<const uint8_t*>(addr);
+            m_size = st.st_size;
+        }
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+#else
+    (void)path;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef WIN32
+    if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+}
@@ -0,0 +1,41 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_MAPPEDFILE_H
+#define BITCOIN_UTIL_MAPPEDFILE_H
+
+#include <fs.h>
+#include <span.h>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A read-only memory mapping of a whole file, as large as the file was when
+ * it was mapped. Writes to the file through other handles are visible in the
+ * mapping, but the file must not be truncated below a range that is read.
+ *
+ * Only supported on POSIX systems. Elsewhere the mapping is always null, and
+ * callers should fall back to reading the file.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const fs::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** Whether mapping the file failed, or it is empty. */
+    bool IsNull() const { return m_data == nullptr; }
+
+    Span<const uint8_t> Data() const { return Span<const uint8_t>(m_data, m_size); }
+
+private:
+    const uint8_t* m_data{nullptr};
+    size_t m_size{0};
+};
+
+#endif // BITCOIN_UTIL_MAPPEDFILE_H
@@ -14,13 +14,17 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <core_memusage.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
 #include <index/txindex.h>
 #include <logging.h>
 #include <logging/timer.h>
+#include <node/blockprefetch.h>
+#include <node/coinstats.h>
 #include <node/ui_interface.h>
+#include <node/utxo_snapshot.h>
 #include <optional.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
@@ -33,6 +37,7 @@
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <shutdown.h>
+#include <streams.h>
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
@@ -40,6 +45,8 @@
 #include <uint256.h>
 #include <undo.h>
 #include <util/check.h> // For NDEBUG compile time check
+#include <util/lz.h>
+#include <util/mappedfile.h>
 #include <util/moneystr.h>
 #include <util/rbf.h>
 #include <util/strencodings.h>
@@ -48,9 +55,11 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <numeric>
 #include <string>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/thread/thread.hpp>
 
 #define MICRO 0.000001
 #define MILLI 0.001
@@ -71,8 +80,12 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static constexpr std::chrono::hours DATABASE_WRITE_INTERVAL{1};
 /** Time to wait between flushing chainstate to disk. */
 static constexpr std::chrono::hours DATABASE_FLUSH_INTERVAL{24};
+/** Share of its space the coins cache is trimmed to when a flush finds it full. */
+static constexpr int COINS_CACHE_TRIM_PERCENT{50};
 /** Maximum age of our tip for us to be considered current for fee estimation */
 static constexpr std::chrono::hours MAX_FEE_ESTIMATION_TIP_AGE{3};
+/** Number of blocks between the progress messages of background validation */
+static constexpr int BACKGROUND_VALIDATION_LOG_INTERVAL{2000};
 const std::vector<std::string> CHECKLEVEL_DOC {
     "level 0 reads the blocks from disk",
     "level 1 verifies block validity",
@@ -132,12 +145,15 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+bool g_parallel_coins_fetch{false};
+int g_block_prefetch_depth{0};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool g_compress_blocks = DEFAULT_COMPRESS_BLOCKS;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -198,6 +214,9 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
+/** Script check threads, shared by block connection and mempool acceptance. */
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
 // See definition for documentation
 static void FindFilesToPruneManual(ChainstateManager& chainman, std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(ChainstateManager& chainman, std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
@@ -446,6 +465,12 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
     return CheckInputScripts(tx, state, view, flags, /* cacheSigStore = */ true, /* cacheFullSciptStore = */ true, txdata);
 }
 
+/** Transactions with fewer inputs have their scripts checked on the calling thread. */
+static constexpr size_t MIN_PARALLEL_SCRIPT_CHECK_INPUTS = 4;
+
+static int64_t nTimeAcceptTx = 0;
+static int64_t nTxAccepted = 0;
+
 namespace {
 
 class MemPoolAccept
@@ -480,6 +505,16 @@ public:
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Accept the pending transactions of a package that neither depend on
+    // other pending transactions nor spend the same inputs, checking their
+    // scripts as one batch. Transactions that do are left pending for a later
+    // round, as is everything after a replacement, which is accepted on its
+    // own. Resolved transactions are removed from pending, with their state
+    // in args, and the number accepted is added to accepted.
+    // Returns false if transactions left the mempool, in which case coins
+    // cached by this instance may be stale and it must not be used again.
+    bool AcceptPackageRound(const std::vector<CTransactionRef>& txns, std::vector<ATMPArgs>& args, std::vector<size_t>& pending, size_t& accepted) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -487,7 +522,7 @@ private:
         Workspace(const CTransactionRef& ptx) : m_ptx(ptx), m_hash(ptx->GetHash()) {}
         std::set<uint256> m_conflicts;
         CTxMemPool::setEntries m_all_conflicting;
-        CTxMemPool::setEntries m_ancestors;
+        CTxMemPool::vecEntries m_ancestors;
         std::unique_ptr<CTxMemPoolEntry> m_entry;
 
         bool m_replacement_transaction;
@@ -505,6 +540,10 @@ private:
     // only tests that are fast should be done here (to avoid CPU DoS).
     bool PreChecks(ATMPArgs& args, Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
+    // Calculate the in-mempool ancestors of entry, checking the ancestor and
+    // descendant limits of the package it would join.
+    bool CheckPackageLimits(const CTxMemPoolEntry& entry, CTxMemPool::vecEntries& ancestors, TxValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(m_pool.cs);
+
     // Run the script checks using our policy flags. As this can be slow, we should
     // only invoke this on transactions that have otherwise passed policy checks.
     bool PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -515,10 +554,12 @@ private:
     // utxo set or in the mempool.
     bool ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData &txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-    // Try to add the transaction to the mempool, removing any conflicts first.
-    // Returns true if the transaction is in the mempool after any size
-    // limiting is performed, false otherwise.
-    bool Finalize(ATMPArgs& args, Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+    // Add the transaction to the mempool, removing any conflicts first. The
+    // caller limits the size of the mempool afterwards.
+    void Finalize(ATMPArgs& args, Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+
+    // Limit the size of the mempool, unless bypassing the limits.
+    void LimitSize(const ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
     // Compare a package's feerate against minimum allowed.
     bool CheckFeeRate(size_t package_size, CAmount package_fee, TxValidationState& state)
@@ -565,7 +606,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     // Alias what we need out of ws
     std::set<uint256>& setConflicts = ws.m_conflicts;
     CTxMemPool::setEntries& allConflicting = ws.m_all_conflicting;
-    CTxMemPool::setEntries& setAncestors = ws.m_ancestors;
+    CTxMemPool::vecEntries& ancestors = ws.m_ancestors;
     std::unique_ptr<CTxMemPoolEntry>& entry = ws.m_entry;
     bool& fReplacementTransaction = ws.m_replacement_transaction;
     CAmount& nModifiedFees = ws.m_modified_fees;
@@ -765,33 +806,15 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         m_limit_descendant_size += conflict->GetSizeWithDescendants();
     }
 
-    std::string errString;
-    if (!m_pool.CalculateMemPoolAncestors(*entry, setAncestors, m_limit_ancestors, m_limit_ancestor_size, m_limit_descendants, m_limit_descendant_size, errString)) {
-        setAncestors.clear();
-        // If CalculateMemPoolAncestors fails second time, we want the original error string.
-        std::string dummy_err_string;
-        // Contracting/payment channels CPFP carve-out:
-        // If the new transaction is relatively small (up to 40k weight)
-        // and has at most one ancestor (ie ancestor limit of 2, including
-        // the new transaction), allow it if its parent has exactly the
-        // descendant limit descendants.
-        //
-        // This allows protocols which rely on distrusting counterparties
-        // being able to broadcast descendants of an unconfirmed transaction
-        // to be secure by simply only having two immediately-spendable
-        // outputs - one for each counterparty. For more info on the uses for
-        // this, see https://lists.linuxfoundation.org/pipermail/bitcoin-dev/2018-November/016518.html
-        if (nSize >  EXTRA_DESCENDANT_TX_SIZE_LIMIT ||
-                !m_pool.CalculateMemPoolAncestors(*entry, setAncestors, 2, m_limit_ancestor_size, m_limit_descendants + 1, m_limit_descendant_size + EXTRA_DESCENDANT_TX_SIZE_LIMIT, dummy_err_string)) {
-            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-long-mempool-chain", errString);
-        }
+    if (!CheckPackageLimits(*entry, ancestors, state)) {
+        return false; // state filled in by CheckPackageLimits
     }
 
     // A transaction that spends outputs that would be replaced by it is invalid. Now
     // that we have the set of all ancestors we can detect this
-    // pathological case by making sure setConflicts and setAncestors don't
+    // pathological case by making sure setConflicts and ancestors don't
     // intersect.
-    for (CTxMemPool::txiter ancestorIt : setAncestors)
+    for (CTxMemPool::txiter ancestorIt : ancestors)
     {
         const uint256 &hashAncestor = ancestorIt->GetTx().GetHash();
         if (setConflicts.count(hashAncestor))
@@ -920,6 +943,32 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     return true;
 }
 
+bool MemPoolAccept::CheckPackageLimits(const CTxMemPoolEntry& entry, CTxMemPool::vecEntries& ancestors, TxValidationState& state)
+{
+    std::string errString;
+    if (!m_pool.CalculateMemPoolAncestors(entry, ancestors, m_limit_ancestors, m_limit_ancestor_size, m_limit_descendants, m_limit_descendant_size, errString)) {
+        ancestors.clear();
+        // If CalculateMemPoolAncestors fails second time, we want the original error string.
+        std::string dummy_err_string;
+        // Contracting/payment channels CPFP carve-out:
+        // If the new transaction is relatively small (up to 40k weight)
+        // and has at most one ancestor (ie ancestor limit of 2, including
+        // the new transaction), allow it if its parent has exactly the
+        // descendant limit descendants.
+        //
+        // This allows protocols which rely on distrusting counterparties
+        // being able to broadcast descendants of an unconfirmed transaction
+        // to be secure by simply only having two immediately-spendable
+        // outputs - one for each counterparty. For more info on the uses for
+        // this, see https://lists.linuxfoundation.org/pipermail/bitcoin-dev/2018-November/016518.html
+        if (entry.GetTxSize() > EXTRA_DESCENDANT_TX_SIZE_LIMIT ||
+                !m_pool.CalculateMemPoolAncestors(entry, ancestors, 2, m_limit_ancestor_size, m_limit_descendants + 1, m_limit_descendant_size + EXTRA_DESCENDANT_TX_SIZE_LIMIT, dummy_err_string)) {
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-long-mempool-chain", errString);
+        }
+    }
+    return true;
+}
+
 bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata)
 {
     const CTransaction& tx = *ws.m_ptx;
@@ -930,7 +979,20 @@ bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, Precompute
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
+    // The inputs of larger transactions are spread over the script check
+    // threads, as in ConnectBlock, which shortens the time cs_main is held.
+    // The queue only reports whether all checks passed, so a failure is
+    // checked again below to fill in the state.
+    bool parallel_ok = false;
+    if (g_parallel_script_checks && tx.vin.size() >= MIN_PARALLEL_SCRIPT_CHECK_INPUTS) {
+        std::vector<CScriptCheck> checks;
+        if (CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata, &checks)) {
+            CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+            control.Add(checks);
+            parallel_ok = control.Wait();
+        }
+    }
+    if (!parallel_ok && !CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
@@ -979,15 +1041,14 @@ bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, Precomp
     return true;
 }
 
-bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
+void MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
 {
     const CTransaction& tx = *ws.m_ptx;
     const uint256& hash = ws.m_hash;
-    TxValidationState &state = args.m_state;
     const bool bypass_limits = args.m_bypass_limits;
 
     CTxMemPool::setEntries& allConflicting = ws.m_all_conflicting;
-    CTxMemPool::setEntries& setAncestors = ws.m_ancestors;
+    CTxMemPool::vecEntries& ancestors = ws.m_ancestors;
     const CAmount& nModifiedFees = ws.m_modified_fees;
     const CAmount& nConflictingFees = ws.m_conflicting_fees;
     const size_t& nConflictingSize = ws.m_conflicting_size;
@@ -1015,15 +1076,14 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && m_pool.HasNoInputsOf(tx);
 
     // Store transaction in memory
-    m_pool.addUnchecked(*entry, setAncestors, validForFeeEstimation);
+    m_pool.addUnchecked(*entry, ancestors, validForFeeEstimation);
+}
 
-    // trim mempool and check if tx was trimmed
-    if (!bypass_limits) {
+void MemPoolAccept::LimitSize(const ATMPArgs& args)
+{
+    if (!args.m_bypass_limits) {
         LimitMempoolSize(m_pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
-        if (!m_pool.exists(hash))
-            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
     }
-    return true;
 }
 
 bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args)
@@ -1031,10 +1091,14 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     AssertLockHeld(cs_main);
     LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
 
+    int64_t nTimeStart = GetTimeMicros();
+
     Workspace workspace(ptx);
 
     if (!PreChecks(args, workspace)) return false;
 
+    int64_t nTime1 = GetTimeMicros();
+
     // Only compute the precomputed transaction data if we need to verify
     // scripts (ie, other policy checks pass). We perform the inexpensive
     // checks first and avoid hashing and signature verification unless those
@@ -1045,16 +1109,140 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
     if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
 
+    int64_t nTime2 = GetTimeMicros();
+
     // Tx was accepted, but not added
     if (args.m_test_accept) return true;
 
-    if (!Finalize(args, workspace)) return false;
+    Finalize(args, workspace);
+
+    // trim mempool and check if tx was trimmed
+    LimitSize(args);
+    if (!m_pool.exists(workspace.m_hash)) {
+        return args.m_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+    }
+
+    int64_t nTime3 = GetTimeMicros(); nTimeAcceptTx += nTime3 - nTimeStart;
+    ++nTxAccepted;
+    LogPrint(BCLog::BENCH, "- Accept tx %s: %.2fms (prechecks %.2fms, %u txins %.2fms, finalize %.2fms) [%.2fs (%.2fms/tx)]\n",
+        workspace.m_hash.ToString(), MILLI * (nTime3 - nTimeStart), MILLI * (nTime1 - nTimeStart), (unsigned)ptx->vin.size(), MILLI * (nTime2 - nTime1),
+        MILLI * (nTime3 - nTime2), nTimeAcceptTx * MICRO, nTimeAcceptTx * MILLI / nTxAccepted);
 
     GetMainSignals().TransactionAddedToMempool(ptx);
 
     return true;
 }
 
+bool MemPoolAccept::AcceptPackageRound(const std::vector<CTransactionRef>& txns, std::vector<ATMPArgs>& args, std::vector<size_t>& pending, size_t& accepted)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(m_pool.cs);
+
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Transactions not yet accepted or rejected, whose children have to wait
+    std::set<uint256> pending_txids;
+    for (size_t idx : pending) pending_txids.insert(txns[idx]->GetHash());
+
+    std::vector<size_t> round;
+    std::vector<Workspace> workspaces;
+    workspaces.reserve(pending.size());
+    std::set<COutPoint> round_spent;
+    std::vector<size_t> deferred;
+    for (size_t k = 0; k < pending.size(); ++k) {
+        const size_t idx = pending[k];
+        const CTransaction& tx = *txns[idx];
+        const bool wait = std::any_of(tx.vin.begin(), tx.vin.end(), [&](const CTxIn& txin) {
+            return pending_txids.count(txin.prevout.hash) || round_spent.count(txin.prevout);
+        });
+        if (wait) {
+            deferred.push_back(idx);
+            continue;
+        }
+
+        // PreChecks raises the descendant limits of a replacement, which
+        // must not carry over to the other transactions.
+        const size_t limit_descendants = m_limit_descendants;
+        const size_t limit_descendant_size = m_limit_descendant_size;
+        Workspace ws(txns[idx]);
+        const bool ok = PreChecks(args[idx], ws);
+        m_limit_descendants = limit_descendants;
+        m_limit_descendant_size = limit_descendant_size;
+        if (!ok) {
+            pending_txids.erase(ws.m_hash);
+            continue;
+        }
+
+        if (!ws.m_conflicts.empty()) {
+            // Removing the conflicts could remove ancestors of the other
+            // transactions of the round, so a replacement goes alone.
+            if (round.empty()) {
+                round.push_back(idx);
+                workspaces.push_back(std::move(ws));
+            } else {
+                deferred.push_back(idx);
+            }
+            deferred.insert(deferred.end(), pending.begin() + k + 1, pending.end());
+            break;
+        }
+
+        for (const CTxIn& txin : tx.vin) round_spent.insert(txin.prevout);
+        round.push_back(idx);
+        workspaces.push_back(std::move(ws));
+    }
+    pending.swap(deferred);
+
+    int64_t nTime1 = GetTimeMicros();
+
+    // Check the scripts of the whole round on the script check threads. The
+    // queue only reports whether all checks passed, so after a failure each
+    // transaction is checked again to find the invalid ones.
+    std::vector<PrecomputedTransactionData> txsdata(round.size());
+    bool round_scripts_ok = false;
+    if (g_parallel_script_checks && !round.empty()) {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        round_scripts_ok = true;
+        for (size_t i = 0; i < round.size() && round_scripts_ok; ++i) {
+            std::vector<CScriptCheck> checks;
+            round_scripts_ok = CheckInputScripts(*txns[round[i]], args[round[i]].m_state, m_view, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txsdata[i], &checks);
+            control.Add(checks);
+        }
+        round_scripts_ok = control.Wait() && round_scripts_ok;
+    }
+
+    const size_t pool_size = m_pool.size();
+    std::vector<size_t> added;
+    for (size_t i = 0; i < round.size(); ++i) {
+        ATMPArgs& tx_args = args[round[i]];
+        Workspace& ws = workspaces[i];
+        if (!round_scripts_ok && !PolicyScriptChecks(tx_args, ws, txsdata[i])) continue;
+        if (!ConsensusScriptChecks(tx_args, ws, txsdata[i])) continue;
+        // The transactions added so far may share ancestors with this one.
+        if (!added.empty() && !CheckPackageLimits(*ws.m_entry, ws.m_ancestors, tx_args.m_state)) continue;
+        Finalize(tx_args, ws);
+        added.push_back(i);
+    }
+
+    // Trim the mempool once for the round
+    const bool removed = m_pool.size() < pool_size + added.size();
+    if (!round.empty()) LimitSize(args[round.front()]);
+    const bool trimmed = m_pool.size() < pool_size + added.size();
+    for (size_t i : added) {
+        if (!m_pool.exists(workspaces[i].m_hash)) {
+            args[round[i]].m_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+            continue;
+        }
+        GetMainSignals().TransactionAddedToMempool(txns[round[i]]);
+        ++accepted;
+    }
+
+    int64_t nTime2 = GetTimeMicros();
+    LogPrint(BCLog::BENCH, "- Accept package round: %u txs, %u added, %u deferred: %.2fms (prechecks %.2fms, scripts and finalize %.2fms)\n",
+        (unsigned)round.size(), (unsigned)added.size(), (unsigned)pending.size(), MILLI * (nTime2 - nTimeStart), MILLI * (nTime1 - nTimeStart), MILLI * (nTime2 - nTime1));
+
+    return !removed && !trimmed;
+}
+
 } // anon namespace
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
@@ -1080,6 +1268,44 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
     return res;
 }
 
+/** (try to) add transactions to memory pool, in order, each with a specified acceptance time **/
+static size_t AcceptPackageToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, const std::vector<CTransactionRef>& txns,
+                        const std::vector<int64_t>& accept_times, std::vector<TxValidationState>& states,
+                        std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    assert(accept_times.size() == txns.size());
+    states.assign(txns.size(), TxValidationState());
+    std::vector<std::vector<COutPoint>> coins_to_uncache(txns.size());
+    std::vector<MemPoolAccept::ATMPArgs> args;
+    args.reserve(txns.size());
+    for (size_t i = 0; i < txns.size(); ++i) {
+        args.push_back(MemPoolAccept::ATMPArgs{chainparams, states[i], accept_times[i], plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache[i], false /* test_accept */});
+    }
+
+    std::vector<size_t> pending(txns.size());
+    std::iota(pending.begin(), pending.end(), 0);
+    size_t accepted = 0;
+    {
+        LOCK(pool.cs);
+        while (!pending.empty()) {
+            // Share the coins view between rounds until it may have gone stale
+            MemPoolAccept accept(pool);
+            while (!pending.empty() && accept.AcceptPackageRound(txns, args, pending, accepted)) {}
+        }
+    }
+
+    // As in AcceptToMemoryPoolWithTime, uncache the coins that rejected
+    // transactions pulled into the coins cache.
+    for (size_t i = 0; i < txns.size(); ++i) {
+        if (states[i].IsValid()) continue;
+        for (const COutPoint& hashTx : coins_to_uncache[i])
+            ::ChainstateActive().CoinsTip().Uncache(hashTx);
+    }
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    return accepted;
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept)
@@ -1088,6 +1314,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+size_t AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txns, std::vector<TxValidationState>& states,
+                        std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee)
+{
+    const CChainParams& chainparams = Params();
+    return AcceptPackageToMemoryPoolWithTime(chainparams, pool, txns, std::vector<int64_t>(txns.size(), GetTime()), states, plTxnReplaced, bypass_limits, nAbsurdFee);
+}
+
 CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMemPool* const mempool, const uint256& hash, const Consensus::Params& consensusParams, uint256& hashBlock)
 {
     LOCK(cs_main);
@@ -1120,7 +1353,38 @@ CTransactionRef GetTransaction(const CBlockIndex* const block_index, const CTxMe
 // CBlock and CBlockIndex
 //
 
-static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
+/**
+ * Serialize obj and compress it into the data of a compressed blk or rev file
+ * record. Records that do not get smaller, like the undo data of blocks
+ * without spends, are stored uncompressed in any file, so this fails for them.
+ */
+template <typename T>
+static bool CompressRecord(const T& obj, std::vector<uint8_t>& compressed)
+{
+    std::vector<uint8_t> data;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0, obj);
+    compressed = LZCompress(data);
+    if (compressed.size() < data.size()) return true;
+    compressed.clear();
+    return false;
+}
+
+/** Read the data of a compressed record with header size field size from file, and decompress it into data. */
+static void ReadCompressedRecord(CAutoFile& file, unsigned int size, size_t max_size, std::vector<uint8_t>& data)
+{
+    size &= ~BLOCK_RECORD_COMPRESSED;
+    if (size > MAX_SIZE) {
+        throw std::ios_base::failure("Compressed record larger than maximum deserialization size");
+    }
+    std::vector<uint8_t> compressed(size);
+    file.read((char*)compressed.data(), size);
+    if (!LZDecompress(compressed, data, max_size)) {
+        throw std::ios_base::failure("Corrupt compressed record");
+    }
+}
+
+/** Write block, whose record data is compressed if compressed is non-null, at the end of the blk file of pos, and set pos to its data. */
+static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart, const std::vector<uint8_t>* compressed)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1128,7 +1392,7 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
+    unsigned int nSize = compressed ? compressed->size() | BLOCK_RECORD_COMPRESSED : GetSerializeSize(block, fileout.GetVersion());
     fileout << messageStart << nSize;
 
     // Write block
@@ -1136,7 +1400,11 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    if (compressed) {
+        fileout.write((const char*)compressed->data(), compressed->size());
+    } else {
+        fileout << block;
+    }
 
     return true;
 }
@@ -1145,14 +1413,25 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, at the index header
+    FlatFilePos hpos = pos;
+    hpos.nPos -= 8;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
     // Read block
     try {
-        filein >> block;
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+        filein >> blk_start >> blk_size;
+        if (blk_size & BLOCK_RECORD_COMPRESSED) {
+            std::vector<uint8_t> data;
+            ReadCompressedRecord(filein, blk_size, MAX_BLOCK_SERIALIZED_SIZE, data);
+            VectorReader(SER_DISK, CLIENT_VERSION, data, 0) >> block;
+        } else {
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1202,6 +1481,11 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, c
                     HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
         }
 
+        if (blk_size & BLOCK_RECORD_COMPRESSED) {
+            ReadCompressedRecord(filein, blk_size, MAX_BLOCK_SERIALIZED_SIZE, block);
+            return true;
+        }
+
         if (blk_size > MAX_SIZE) {
             return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
                     blk_size, MAX_SIZE);
@@ -1227,6 +1511,120 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+namespace {
+/** Maximum number of blk files kept mapped for MapRawBlockFromDisk. Address space is scarce on 32-bit systems. */
+const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void*) >= 8 ? 64 : 4;
+
+struct MappedBlockFile {
+    std::shared_ptr<const MappedFile> mapping;
+    uint64_t last_used;
+};
+
+Mutex g_mapped_block_files_mutex;
+/** Mappings of recently served blk files, by path. Mappings stay alive while messages or replies refer to them. */
+std::map<fs::path, MappedBlockFile> g_mapped_block_files GUARDED_BY(g_mapped_block_files_mutex);
+uint64_t g_mapped_block_files_uses GUARDED_BY(g_mapped_block_files_mutex){0};
+} // namespace
+
+/** Get a mapping of the blk file at path that extends to at least end, remapping it if the file grew. Returns nullptr on failure. */
+static std::shared_ptr<const MappedFile> GetMappedBlockFile(const fs::path& path, size_t end)
+{
+    LOCK(g_mapped_block_files_mutex);
+    auto it = g_mapped_block_files.find(path);
+    if (it == g_mapped_block_files.end() || it->second.mapping->Data().size() < end) {
+        auto mapping = std::make_shared<const MappedFile>(path);
+        if (mapping->IsNull() || mapping->Data().size() < end) return nullptr;
+        if (it == g_mapped_block_files.end()) {
+            if (g_mapped_block_files.size() >= MAX_MAPPED_BLOCK_FILES) {
+                g_mapped_block_files.erase(std::min_element(g_mapped_block_files.begin(), g_mapped_block_files.end(),
+                    [](const std::pair<const fs::path, MappedBlockFile>& a, const std::pair<const fs::path, MappedBlockFile>& b) {
+                        return a.second.last_used < b.second.last_used;
+                    }));
+            }
+            it = g_mapped_block_files.emplace(path, MappedBlockFile{}).first;
+        }
+        it->second.mapping = std::move(mapping);
+    }
+    it->second.last_used = ++g_mapped_block_files_uses;
+    return it->second.mapping;
+}
+
+/** Stop caching the mapping of the blk file at path, after it was deleted or replaced. */
+static void ForgetMappedBlockFile(const fs::path& path)
+{
+    LOCK(g_mapped_block_files_mutex);
+    g_mapped_block_files.erase(path);
+}
+
+bool MapRawBlockFromDisk(Span<const uint8_t>& block, std::shared_ptr<const void>& owner, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    if (pos.nPos >= 8) {
+        const fs::path path = BlockFileSeq().FileName(pos);
+        std::shared_ptr<const MappedFile> mapping = GetMappedBlockFile(path, pos.nPos);
+        if (mapping) {
+            const uint8_t* header = mapping->Data().data() + pos.nPos - 8;
+            if (memcmp(header, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+                return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                        HexStr(header, header + CMessageHeader::MESSAGE_START_SIZE),
+                        HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
+            }
+            const uint32_t blk_size = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+            if (blk_size > MAX_SIZE && !(blk_size & BLOCK_RECORD_COMPRESSED)) {
+                return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
+                        blk_size, MAX_SIZE);
+            }
+            // Compressed records are decompressed into a copy below.
+            if (!(blk_size & BLOCK_RECORD_COMPRESSED)) {
+                if (mapping->Data().size() - pos.nPos < blk_size) {
+                    mapping = GetMappedBlockFile(path, size_t{pos.nPos} + blk_size);
+                }
+                if (mapping) {
+                    block = mapping->Data().subspan(pos.nPos, blk_size);
+                    owner = std::move(mapping);
+                    return true;
+                }
+            }
+        }
+    }
+
+    auto copy = std::make_shared<std::vector<uint8_t>>();
+    if (!ReadRawBlockFromDisk(*copy, pos, message_start)) return false;
+    block = *copy;
+    owner = std::move(copy);
+    return true;
+}
+
+bool MapRawBlockFromDisk(Span<const uint8_t>& block, std::shared_ptr<const void>& owner, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    FlatFilePos block_pos;
+    {
+        LOCK(cs_main);
+        block_pos = pindex->GetBlockPos();
+    }
+
+    return MapRawBlockFromDisk(block, owner, block_pos, message_start);
+}
+
+/** Read the size of the data of the blk file record at pos, and whether it is compressed. */
+static bool ReadBlockRecordHeader(const FlatFilePos& pos, unsigned int& size, bool& compressed)
+{
+    FlatFilePos hpos = pos;
+    hpos.nPos -= 8;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    }
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        filein >> blk_start >> size;
+    } catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+    compressed = size & BLOCK_RECORD_COMPRESSED;
+    size &= ~BLOCK_RECORD_COMPRESSED;
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1455,6 +1853,7 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    txdata->InitOnce(*ptxTo);
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
@@ -1468,17 +1867,24 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 }
 
 
-static CuckooCache::cache<uint256, SignatureCacheHasher> g_scriptExecutionCache;
+static ShardedSignatureCache g_scriptExecutionCache;
+static uint256 g_scriptExecutionCacheNonce;
 static CSHA256 g_scriptExecutionCacheHasher;
 
-void InitScriptExecutionCache() {
-    // Setup the salted hasher
-    uint256 nonce = GetRandHash();
+static void SetScriptExecutionCacheNonce(const uint256& nonce)
+{
+    g_scriptExecutionCacheNonce = nonce;
+    g_scriptExecutionCacheHasher.Reset();
     // We want the nonce to be 64 bytes long to force the hasher to process
     // this chunk, which makes later hash computations more efficient. We
     // just write our 32-byte entropy twice to fill the 64 bytes.
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
+}
+
+void InitScriptExecutionCache() {
+    // Setup the salted hasher
+    SetScriptExecutionCacheNonce(GetRandHash());
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
@@ -1487,6 +1893,11 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+std::vector<SignatureCacheShardStats> GetScriptExecutionCacheStats()
+{
+    return g_scriptExecutionCache.GetStats();
+}
+
 /**
  * Check whether all of this transaction's input scripts succeed.
  *
@@ -1522,12 +1933,13 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
     uint256 hashCacheEntry;
     CSHA256 hasher = g_scriptExecutionCacheHasher;
     hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
-    AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
     if (g_scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
     }
 
-    if (!txdata.m_ready) {
+    // Checks that are returned rather than run initialize txdata themselves,
+    // so that script check threads compute it rather than the caller.
+    if (!pvChecks && !txdata.m_ready) {
         txdata.Init(tx);
     }
 
@@ -1584,29 +1996,39 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
     return true;
 }
 
-static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+/** Write the rev file record of blockundo, whose data is compressed if compressed is non-null, to fileout. */
+static void WriteUndoRecord(CAutoFile& fileout, const CBlockUndo& blockundo, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart, const std::vector<uint8_t>* compressed)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
     // Write index header
-    unsigned int nSize = GetSerializeSize(blockundo, fileout.GetVersion());
+    unsigned int nSize = compressed ? compressed->size() | BLOCK_RECORD_COMPRESSED : GetSerializeSize(blockundo, fileout.GetVersion());
     fileout << messageStart << nSize;
 
     // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    if (compressed) {
+        fileout.write((const char*)compressed->data(), compressed->size());
+    } else {
+        fileout << blockundo;
+    }
 
-    // calculate & write checksum
+    // calculate & write checksum, which is over the uncompressed data
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
     fileout << hasher.GetHash();
+}
+
+static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart, const std::vector<uint8_t>* compressed)
+{
+    // Open history file to append
+    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+
+    long fileOutPos = ftell(fileout.Get());
+    if (fileOutPos < 0)
+        return error("%s: ftell failed", __func__);
+    pos.nPos = (unsigned int)fileOutPos + 8;
+    WriteUndoRecord(fileout, blockundo, hashBlock, messageStart, compressed);
 
     return true;
 }
@@ -1618,7 +2040,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
+    // Open history file to read, at the index header
+    pos.nPos -= 8;
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
@@ -1627,8 +2050,18 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
     uint256 hashChecksum;
     CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
+        CMessageHeader::MessageStartChars undo_start;
+        unsigned int undo_size;
+        filein >> undo_start >> undo_size;
         verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
+        if (undo_size & BLOCK_RECORD_COMPRESSED) {
+            std::vector<uint8_t> data;
+            ReadCompressedRecord(filein, undo_size, MAX_SIZE, data);
+            verifier.write((const char*)data.data(), data.size());
+            CDataStream(data, SER_DISK, CLIENT_VERSION) >> blockundo;
+        } else {
+            verifier >> blockundo;
+        }
         filein >> hashChecksum;
     }
     catch (const std::exception& e) {
@@ -1781,10 +2214,15 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationSt
 {
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
+        // Undo data is stored in the format of the block file of the block
+        std::vector<uint8_t> compressed;
+        const bool compress = WITH_LOCK(cs_LastBlockFile, return vinfoBlockFile[pindex->nFile].nFlags & BLOCK_FILE_COMPRESSED) &&
+                              CompressRecord(blockundo, compressed);
+        const size_t undo_size = compress ? compressed.size() : ::GetSerializeSize(blockundo, CLIENT_VERSION);
         FlatFilePos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, CLIENT_VERSION) + 40))
+        if (!FindUndoPos(state, pindex->nFile, _pos, undo_size + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart(), compress ? &compressed : nullptr))
             return AbortNode(state, "Failed to write undo data");
         // rev files are written in block height order, whereas blk files are written as blocks come in (often out of order)
         // we want to flush the rev (undo) file once we've written the last block, which is indicated by the last height
@@ -1804,13 +2242,59 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationSt
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck(int worker_num) {
     util::ThreadRename(strprintf("scriptch.%i", worker_num));
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CCoinsFetch> coinsfetchqueue(16);
+
+void ThreadCoinsFetch(int worker_num) {
+    util::ThreadRename(strprintf("coinsfetch.%i", worker_num));
+    coinsfetchqueue.Thread();
+}
+
+/**
+ * Load the coins spent by a block into the chainstate's coins cache with
+ * concurrent lookups, so ConnectBlock does not stall on one database read
+ * after another. Inputs spending outputs created within the block itself
+ * are skipped, as they cannot be in the database.
+ */
+static void PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& view)
+{
+    std::set<uint256> block_txids;
+    size_t n_inputs = 0;
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+        n_inputs += tx->vin.size();
+    }
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(n_inputs);
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!block_txids.count(txin.prevout.hash)) outpoints.push_back(txin.prevout);
+        }
+    }
+    int64_t nTimeStart = GetTimeMicros();
+    size_t n_fetched = view.PrefetchCoins(outpoints, &coinsfetchqueue);
+    LogPrint(BCLog::BENCH, "    - Prefetch %u inputs: %u fetched, %.2fms\n", (unsigned)outpoints.size(), (unsigned)n_fetched, (GetTimeMicros() - nTimeStart) * MILLI);
+}
+
+static CBlockPrefetcher blockprefetcher(MAX_PREFETCH_BLOCKS, [](CBlock& block, const FlatFilePos& pos, const Consensus::Params& params) {
+    return ReadBlockFromDisk(block, pos, params);
+});
+
+void ThreadBlockPrefetch(int worker_num) {
+    util::ThreadRename(strprintf("blkprefetch.%i", worker_num));
+    blockprefetcher.Thread();
+}
+
+int CChainState::BlockPrefetchDepth()
+{
+    return g_chainman.IsBackgroundIBD(this) ? 0 : g_block_prefetch_depth;
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2111,7 +2595,8 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     // until after `control` has run the script checks (potentially
     // in multiple threads). Preallocate the vector size so a new allocation
     // doesn't invalidate pointers into the vector, and keep txsdata in scope
-    // for as long as `control`.
+    // for as long as `control`. The data itself is computed by the first
+    // script check of each transaction that runs.
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && g_parallel_script_checks ? &scriptcheckqueue : nullptr);
     std::vector<PrecomputedTransactionData> txsdata(block.vtx.size());
 
@@ -2373,13 +2858,26 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Disk space is too low!"));
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
-                return AbortNode(state, "Failed to write to coin database");
+            if (mode == FlushStateMode::ALWAYS) {
+                // Empty the cache, as callers resizing it or shutting down expect.
+                if (!CoinsTip().Flush())
+                    return AbortNode(state, "Failed to write to coin database");
+            } else {
+                // Keep the cache warm: write the modified coins, and only evict
+                // unmodified ones if the cache has run out of space.
+                if (!CoinsTip().Sync())
+                    return AbortNode(state, "Failed to write to coin database");
+                if (cache_state >= CoinsCacheSizeState::LARGE) {
+                    const size_t evicted = CoinsTip().Trim(m_coinstip_cache_size_bytes * COINS_CACHE_TRIM_PERCENT / 100);
+                    LogPrint(BCLog::COINDB, "Evicted %u coins from the cache, %u remain (%.2f MiB)\n",
+                        evicted, CoinsTip().GetCacheSize(), CoinsTip().DynamicMemoryUsage() * (1.0 / 1048576.0));
+                }
+            }
             nLastFlush = nNow;
             full_flush_completed = true;
         }
     }
-    if (full_flush_completed) {
+    if (full_flush_completed && !g_chainman.IsBackgroundIBD(this)) {
         // Update best block in wallet (so we can detect restored wallets).
         GetMainSignals().ChainStateFlushed(m_chain.GetLocator());
     }
@@ -2589,10 +3087,15 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
-            return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
+        if (BlockPrefetchDepth() > 0) {
+            pthisBlock = blockprefetcher.Take(pindexNew);
+        }
+        if (!pthisBlock) {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            pthisBlock = pblockNew;
+        }
     } else {
         pthisBlock = pblock;
     }
@@ -2602,6 +3105,9 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
+        if (g_parallel_coins_fetch) {
+            PrefetchBlockInputs(blockConnecting, CoinsTip());
+        }
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
         GetMainSignals().BlockChecked(blockConnecting, state);
@@ -2623,12 +3129,22 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
-    // Remove conflicting transactions from the mempool.;
-    mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
-    disconnectpool.removeForBlock(blockConnecting.vtx);
-    // Update m_chain & related variables.
-    m_chain.SetTip(pindexNew);
-    UpdateTip(pindexNew, chainparams);
+    if (g_chainman.IsBackgroundIBD(this)) {
+        // The block is already part of the active chain: the mempool and the
+        // best block are none of our business.
+        m_chain.SetTip(pindexNew);
+        if (pindexNew->nHeight % BACKGROUND_VALIDATION_LOG_INTERVAL == 0) {
+            LogPrintf("[background validation] new best=%s height=%d\n",
+                pindexNew->GetBlockHash().ToString(), pindexNew->nHeight);
+        }
+    } else {
+        // Remove conflicting transactions from the mempool.;
+        mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+        disconnectpool.removeForBlock(blockConnecting.vtx);
+        // Update m_chain & related variables.
+        m_chain.SetTip(pindexNew);
+        UpdateTip(pindexNew, chainparams);
+    }
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
@@ -2740,6 +3256,25 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         fBlocksDisconnected = true;
     }
 
+    // Let the block prefetch threads read the blocks we are about to connect
+    // from disk while we validate the ones before them.
+    const int prefetch_depth = BlockPrefetchDepth();
+    if (prefetch_depth > 0) {
+        int nFirstHeight = pindexFork ? pindexFork->nHeight + 1 : 0;
+        int nLastHeight = std::min(nFirstHeight + prefetch_depth - 1, pindexMostWork->nHeight);
+        std::vector<const CBlockIndex*> vpindexToPrefetch;
+        if (nLastHeight >= nFirstHeight) {
+            vpindexToPrefetch.reserve(nLastHeight - nFirstHeight + 1);
+            for (const CBlockIndex* pindexIter = pindexMostWork->GetAncestor(nLastHeight); pindexIter && pindexIter->nHeight >= nFirstHeight; pindexIter = pindexIter->pprev) {
+                // The block for pindexMostWork may already have been passed in.
+                if (pindexIter == pindexMostWork && pblock) continue;
+                vpindexToPrefetch.push_back(pindexIter);
+            }
+            std::reverse(vpindexToPrefetch.begin(), vpindexToPrefetch.end());
+        }
+        blockprefetcher.Prefetch(vpindexToPrefetch, chainparams.GetConsensus());
+    }
+
     // Build list of new blocks to connect.
     std::vector<CBlockIndex*> vpindexToConnect;
     bool fContinue = true;
@@ -2792,7 +3327,9 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         // any disconnected transactions back to the mempool.
         UpdateMempoolForReorg(disconnectpool, true);
     }
-    mempool.check(&CoinsTip());
+    if (!g_chainman.IsBackgroundIBD(this)) {
+        mempool.check(&CoinsTip());
+    }
 
     // Callbacks/notifications for a new best chain.
     if (fInvalidFound)
@@ -2867,6 +3404,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
         {
             LOCK2(cs_main, ::mempool.cs); // Lock transaction pool for at least as long as it takes for connectTrace to be consumed
+            const bool background = g_chainman.IsBackgroundIBD(this);
             CBlockIndex* starting_tip = m_chain.Tip();
             bool blocks_connected = false;
             do {
@@ -2897,9 +3435,13 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
                 }
                 pindexNewTip = m_chain.Tip();
 
-                for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
-                    assert(trace.pblock && trace.pindex);
-                    GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                // Listeners have already seen the blocks connected in the
+                // background, on top of the snapshot base.
+                if (!background) {
+                    for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
+                        assert(trace.pblock && trace.pindex);
+                        GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                    }
                 }
             } while (!m_chain.Tip() || (starting_tip && CBlockIndexWorkComparator()(m_chain.Tip(), starting_tip)));
             if (!blocks_connected) return true;
@@ -2909,7 +3451,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
             // Notify external listeners about the new tip.
             // Enqueue while holding cs_main to ensure that UpdatedBlockTip is called in the order in which blocks are connected
-            if (pindexFork != pindexNewTip) {
+            if (pindexFork != pindexNewTip && !background) {
                 // Notify ValidationInterface subscribers
                 GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
@@ -3151,24 +3693,21 @@ void ResetBlockFailureFlags(CBlockIndex *pindex) {
     return ::ChainstateActive().ResetBlockFailureFlags(pindex);
 }
 
-CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     AssertLockHeld(cs_main);
 
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = m_block_index.find(hash);
     if (it != m_block_index.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = m_block_index.try_emplace(hash, block).first->second;
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = m_block_index.find(block.hashPrevBlock);
     if (miPrev != m_block_index.end())
     {
@@ -3191,7 +3730,11 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
 void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
     pindexNew->nTx = block.vtx.size();
-    pindexNew->nChainTx = 0;
+    // The base block of a snapshot chainstate keeps the nChainTx it was given
+    // from the assumeutxo data until all of its ancestors have been received.
+    if (!pindexNew->HaveTxsDownloaded() || pindexNew != g_chainman.SnapshotBase()) {
+        pindexNew->nChainTx = 0;
+    }
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
@@ -3219,6 +3762,7 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
             if (m_chain.Tip() == nullptr || !setBlockIndexCandidates.value_comp()(pindex, m_chain.Tip())) {
                 setBlockIndexCandidates.insert(pindex);
             }
+            g_chainman.AddBackgroundValidationCandidate(pindex);
             std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = m_blockman.m_blocks_unlinked.equal_range(pindex);
             while (range.first != range.second) {
                 std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first;
@@ -3234,7 +3778,8 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
     }
 }
 
-static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool fKnown = false)
+/** Find the position for a block record of nAddSize bytes. New blocks are only appended to files of the format selected by compressed_file. */
+static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize, unsigned int nHeight, uint64_t nTime, bool compressed_file, bool fKnown = false)
 {
     LOCK(cs_LastBlockFile);
 
@@ -3243,9 +3788,11 @@ static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize, unsigned int n
         vinfoBlockFile.resize(nFile + 1);
     }
 
+    const uint32_t file_flags = compressed_file ? uint32_t{BLOCK_FILE_COMPRESSED} : 0;
     bool finalize_undo = false;
     if (!fKnown) {
-        while (vinfoBlockFile[nFile].nSize + nAddSize >= MAX_BLOCKFILE_SIZE) {
+        while (vinfoBlockFile[nFile].nSize + nAddSize >= MAX_BLOCKFILE_SIZE ||
+               (vinfoBlockFile[nFile].nSize != 0 && vinfoBlockFile[nFile].nFlags != file_flags)) {
             // when the undo file is keeping up with the block file, we want to flush it explicitly
             // when it is lagging behind (more blocks arrive than are being connected), we let the
             // undo block write case handle it
@@ -3267,6 +3814,13 @@ static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize, unsigned int n
         nLastBlockFile = nFile;
     }
 
+    // New files get the format of their first block. Known blocks found
+    // while reindexing are only stored compressed in compressed files.
+    if (vinfoBlockFile[nFile].nBlocks == 0) {
+        vinfoBlockFile[nFile].nFlags = file_flags;
+    } else if (fKnown) {
+        vinfoBlockFile[nFile].nFlags |= file_flags;
+    }
     vinfoBlockFile[nFile].AddBlock(nHeight, nTime);
     if (fKnown)
         vinfoBlockFile[nFile].nSize = std::max(pos.nPos + nAddSize, vinfoBlockFile[nFile].nSize);
@@ -3310,10 +3864,10 @@ static bool FindUndoPos(BlockValidationState &state, int nFile, FlatFilePos &pos
     return true;
 }
 
-static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+static bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckProofOfWork(hash, block.nBits, consensusParams))
         return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
 
     return true;
@@ -3328,7 +3882,7 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
-    if (!CheckBlockHeader(block, state, consensusParams, fCheckPOW))
+    if (fCheckPOW && !CheckBlockHeader(block, block.GetHash(), state, consensusParams))
         return false;
 
     // Check the merkle root.
@@ -3609,11 +4163,10 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = m_block_index.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3629,7 +4182,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus())) {
+        if (!CheckBlockHeader(block, hash, state, chainparams.GetConsensus())) {
             LogPrint(BCLog::VALIDATION, "%s: Consensus::CheckBlockHeader: %s, %s\n", __func__, hash.ToString(), state.ToString());
             return false;
         }
@@ -3689,7 +4242,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
         }
     }
     if (pindex == nullptr)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3699,14 +4252,21 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
 
 // Exposed wrapper for AcceptBlockHeader
 bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
+{
+    // Hash all headers before taking cs_main
+    return ProcessNewBlockHeaders(headers, GetBlockHeaderHashes(headers), state, chainparams, ppindex);
+}
+
+bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, const std::vector<uint256>& hashes, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
     AssertLockNotHeld(cs_main);
+    assert(hashes.size() == headers.size());
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); ++i) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
             bool accepted = m_blockman.AcceptBlockHeader(
-                header, state, chainparams, &pindex);
+                headers[i], hashes[i], state, chainparams, &pindex);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
@@ -3727,16 +4287,28 @@ bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>&
 
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
 static FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, const CChainParams& chainparams, const FlatFilePos* dbp) {
-    unsigned int nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
+    unsigned int nBlockSize;
+    bool compress = g_compress_blocks;
+    std::vector<uint8_t> compressed;
     FlatFilePos blockPos;
-    if (dbp != nullptr)
+    if (dbp != nullptr) {
         blockPos = *dbp;
-    if (!FindBlockPos(blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), dbp != nullptr)) {
+        // Account for the record as it is stored already
+        if (!ReadBlockRecordHeader(blockPos, nBlockSize, compress)) {
+            error("%s: ReadBlockRecordHeader failed", __func__);
+            return FlatFilePos();
+        }
+    } else if (compress && CompressRecord(block, compressed)) {
+        nBlockSize = compressed.size();
+    } else {
+        nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
+    }
+    if (!FindBlockPos(blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), compress, dbp != nullptr)) {
         error("%s: FindBlockPos failed", __func__);
         return FlatFilePos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart())) {
+        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart(), compressed.empty() ? nullptr : &compressed)) {
             AbortNode("Failed to write block");
             return FlatFilePos();
         }
@@ -3755,7 +4327,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex);
+    bool accepted_header = m_blockman.AcceptBlockHeader(block, block.GetHash(), state, chainparams, &pindex);
     CheckBlockIndex(chainparams.GetConsensus());
 
     if (!accepted_header)
@@ -3942,6 +4514,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
+        ForgetMappedBlockFile(BlockFileSeq().FileName(pos));
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4076,47 +4649,361 @@ fs::path GetBlockPosFilename(const FlatFilePos &pos)
     return BlockFileSeq().FileName(pos);
 }
 
-CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
+/** Move the rewritten blk and rev file nFile into place, once the block tree refers to their contents (see RewriteBlockFiles). */
+static bool FinishBlockFileRewrite(int nFile)
 {
-    AssertLockHeld(cs_main);
-
+    const FlatFilePos pos(nFile, 0);
+    for (const fs::path& path : {BlockFileSeq().FileName(pos), UndoFileSeq().FileName(pos)}) {
+        const fs::path tmp = path.string() + ".tmp";
+        if (fs::exists(tmp) && !RenameOver(tmp, path)) {
+            return error("%s: Failed to rename %s", __func__, tmp.string());
+        }
+    }
+    ForgetMappedBlockFile(BlockFileSeq().FileName(pos));
+    return pblocktree->EraseBlockFileRewrite();
+}
+
+bool RewriteBlockFiles(const CChainParams& chainparams)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    const bool compress = g_compress_blocks;
+    const uint32_t file_flags = compress ? uint32_t{BLOCK_FILE_COMPRESSED} : 0;
+
+    std::vector<std::vector<CBlockIndex*>> file_blocks(vinfoBlockFile.size());
+    std::vector<std::vector<CBlockIndex*>> file_undos(vinfoBlockFile.size());
+    for (const auto& entry : g_chainman.BlockIndex()) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nFile < 0 || (size_t)pindex->nFile >= vinfoBlockFile.size()) continue;
+        if (pindex->nStatus & BLOCK_HAVE_DATA) file_blocks[pindex->nFile].push_back(pindex);
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) file_undos[pindex->nFile].push_back(pindex);
+    }
+
+    for (size_t nFile = 0; nFile < vinfoBlockFile.size(); ++nFile) {
+        if (ShutdownRequested()) return true;
+        CBlockFileInfo info = vinfoBlockFile[nFile];
+        if (info.nSize == 0 || info.nFlags == file_flags) continue;
+        LogPrintf("Rewriting block file %u: %s\n", nFile, info.ToString());
+
+        // Write the blocks and undo data in their current order to temporary
+        // files, and remember their new positions.
+        std::vector<CBlockIndex*>& blocks = file_blocks[nFile];
+        std::vector<CBlockIndex*>& undos = file_undos[nFile];
+        std::sort(blocks.begin(), blocks.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nDataPos < b->nDataPos; });
+        std::sort(undos.begin(), undos.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nUndoPos < b->nUndoPos; });
+        std::vector<unsigned int> data_pos, undo_pos;
+        const FlatFilePos file_pos(nFile, 0);
+        try {
+            CAutoFile blkout(fsbridge::fopen(BlockFileSeq().FileName(file_pos).string() + ".tmp", "wb"), SER_DISK, CLIENT_VERSION);
+            if (blkout.IsNull()) return error("%s: Failed to create temporary block file", __func__);
+            info.nSize = 0;
+            for (const CBlockIndex* pindex : blocks) {
+                std::vector<uint8_t> data;
+                if (!ReadRawBlockFromDisk(data, pindex->GetBlockPos(), chainparams.MessageStart())) {
+                    return error("%s: Failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+                }
+                unsigned int nSize = data.size();
+                if (compress) {
+                    std::vector<uint8_t> compressed = LZCompress(data);
+                    if (compressed.size() < data.size()) {
+                        data.swap(compressed);
+                        nSize = data.size() | BLOCK_RECORD_COMPRESSED;
+                    }
+                }
+                blkout << chainparams.MessageStart() << nSize;
+                blkout.write((const char*)data.data(), data.size());
+                data_pos.push_back(info.nSize + 8);
+                info.nSize += 8 + data.size();
+            }
+            if (!FileCommit(blkout.Get())) return error("%s: Failed to commit temporary block file", __func__);
+
+            CAutoFile revout(fsbridge::fopen(UndoFileSeq().FileName(file_pos).string() + ".tmp", "wb"), SER_DISK, CLIENT_VERSION);
+            if (revout.IsNull()) return error("%s: Failed to create temporary undo file", __func__);
+            info.nUndoSize = 0;
+            for (const CBlockIndex* pindex : undos) {
+                CBlockUndo blockundo;
+                if (!UndoReadFromDisk(blockundo, pindex)) {
+                    return error("%s: Failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+                }
+                std::vector<uint8_t> compressed;
+                const bool compress_undo = compress && CompressRecord(blockundo, compressed);
+                WriteUndoRecord(revout, blockundo, pindex->pprev->GetBlockHash(), chainparams.MessageStart(), compress_undo ? &compressed : nullptr);
+                undo_pos.push_back(info.nUndoSize + 8);
+                info.nUndoSize += 8 + (compress_undo ? compressed.size() : ::GetSerializeSize(blockundo, CLIENT_VERSION)) + 32;
+            }
+            if (!FileCommit(revout.Get())) return error("%s: Failed to commit temporary undo file", __func__);
+        } catch (const std::exception& e) {
+            return error("%s: Failed to write temporary block files: %s", __func__, e.what());
+        }
+        info.nFlags = file_flags;
+
+        // Commit the new positions, then move the files into place. A crash
+        // in between is completed by LoadBlockIndexDB.
+        std::set<const CBlockIndex*> changed;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            std::swap(blocks[i]->nDataPos, data_pos[i]);
+            changed.insert(blocks[i]);
+        }
+        for (size_t i = 0; i < undos.size(); ++i) {
+            std::swap(undos[i]->nUndoPos, undo_pos[i]);
+            changed.insert(undos[i]);
+        }
+        if (!pblocktree->WriteBlockFileRewrite(nFile, info, std::vector<const CBlockIndex*>(changed.begin(), changed.end()))) {
+            // Restore the positions, which still refer to the old files
+            for (size_t i = 0; i < blocks.size(); ++i) std::swap(blocks[i]->nDataPos, data_pos[i]);
+            for (size_t i = 0; i < undos.size(); ++i) std::swap(undos[i]->nUndoPos, undo_pos[i]);
+            return AbortNode("Failed to write to block index database");
+        }
+        vinfoBlockFile[nFile] = info;
+        if (!FinishBlockFileRewrite(nFile)) {
+            return AbortNode("Failed to move rewritten block files into place");
+        }
+    }
+    return true;
+}
+
+CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+
     if (hash.IsNull())
         return nullptr;
 
-    // Return existing
-    BlockMap::iterator mi = m_block_index.find(hash);
-    if (mi != m_block_index.end())
-        return (*mi).second;
+    // Return existing or create new
+    return m_block_index.try_emplace(hash).first->second;
+}
+
+namespace {
 
-    // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
+/** Name of the block index cache file, in the same directory as the block tree database. */
+static const char* const BLOCK_INDEX_CACHE_FILENAME = "index.cache";
+static const uint32_t BLOCK_INDEX_CACHE_VERSION = 1;
 
-    return pindexNew;
+fs::path BlockIndexCachePath()
+{
+    return GetDataDir() / "blocks" / BLOCK_INDEX_CACHE_FILENAME;
 }
 
-bool BlockManager::LoadBlockIndex(
+/**
+ * A block index entry as stored in the block index cache. Unlike
+ * CDiskBlockIndex, all fields have a fixed size and the block hash is stored,
+ * so that entries can be loaded without hashing their headers. The parent is
+ * referred to by its position in the cache.
+ */
+struct BlockIndexCacheEntry
+{
+    uint256 hash;
+    int32_t prev{-1};
+    int32_t nHeight{0};
+    uint32_t nStatus{0};
+    uint32_t nTx{0};
+    int32_t nFile{0};
+    uint32_t nDataPos{0};
+    uint32_t nUndoPos{0};
+    int32_t nVersion{0};
+    uint256 hashMerkleRoot;
+    uint32_t nTime{0};
+    uint32_t nBits{0};
+    uint32_t nNonce{0};
+
+    SERIALIZE_METHODS(BlockIndexCacheEntry, obj)
+    {
+        READWRITE(obj.hash, obj.prev, obj.nHeight, obj.nStatus, obj.nTx, obj.nFile, obj.nDataPos, obj.nUndoPos);
+        READWRITE(obj.nVersion, obj.hashMerkleRoot, obj.nTime, obj.nBits, obj.nNonce);
+    }
+};
+
+/** Serialized size of a BlockIndexCacheEntry. */
+static constexpr size_t BLOCK_INDEX_CACHE_ENTRY_SIZE{32 + 4 * 11 + 32};
+
+} // namespace
+
+bool BlockManager::LoadBlockIndexCache(
     const Consensus::Params& consensus_params,
     CBlockTreeDB& blocktree,
-    std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
+    std::vector<CBlockIndex*>& sorted_entries)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    AssertLockHeld(cs_main);
+    assert(m_block_index.empty());
+
+    uint256 expected_hash;
+    if (!blocktree.ReadBlockIndexCacheHash(expected_hash)) {
         return false;
+    }
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(m_block_index.size());
-    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
+    // Read the whole file at once; it is checked against the hash in the block
+    // tree database before any of it is used.
+    std::vector<unsigned char> data;
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        CAutoFile file(fsbridge::fopen(BlockIndexCachePath(), "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull() || std::fseek(file.Get(), 0, SEEK_END) != 0) {
+            LogPrintf("%s: unable to open block index cache\n", __func__);
+            return false;
+        }
+        const long size = std::ftell(file.Get());
+        if (size < 0 || std::fseek(file.Get(), 0, SEEK_SET) != 0) {
+            return false;
+        }
+        data.resize(size);
+        if (std::fread(data.data(), 1, data.size(), file.Get()) != data.size()) {
+            LogPrintf("%s: unable to read block index cache\n", __func__);
+            return false;
+        }
+    }
+    if (Hash(data.begin(), data.end()) != expected_hash) {
+        LogPrintf("%s: block index cache does not match the block tree database\n", __func__);
+        return false;
+    }
+
+    VectorReader reader(SER_DISK, CLIENT_VERSION, data, 0);
+    uint32_t version;
+    uint64_t count;
+    try {
+        reader >> version >> count;
+    } catch (const std::ios_base::failure&) {
+        return false;
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
+    if (version != BLOCK_INDEX_CACHE_VERSION || count > std::numeric_limits<int32_t>::max() ||
+        reader.size() != count * BLOCK_INDEX_CACHE_ENTRY_SIZE) {
+        LogPrintf("%s: unsupported block index cache\n", __func__);
+        return false;
+    }
+
+    m_block_index.reserve(count);
+    sorted_entries.reserve(count);
+    auto fail = [&](const char* reason) {
+        LogPrintf("%s: bad block index cache entry %d: %s\n", __func__, sorted_entries.size(), reason);
+        m_block_index.clear();
+        sorted_entries.clear();
+        return false;
+    };
+    BlockIndexCacheEntry entry;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (ShutdownRequested()) return fail("shutdown requested");
+        reader >> entry;
+        if (entry.prev < -1 || entry.prev >= (int64_t)i) return fail("parent does not precede child");
+        const auto inserted = m_block_index.try_emplace(entry.hash);
+        if (!inserted.second) return fail("duplicate entry");
+        CBlockIndex* pindex = inserted.first->second;
+        pindex->pprev = entry.prev < 0 ? nullptr : sorted_entries[entry.prev];
+        pindex->nHeight = entry.nHeight;
+        pindex->nFile = entry.nFile;
+        pindex->nDataPos = entry.nDataPos;
+        pindex->nUndoPos = entry.nUndoPos;
+        pindex->nVersion = entry.nVersion;
+        pindex->hashMerkleRoot = entry.hashMerkleRoot;
+        pindex->nTime = entry.nTime;
+        pindex->nBits = entry.nBits;
+        pindex->nNonce = entry.nNonce;
+        pindex->nStatus = entry.nStatus;
+        pindex->nTx = entry.nTx;
+
+        if (!CheckProofOfWork(pindex->GetBlockHash(), pindex->nBits, consensus_params)) {
+            return fail("CheckProofOfWork failed");
+        }
+        sorted_entries.push_back(pindex);
+    }
+
+    LogPrintf("%s: loaded %d block index entries from cache\n", __func__, count);
+    return true;
+}
+
+bool BlockManager::WriteBlockIndexCache(CBlockTreeDB& blocktree)
+{
+    AssertLockHeld(cs_main);
+    // Only a flushed, complete block index matches the block tree database.
+    if (!m_block_index_complete || !setDirtyBlockIndex.empty()) {
+        return false;
+    }
+    const int64_t start = GetTimeMicros();
+
+    std::vector<std::pair<int, const CBlockIndex*>> sorted_by_height;
+    sorted_by_height.reserve(m_block_index.size());
+    for (const auto& item : m_block_index) {
+        sorted_by_height.emplace_back(item.second->nHeight, item.second);
+    }
+    std::sort(sorted_by_height.begin(), sorted_by_height.end());
+    std::unordered_map<const CBlockIndex*, int32_t> positions;
+    positions.reserve(sorted_by_height.size());
+
+    const fs::path path = BlockIndexCachePath();
+    const fs::path temppath = path.string() + ".new";
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    try {
+        CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            throw std::runtime_error("unable to open file");
+        }
+        const uint64_t count = sorted_by_height.size();
+        file << BLOCK_INDEX_CACHE_VERSION << count;
+        hasher << BLOCK_INDEX_CACHE_VERSION << count;
+        BlockIndexCacheEntry entry;
+        for (const std::pair<int, const CBlockIndex*>& item : sorted_by_height) {
+            const CBlockIndex* pindex = item.second;
+            // Same fields as CDiskBlockIndex, so that the entries match the
+            // ones loaded from the block tree database.
+            entry.hash = pindex->GetBlockHash();
+            entry.prev = pindex->pprev ? positions.at(pindex->pprev) : -1;
+            entry.nHeight = pindex->nHeight;
+            entry.nStatus = pindex->nStatus;
+            entry.nTx = pindex->nTx;
+            entry.nFile = (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)) ? pindex->nFile : 0;
+            entry.nDataPos = (pindex->nStatus & BLOCK_HAVE_DATA) ? pindex->nDataPos : 0;
+            entry.nUndoPos = (pindex->nStatus & BLOCK_HAVE_UNDO) ? pindex->nUndoPos : 0;
+            entry.nVersion = pindex->nVersion;
+            entry.hashMerkleRoot = pindex->hashMerkleRoot;
+            entry.nTime = pindex->nTime;
+            entry.nBits = pindex->nBits;
+            entry.nNonce = pindex->nNonce;
+            file << entry;
+            hasher << entry;
+            positions.emplace(pindex, positions.size());
+        }
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        if (!RenameOver(temppath, path))
+            throw std::runtime_error("rename failed");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to write block index cache: %s\n", e.what());
+        return false;
+    }
+    if (!blocktree.WriteBlockIndexCacheHash(hasher.GetHash())) {
+        return false;
+    }
+    LogPrintf("Wrote %d block index entries to cache: %gs\n", sorted_by_height.size(), (GetTimeMicros() - start) * MICRO);
+    return true;
+}
+
+bool BlockManager::LoadBlockIndex(
+    const Consensus::Params& consensus_params,
+    CBlockTreeDB& blocktree,
+    std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates,
+    bool use_cache)
+{
+    // Entries from the cache come in height order already, saving the sort.
+    std::vector<CBlockIndex*> sorted_entries;
+    if (!use_cache || !LoadBlockIndexCache(consensus_params, blocktree, sorted_entries)) {
+        if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+            return false;
+
+        std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+        vSortedByHeight.reserve(m_block_index.size());
+        for (const auto& item : m_block_index)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+        sorted_entries.reserve(vSortedByHeight.size());
+        for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            sorted_entries.push_back(item.second);
+        }
+    }
+
+    // Calculate nChainWork
+    for (CBlockIndex* pindex : sorted_entries)
     {
         if (ShutdownRequested()) return false;
-        CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
@@ -4155,18 +5042,16 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_block_index_complete = false;
 }
 
 bool static LoadBlockIndexDB(ChainstateManager& chainman, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (!chainman.m_blockman.LoadBlockIndex(
             chainparams.GetConsensus(), *pblocktree,
-            ::ChainstateActive().setBlockIndexCandidates)) {
+            ::ChainstateActive().setBlockIndexCandidates,
+            gArgs.GetBoolArg("-blockindexcache", DEFAULT_BLOCKINDEXCACHE))) {
         return false;
     }
 
@@ -4187,10 +5072,19 @@ bool static LoadBlockIndexDB(ChainstateManager& chainman, const CChainParams& ch
         }
     }
 
+    // Complete an interrupted rewrite of the block files
+    int rewritten_file;
+    if (pblocktree->ReadBlockFileRewrite(rewritten_file)) {
+        LogPrintf("%s: completing the rewrite of block file %i\n", __func__, rewritten_file);
+        if (!FinishBlockFileRewrite(rewritten_file)) {
+            return false;
+        }
+    }
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
-    for (const std::pair<const uint256, CBlockIndex*>& item : chainman.BlockIndex()) {
+    for (const auto& item : chainman.BlockIndex()) {
         CBlockIndex* pindex = item.second;
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
             setBlkDataFiles.insert(pindex->nFile);
@@ -4395,13 +5289,13 @@ bool CChainState::ReplayBlocks(const CChainParams& params)
     if (m_blockman.m_block_index.count(hashHeads[0]) == 0) {
         return error("ReplayBlocks(): reorganization to unknown block requested");
     }
-    pindexNew = m_blockman.m_block_index[hashHeads[0]];
+    pindexNew = m_blockman.m_block_index.find(hashHeads[0])->second;
 
     if (!hashHeads[1].IsNull()) { // The old tip is allowed to be 0, indicating it's the first flush.
         if (m_blockman.m_block_index.count(hashHeads[1]) == 0) {
             return error("ReplayBlocks(): reorganization from unknown block requested");
         }
-        pindexOld = m_blockman.m_block_index[hashHeads[1]];
+        pindexOld = m_blockman.m_block_index.find(hashHeads[1])->second;
         pindexFork = LastCommonAncestor(pindexOld, pindexNew);
         assert(pindexFork != nullptr);
     }
@@ -4603,6 +5497,7 @@ void UnloadBlockIndex(CTxMemPool* mempool)
         warningcache[b].clear();
     }
     fHavePruned = false;
+    WITH_LOCK(g_mapped_block_files_mutex, g_mapped_block_files.clear());
 }
 
 bool ChainstateManager::LoadBlockIndex(const CChainParams& chainparams)
@@ -4625,6 +5520,7 @@ bool ChainstateManager::LoadBlockIndex(const CChainParams& chainparams)
 
         LogPrintf("Initializing databases...\n");
     }
+    m_blockman.SetBlockIndexComplete();
     return true;
 }
 
@@ -4644,7 +5540,7 @@ bool CChainState::LoadGenesisBlock(const CChainParams& chainparams)
         FlatFilePos blockPos = SaveBlockToDisk(block, 0, chainparams, nullptr);
         if (blockPos.IsNull())
             return error("%s: writing genesis block to disk failed", __func__);
-        CBlockIndex *pindex = m_blockman.AddToBlockIndex(block);
+        CBlockIndex *pindex = m_blockman.AddToBlockIndex(block, block.GetHash());
         ReceivedBlockTransactions(block, pindex, blockPos, chainparams.GetConsensus());
     } catch (const std::runtime_error& e) {
         return error("%s: failed to write genesis block: %s", __func__, e.what());
@@ -4658,13 +5554,29 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
-void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp)
-{
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+namespace {
+
+/** Maximum number of threads scanning block files for LoadExternalBlockFiles. */
+static constexpr int MAX_BLOCK_IMPORT_THREADS{8};
+/** A block found in an external block file. */
+struct ExternalBlock {
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+    uint256 parent_hash;
+    //! Where the block is stored, if it is in a blk file already (-reindex).
+    Optional<FlatFilePos> pos;
+    //! Memory used by the deserialized block.
+    size_t memory_usage{0};
+};
 
-    int nLoaded = 0;
+/**
+ * Find the blocks in fileIn and pass them to sink, in file order, until it
+ * returns false. Blocks are checked with CheckBlock, which AcceptBlock then
+ * skips, so the caller does not need cs_main for the expensive part of an
+ * import.
+ */
+void ScanExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, Optional<int> file_number, const std::function<bool(ExternalBlock&&)>& sink)
+{
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
@@ -4686,7 +5598,10 @@ void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
                     continue;
                 // read size
                 blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                if (nSize & BLOCK_RECORD_COMPRESSED) {
+                    if ((nSize & ~BLOCK_RECORD_COMPRESSED) > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } else if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
@@ -4695,78 +5610,32 @@ void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
             try {
                 // read block
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
-
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      BlockValidationState state;
-                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+                ExternalBlock external;
+                external.block = std::make_shared<CBlock>();
+                if (nSize & BLOCK_RECORD_COMPRESSED) {
+                    nSize &= ~BLOCK_RECORD_COMPRESSED;
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    std::vector<uint8_t> compressed(nSize);
+                    blkdat.read((char*)compressed.data(), nSize);
+                    std::vector<uint8_t> data;
+                    if (!LZDecompress(compressed, data, MAX_BLOCK_SERIALIZED_SIZE)) {
+                        throw std::ios_base::failure("Corrupt compressed block");
                     }
+                    VectorReader(SER_DISK, CLIENT_VERSION, data, 0) >> *external.block;
+                } else {
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    blkdat >> *external.block;
                 }
+                nRewind = blkdat.GetPos();
+                external.memory_usage = RecursiveDynamicUsage(external.block);
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(state, chainparams, nullptr)) {
-                        break;
-                    }
-                }
+                external.hash = external.block->GetHash();
+                external.parent_hash = external.block->hashPrevBlock;
+                if (file_number) external.pos = FlatFilePos(*file_number, nBlockPos);
+                BlockValidationState state;
+                CheckBlock(*external.block, state, chainparams.GetConsensus());
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                if (!sink(std::move(external))) return;
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
@@ -4774,7 +5643,301 @@ void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
-    LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+}
+
+/**
+ * Accepts the blocks of external block files in the order they are found.
+ *
+ * Blocks whose parent is not known yet are kept until it is. They are kept
+ * in memory up to max_unknown_parent_usage; beyond that, only their position
+ * is kept, and they are read from disk again. Out of order blocks that are
+ * not stored in a blk file and do not fit are dropped.
+ */
+class ExternalBlockImporter
+{
+public:
+    ExternalBlockImporter(const CChainParams& chainparams, size_t max_unknown_parent_usage)
+        : m_chainparams(chainparams), m_max_unknown_parent_usage(max_unknown_parent_usage) {}
+
+    //! @returns false if the rest of the file should be skipped.
+    bool Accept(ExternalBlock&& external);
+
+    int Loaded() const { return m_loaded; }
+
+private:
+    const CChainParams& m_chainparams;
+    const size_t m_max_unknown_parent_usage;
+    std::multimap<uint256, ExternalBlock> m_unknown_parent;
+    size_t m_unknown_parent_usage{0};
+    int m_loaded{0};
+
+    //! Recursively accept the earlier encountered descendants of hash.
+    void AcceptUnknownParentChildren(const uint256& hash);
+};
+
+bool ExternalBlockImporter::Accept(ExternalBlock&& external)
+{
+    const uint256 hash = external.hash;
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != m_chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(external.parent_hash)) {
+            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    external.parent_hash.ToString());
+            if (m_unknown_parent_usage + external.memory_usage <= m_max_unknown_parent_usage) {
+                m_unknown_parent_usage += external.memory_usage;
+            } else if (external.pos) {
+                external.block.reset();
+            } else {
+                return true;
+            }
+            m_unknown_parent.emplace(external.parent_hash, std::move(external));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+          BlockValidationState state;
+          if (::ChainstateActive().AcceptBlock(external.block, state, m_chainparams, nullptr, true, external.pos ? &*external.pos : nullptr, nullptr)) {
+              m_loaded++;
+          }
+          if (state.IsError()) {
+              return false;
+          }
+        } else if (hash != m_chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+          LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+        }
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == m_chainparams.GetConsensus().hashGenesisBlock) {
+        BlockValidationState state;
+        if (!ActivateBestChain(state, m_chainparams, nullptr)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    AcceptUnknownParentChildren(hash);
+    return true;
+}
+
+void ExternalBlockImporter::AcceptUnknownParentChildren(const uint256& hash)
+{
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        auto range = m_unknown_parent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, ExternalBlock>::iterator it = range.first;
+            ExternalBlock& child = it->second;
+            if (child.block) {
+                m_unknown_parent_usage -= child.memory_usage;
+            } else {
+                child.block = std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*child.block, *child.pos, m_chainparams.GetConsensus())) {
+                    child.block.reset();
+                }
+            }
+            if (child.block) {
+                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, child.hash.ToString(),
+                        head.ToString());
+                LOCK(cs_main);
+                BlockValidationState dummy;
+                if (::ChainstateActive().AcceptBlock(child.block, dummy, m_chainparams, nullptr, true, child.pos ? &*child.pos : nullptr, nullptr))
+                {
+                    m_loaded++;
+                    queue.push_back(child.hash);
+                }
+            }
+            range.first++;
+            m_unknown_parent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+}
+
+/**
+ * The blocks scanned from the files of LoadExternalBlockFiles, by file. Scan
+ * threads claim files in order and stay at most m_max_files_ahead files
+ * ahead of the importer. The buffered blocks of all files may use up to
+ * m_max_usage of memory, of which the files ahead of the one being accepted
+ * only get two thirds, so that they cannot stall it.
+ */
+class ExternalBlockFileQueue
+{
+private:
+    struct FileBlocks {
+        std::deque<ExternalBlock> blocks;
+        size_t usage{0};
+        bool done{false};
+        bool skip{false};
+    };
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<FileBlocks> m_files GUARDED_BY(m_mutex);
+    size_t m_next_file GUARDED_BY(m_mutex){0};
+    size_t m_current_file GUARDED_BY(m_mutex){0};
+    //! Memory used by the buffered blocks of all files.
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    //! Number of files being scanned.
+    size_t m_scanning GUARDED_BY(m_mutex){0};
+    const size_t m_max_files_ahead;
+    const size_t m_max_usage;
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+public:
+    ExternalBlockFileQueue(size_t num_files, size_t max_files_ahead, size_t max_usage)
+        : m_files(num_files), m_max_files_ahead(max_files_ahead), m_max_usage(max_usage) {}
+
+    //! Claim the next file to scan. @returns false if there is none.
+    bool ClaimFile(size_t& index)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&] { return m_stop || m_next_file == m_files.size() || m_next_file < m_current_file + m_max_files_ahead; });
+        if (m_stop || m_next_file == m_files.size()) return false;
+        index = m_next_file++;
+        ++m_scanning;
+        return true;
+    }
+
+    //! Add the next block of file index. @returns false if the file should no longer be scanned.
+    bool Push(size_t index, ExternalBlock&& external)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        FileBlocks& file = m_files[index];
+        m_cv.wait(lock, [&] {
+            if (m_stop || file.skip) return true;
+            // Each scan thread may overshoot by a block, so the file being
+            // accepted can always buffer one block.
+            if (index == m_current_file) return m_usage < m_max_usage || file.usage == 0;
+            return m_usage < m_max_usage / 3 * 2;
+        });
+        if (m_stop || file.skip) return false;
+        file.usage += external.memory_usage;
+        m_usage += external.memory_usage;
+        file.blocks.push_back(std::move(external));
+        m_cv.notify_all();
+        return true;
+    }
+
+    //! Mark file index as scanned. @returns how far the scan threads are ahead of the importer.
+    std::string FileDone(size_t index)
+    {
+        LOCK(m_mutex);
+        m_files[index].done = true;
+        --m_scanning;
+        m_cv.notify_all();
+        return strprintf("%u other files being scanned, %u files ahead of the import, %.1f MiB buffered",
+            m_scanning, index - std::min(index, m_current_file), m_usage / (1024.0 * 1024.0));
+    }
+
+    //! Take the next block of file index. @returns false once the file is done.
+    bool Pop(size_t index, ExternalBlock& external)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        FileBlocks& file = m_files[index];
+        m_cv.wait(lock, [&] { return m_stop || file.done || !file.blocks.empty(); });
+        if (m_stop || file.blocks.empty()) return false;
+        external = std::move(file.blocks.front());
+        file.blocks.pop_front();
+        file.usage -= external.memory_usage;
+        m_usage -= external.memory_usage;
+        m_cv.notify_all();
+        return true;
+    }
+
+    //! Drop the remaining blocks of file index, and move on to the next file.
+    void NextFile(size_t index)
+    {
+        LOCK(m_mutex);
+        m_files[index].skip = true;
+        m_files[index].blocks.clear();
+        m_usage -= m_files[index].usage;
+        m_files[index].usage = 0;
+        m_current_file = index + 1;
+        m_cv.notify_all();
+    }
+
+    void Stop()
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+        m_cv.notify_all();
+    }
+};
+
+} // namespace
+
+void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp)
+{
+    int64_t nStart = GetTimeMillis();
+    ExternalBlockImporter importer(chainparams, MIN_BLOCK_IMPORT_BUFFER);
+    Optional<int> file_number;
+    if (dbp) file_number = dbp->nFile;
+    ScanExternalBlockFile(chainparams, fileIn, file_number, [&](ExternalBlock&& external) {
+        return importer.Accept(std::move(external));
+    });
+    LogPrintf("Loaded %i blocks from external file in %dms\n", importer.Loaded(), GetTimeMillis() - nStart);
+}
+
+void LoadExternalBlockFiles(const CChainParams& chainparams, const std::vector<ExternalBlockFile>& files, size_t max_memory_usage)
+{
+    if (files.empty()) return;
+    const int num_threads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_IMPORT_THREADS));
+    // Three quarters for the blocks read ahead, the rest for the out of order
+    // blocks waiting for their parent.
+    ExternalBlockFileQueue queue(files.size(), num_threads, max_memory_usage / 4 * 3);
+    boost::thread_group scanners;
+    for (int i = 0; i < num_threads; ++i) {
+        scanners.create_thread([&chainparams, &files, &queue, i] {
+            util::ThreadRename(strprintf("loadblk.%i", i));
+            size_t index;
+            while (queue.ClaimFile(index)) {
+                const ExternalBlockFile& file = files[index];
+                const int64_t scan_start = GetTimeMillis();
+                FILE* fileIn = fsbridge::fopen(file.path, "rb");
+                if (fileIn) {
+                    ScanExternalBlockFile(chainparams, fileIn, file.file_number, [&](ExternalBlock&& external) {
+                        return queue.Push(index, std::move(external));
+                    });
+                } else {
+                    LogPrintf("Warning: Could not open blocks file %s\n", file.path.string());
+                }
+                const std::string progress = queue.FileDone(index);
+                LogPrint(BCLog::REINDEX, "Scanned blocks file %s in %dms (%s)\n",
+                    file.path.filename().string(), GetTimeMillis() - scan_start, progress);
+            }
+        });
+    }
+
+    // Accept the blocks in file order, so that the block index ends up as
+    // with a sequential import.
+    ExternalBlockImporter importer(chainparams, max_memory_usage / 4);
+    for (size_t index = 0; index < files.size(); ++index) {
+        const ExternalBlockFile& file = files[index];
+        if (file.file_number) {
+            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)*file.file_number);
+        } else {
+            LogPrintf("Importing blocks file %s...\n", file.path.string());
+        }
+        const int64_t nStart = GetTimeMillis();
+        const int loaded_before = importer.Loaded();
+        ExternalBlock external;
+        while (!ShutdownRequested() && queue.Pop(index, external)) {
+            if (!importer.Accept(std::move(external))) break;
+        }
+        queue.NextFile(index);
+        if (ShutdownRequested()) break;
+        LogPrintf("Loaded %i blocks from external file in %dms\n", importer.Loaded() - loaded_before, GetTimeMillis() - nStart);
+    }
+    queue.Stop();
+    scanners.join_all();
 }
 
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
@@ -4785,6 +5948,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 
     LOCK(cs_main);
 
+    // Below the base of a UTXO snapshot, the block index does not reflect
+    // connected blocks, which the checks below assume.
+    if (g_chainman.IsSnapshotActive()) {
+        return;
+    }
+
     // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
     // so we have the genesis block in m_blockman.m_block_index but no active chain. (A few of the
     // tests when iterating the block tree require that m_chain has been initialized.)
@@ -4795,7 +5964,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 
     // Build forward-pointing map of the entire block tree.
     std::multimap<CBlockIndex*,CBlockIndex*> forward;
-    for (const std::pair<const uint256, CBlockIndex*>& entry : m_blockman.m_block_index) {
+    for (const auto& entry : m_blockman.m_block_index) {
         forward.insert(std::make_pair(entry.second->pprev, entry.second));
     }
 
@@ -5004,7 +6173,7 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
 
 std::string CBlockFileInfo::ToString() const
 {
-    return strprintf("CBlockFileInfo(blocks=%u, size=%u, heights=%u...%u, time=%s...%s)", nBlocks, nSize, nHeightFirst, nHeightLast, FormatISO8601Date(nTimeFirst), FormatISO8601Date(nTimeLast));
+    return strprintf("CBlockFileInfo(blocks=%u, size=%u, heights=%u...%u, time=%s...%s, flags=%u)", nBlocks, nSize, nHeightFirst, nHeightLast, FormatISO8601Date(nTimeFirst), FormatISO8601Date(nTimeLast), nFlags);
 }
 
 CBlockFileInfo* GetBlockFileInfo(size_t n)
@@ -5034,6 +6203,9 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+/** Number of transactions from mempool.dat accepted together, holding cs_main. */
+static constexpr size_t MEMPOOL_LOAD_BATCH_SIZE = 100;
+
 bool LoadMempool(CTxMemPool& pool)
 {
     const CChainParams& chainparams = Params();
@@ -5052,6 +6224,34 @@ bool LoadMempool(CTxMemPool& pool)
     int64_t unbroadcast = 0;
     int64_t nNow = GetTime();
 
+    // Unexpired transactions are accepted in batches, which share the
+    // validation setup and have their scripts checked together
+    std::vector<CTransactionRef> batch;
+    std::vector<int64_t> batch_times;
+    std::vector<TxValidationState> states;
+    const auto accept_batch = [&] {
+        LOCK(cs_main);
+        AcceptPackageToMemoryPoolWithTime(chainparams, pool, batch, batch_times, states,
+                                          nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (states[i].IsValid()) {
+                ++count;
+            } else {
+                // mempool may contain the transaction already, e.g. from
+                // wallet(s) having loaded it while we were processing
+                // mempool transactions; consider these as valid, instead of
+                // failed, but mark them as 'already there'
+                if (pool.exists(batch[i]->GetHash())) {
+                    ++already_there;
+                } else {
+                    ++failed;
+                }
+            }
+        }
+        batch.clear();
+        batch_times.clear();
+    };
+
     try {
         uint64_t version;
         file >> version;
@@ -5072,28 +6272,15 @@ bool LoadMempool(CTxMemPool& pool)
             if (amountdelta) {
                 pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
-            TxValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
-                }
+                batch.push_back(tx);
+                batch_times.push_back(nTime);
             } else {
                 ++expired;
             }
+            if (batch.size() >= MEMPOOL_LOAD_BATCH_SIZE || (num == 0 && !batch.empty())) {
+                accept_batch();
+            }
             if (ShutdownRequested())
                 return false;
         }
@@ -5189,15 +6376,82 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
-//! Guess how far we are in the verification process at the given block index
-//! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
-double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
-    if (pindex == nullptr)
-        return 0.0;
-
-    int64_t nNow = time(nullptr);
-
-    double fTxTotal;
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
+bool LoadSignatureCaches()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SIGCACHE_DUMP_VERSION) {
+            LogPrintf("Signature cache file has unknown version %u. Continuing anyway.\n", version);
+            return false;
+        }
+        file >> sig_nonce >> sig_entries >> script_nonce >> script_entries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // The entries are salted hashes, which only the salt they were computed
+    // with makes meaningful, so the caches switch to the salts in the file.
+    LoadSignatureCacheEntries(sig_nonce, sig_entries);
+    SetScriptExecutionCacheNonce(script_nonce);
+    for (const uint256& entry : script_entries) {
+        g_scriptExecutionCache.insert(entry);
+    }
+    LogPrintf("Imported signature caches from disk: %u signature and %u script execution entries\n", sig_entries.size(), script_entries.size());
+    return true;
+}
+
+bool DumpSignatureCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce;
+    const std::vector<uint256> sig_entries = GetSignatureCacheEntries(sig_nonce);
+    const std::vector<uint256> script_entries = g_scriptExecutionCache.GetEntries();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SIGCACHE_DUMP_VERSION;
+        file << sig_nonce << sig_entries << g_scriptExecutionCacheNonce << script_entries;
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        LogPrintf("Dumped signature caches: %u signature and %u script execution entries in %gs\n", sig_entries.size(), script_entries.size(), (GetTimeMicros() - start) * MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+//! Guess how far we are in the verification process at the given block index
+//! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
+double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
+    if (pindex == nullptr)
+        return 0.0;
+
+    int64_t nNow = time(nullptr);
+
+    double fTxTotal;
 
     if (pindex->nChainTx <= data.nTxCount) {
         fTxTotal = data.nTxCount + (nNow - data.nTime) * data.dTxRate;
@@ -5214,10 +6468,7 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = g_chainman.BlockIndex().begin();
-        for (; it1 != g_chainman.BlockIndex().end(); it1++)
-            delete (*it1).second;
-        g_chainman.BlockIndex().clear();
+        g_chainman.m_blockman.Unload();
     }
 };
 static CMainCleanup instance_of_cmaincleanup;
@@ -5268,6 +6519,440 @@ CChainState& ChainstateManager::InitializeChainstate(const uint256& snapshot_blo
     return *to_modify;
 }
 
+const AssumeutxoData* ExpectedAssumeutxo(const int height, const CChainParams& chainparams)
+{
+    const MapAssumeutxo& valid_assumeutxos_map = chainparams.Assumeutxo();
+    const auto assumeutxo_found = valid_assumeutxos_map.find(height);
+
+    if (assumeutxo_found != valid_assumeutxos_map.end()) {
+        return &assumeutxo_found->second;
+    }
+    return nullptr;
+}
+
+namespace {
+
+/** Number of snapshot coins written to the coins database in one batch. */
+static constexpr size_t SNAPSHOT_COINS_PER_BATCH{20000};
+/** Maximum number of threads (including the calling one) writing snapshot coins. */
+static constexpr int MAX_SNAPSHOT_LOAD_THREADS{8};
+/** Number of batches per thread read ahead before waiting for them to be written. */
+static constexpr int SNAPSHOT_BATCHES_PER_THREAD{4};
+
+/**
+ * Sorts a batch of snapshot coins by outpoint and writes it to a coins
+ * database. Batches of SNAPSHOT_VERSION_COMPACT snapshots are handed over as
+ * an encoded SnapshotChunk, which is decoded and checked first.
+ */
+class CSnapshotCoinsWrite
+{
+private:
+    CCoinsViewDB* m_db{nullptr};
+    std::vector<std::pair<COutPoint, Coin>> m_coins;
+    std::vector<unsigned char> m_chunk;
+    uint64_t m_chunk_coins{0};
+    int m_base_height{0};
+
+    bool DecodeChunk()
+    {
+        SnapshotChunk chunk;
+        try {
+            CDataStream stream(m_chunk, SER_DISK, CLIENT_VERSION);
+            stream >> chunk;
+            if (!stream.empty()) {
+                LogPrintf("[snapshot] bad snapshot - trailing data in chunk\n");
+                return false;
+            }
+        } catch (const std::ios_base::failure& e) {
+            LogPrintf("[snapshot] bad snapshot chunk format: %s\n", e.what());
+            return false;
+        }
+        if (chunk.CoinsCount() != m_chunk_coins) {
+            LogPrintf("[snapshot] bad snapshot - chunk holds %d coins, %d expected\n",
+                chunk.CoinsCount(), m_chunk_coins);
+            return false;
+        }
+        m_coins.reserve(m_chunk_coins);
+        for (SnapshotTxOutputs& tx : chunk.m_txs) {
+            for (auto& output : tx.second) {
+                if (output.second.nHeight > m_base_height) {
+                    LogPrintf("[snapshot] bad snapshot data - coin above the base height\n");
+                    return false;
+                }
+                m_coins.emplace_back(COutPoint(tx.first, output.first), std::move(output.second));
+            }
+        }
+        return true;
+    }
+
+public:
+    CSnapshotCoinsWrite() {}
+    CSnapshotCoinsWrite(CCoinsViewDB& db, std::vector<std::pair<COutPoint, Coin>>&& coins) : m_db(&db), m_coins(std::move(coins)) {}
+    CSnapshotCoinsWrite(CCoinsViewDB& db, std::vector<unsigned char>&& chunk, uint64_t chunk_coins, int base_height) :
+        m_db(&db), m_chunk(std::move(chunk)), m_chunk_coins(chunk_coins), m_base_height(base_height) {}
+
+    bool operator()()
+    {
+        if (m_chunk_coins > 0 && !DecodeChunk()) {
+            return false;
+        }
+        std::sort(m_coins.begin(), m_coins.end(), [](const std::pair<COutPoint, Coin>& a, const std::pair<COutPoint, Coin>& b) {
+            return a.first < b.first;
+        });
+        try {
+            return m_db->WriteCoins(m_coins);
+        } catch (const std::runtime_error& e) {
+            LogPrintf("[snapshot] failed to write coins: %s\n", e.what());
+            return false;
+        }
+    }
+
+    void swap(CSnapshotCoinsWrite& check)
+    {
+        std::swap(m_db, check.m_db);
+        m_coins.swap(check.m_coins);
+        m_chunk.swap(check.m_chunk);
+        std::swap(m_chunk_coins, check.m_chunk_coins);
+        std::swap(m_base_height, check.m_base_height);
+    }
+};
+
+/**
+ * Read the next batch of at most SNAPSHOT_COINS_PER_BATCH coins of a
+ * SNAPSHOT_VERSION_LEGACY snapshot, one (COutPoint, Coin) record at a time.
+ */
+bool ReadLegacySnapshotBatch(CAutoFile& coins_file, int base_height, uint64_t coins_left, std::vector<std::pair<COutPoint, Coin>>& coins)
+{
+    coins.reserve(std::min<uint64_t>(SNAPSHOT_COINS_PER_BATCH, coins_left));
+    while (coins.size() < SNAPSHOT_COINS_PER_BATCH && coins.size() < coins_left) {
+        COutPoint outpoint;
+        Coin coin;
+        try {
+            coins_file >> outpoint;
+            coins_file >> coin;
+        } catch (const std::ios_base::failure&) {
+            LogPrintf("[snapshot] bad snapshot format or truncated snapshot\n");
+            return false;
+        }
+        if (coin.nHeight > base_height ||
+            outpoint.n >= std::numeric_limits<decltype(outpoint.n)>::max() // Avoid integer wrap-around in coinstats.cpp:ApplyHash
+        ) {
+            LogPrintf("[snapshot] bad snapshot data\n");
+            return false;
+        }
+        coins.emplace_back(outpoint, std::move(coin));
+    }
+    return true;
+}
+
+/**
+ * Read the coins of a snapshot and write them to coins_db on the threads of
+ * queue. Reading is sequential; decoding (for SNAPSHOT_VERSION_COMPACT
+ * snapshots), sorting and writing the batches is not.
+ */
+bool LoadSnapshotCoins(CCoinsViewDB& coins_db, CAutoFile& coins_file, const SnapshotMetadata& metadata, int base_height, CCheckQueue<CSnapshotCoinsWrite>& queue, int num_threads)
+{
+    uint64_t coins_left = metadata.m_coins_count;
+    uint64_t coins_processed = 0;
+
+    while (coins_left > 0) {
+        CCheckQueueControl<CSnapshotCoinsWrite> control(&queue);
+        for (int i = 0; i < SNAPSHOT_BATCHES_PER_THREAD * num_threads && coins_left > 0; ++i) {
+            std::vector<CSnapshotCoinsWrite> checks(1);
+            uint64_t batch_coins;
+            if (metadata.m_version == SNAPSHOT_VERSION_LEGACY) {
+                std::vector<std::pair<COutPoint, Coin>> coins;
+                if (!ReadLegacySnapshotBatch(coins_file, base_height, coins_left, coins)) {
+                    LogPrintf("[snapshot] failed after deserializing %d coins\n", coins_processed);
+                    return false;
+                }
+                batch_coins = coins.size();
+                CSnapshotCoinsWrite(coins_db, std::move(coins)).swap(checks[0]);
+            } else {
+                std::vector<unsigned char> chunk;
+                try {
+                    batch_coins = ReadCompactSize(coins_file);
+                    coins_file >> chunk;
+                } catch (const std::ios_base::failure&) {
+                    LogPrintf("[snapshot] bad snapshot format or truncated snapshot after deserializing %d coins\n",
+                        coins_processed);
+                    return false;
+                }
+                if (batch_coins == 0 || batch_coins > coins_left) {
+                    LogPrintf("[snapshot] bad snapshot - chunk of %d coins with %d coins left\n",
+                        batch_coins, coins_left);
+                    return false;
+                }
+                CSnapshotCoinsWrite(coins_db, std::move(chunk), batch_coins, base_height).swap(checks[0]);
+            }
+            control.Add(checks);
+            coins_left -= batch_coins;
+            coins_processed += batch_coins;
+
+            if (ShutdownRequested()) {
+                LogPrintf("[snapshot] shutdown requested while loading coins\n");
+                return false;
+            }
+        }
+        if (!control.Wait()) {
+            return false;
+        }
+        LogPrintf("[snapshot] %d coins loaded (%.2f%%)\n",
+            coins_processed, 100.0 * coins_processed / metadata.m_coins_count);
+    }
+
+    // Make sure the file holds nothing beyond the advertised number of coins.
+    bool out_of_coins{false};
+    try {
+        uint8_t next_byte;
+        coins_file >> next_byte;
+    } catch (const std::ios_base::failure&) {
+        // We expect an exception since we should be out of coins.
+        out_of_coins = true;
+    }
+    if (!out_of_coins) {
+        LogPrintf("[snapshot] bad snapshot - coins left over after deserializing %d coins\n",
+            coins_processed);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool ChainstateManager::ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, bool in_memory)
+{
+    const uint256& base_blockhash = metadata.m_base_blockhash;
+
+    int64_t current_coinsdb_cache_size{0};
+    int64_t current_coinstip_cache_size{0};
+
+    // Cache percentages to allocate to each chainstate.
+    //
+    // These particular percentages don't matter so much since they will only be
+    // relevant during snapshot activation; caches are rebalanced at the conclusion of
+    // this function. We want to give (essentially) all available cache capacity to the
+    // snapshot to aid the bulk load later in this function.
+    static constexpr double IBD_CACHE_PERC = 0.01;
+    static constexpr double SNAPSHOT_CACHE_PERC = 0.99;
+
+    TRY_LOCK(m_snapshot_load_mutex, snapshot_load_lock);
+    if (!snapshot_load_lock) {
+        LogPrintf("[snapshot] can't activate a snapshot while another one is being loaded\n");
+        return false;
+    }
+
+    {
+        LOCK(::cs_main);
+        if (m_snapshot_chainstate) {
+            LogPrintf("[snapshot] can't activate a snapshot-based chainstate more than once\n");
+            return false;
+        }
+        // The mempool was validated against the current chainstate, whose
+        // coins the snapshot chainstate does not share.
+        if (::mempool.size() > 0) {
+            LogPrintf("[snapshot] can't activate a snapshot when mempool not empty\n");
+            return false;
+        }
+
+        // Resize the coins caches to ensure we're not exceeding memory limits.
+        //
+        // Allocate the majority of the cache to the incoming snapshot chainstate, since
+        // (optimistically) getting to its tip will be the top priority. We'll need to call
+        // `MaybeRebalanceCaches()` once we're done with this function to ensure
+        // the right allocation (including the possibility that no snapshot was activated
+        // and that we should restore the active chainstate caches to their original size).
+        current_coinsdb_cache_size = this->ActiveChainstate().m_coinsdb_cache_size_bytes;
+        current_coinstip_cache_size = this->ActiveChainstate().m_coinstip_cache_size_bytes;
+
+        // Temporarily resize the active coins cache to make room for the newly-created
+        // snapshot chain.
+        this->ActiveChainstate().ResizeCoinsCaches(
+            static_cast<size_t>(current_coinstip_cache_size * IBD_CACHE_PERC),
+            static_cast<size_t>(current_coinsdb_cache_size * IBD_CACHE_PERC));
+    }
+
+    std::unique_ptr<CChainState> snapshot_chainstate = WITH_LOCK(::cs_main,
+        return MakeUnique<CChainState>(m_blockman, base_blockhash));
+
+    {
+        LOCK(::cs_main);
+        // Wipe whatever an earlier, unsuccessful load left behind.
+        snapshot_chainstate->InitCoinsDB(
+            static_cast<size_t>(current_coinsdb_cache_size * SNAPSHOT_CACHE_PERC),
+            in_memory, /* should_wipe */ true, "chainstate");
+        snapshot_chainstate->InitCoinsCache(
+            static_cast<size_t>(current_coinstip_cache_size * SNAPSHOT_CACHE_PERC));
+    }
+
+    const bool snapshot_ok = this->PopulateAndValidateSnapshot(
+        *snapshot_chainstate, coins_file, metadata);
+
+    if (!snapshot_ok) {
+        WITH_LOCK(::cs_main, this->MaybeRebalanceCaches());
+        return false;
+    }
+
+    {
+        LOCK(::cs_main);
+        assert(!m_snapshot_chainstate);
+        // cs_main was released while the coins were loaded, so transactions
+        // may have been accepted against the current chainstate meanwhile.
+        if (::mempool.size() > 0) {
+            LogPrintf("[snapshot] can't activate a snapshot when mempool not empty\n");
+            this->MaybeRebalanceCaches();
+            return false;
+        }
+        m_snapshot_chainstate.swap(snapshot_chainstate);
+        const bool chaintip_loaded = m_snapshot_chainstate->LoadChainTip(::Params());
+        assert(chaintip_loaded);
+
+        m_active_chainstate = m_snapshot_chainstate.get();
+
+        // From now on the IBD chainstate only connects the blocks up to the
+        // snapshot base, see AddBackgroundValidationCandidate().
+        const CBlockIndex* base = m_snapshot_chainstate->m_chain.Tip();
+        for (auto it = m_ibd_chainstate->setBlockIndexCandidates.begin(); it != m_ibd_chainstate->setBlockIndexCandidates.end();) {
+            if (base->GetAncestor((*it)->nHeight) != *it) {
+                it = m_ibd_chainstate->setBlockIndexCandidates.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        LogPrintf("[snapshot] successfully activated snapshot %s\n", base_blockhash.ToString());
+        LogPrintf("[snapshot] (%.2f MB)\n",
+            m_snapshot_chainstate->CoinsTip().DynamicMemoryUsage() / (1000 * 1000.0));
+
+        this->MaybeRebalanceCaches();
+    }
+    return true;
+}
+
+bool ChainstateManager::PopulateAndValidateSnapshot(
+    CChainState& snapshot_chainstate,
+    CAutoFile& coins_file,
+    const SnapshotMetadata& metadata)
+{
+    // It's okay to release cs_main before we're done using `coins_db` because we know
+    // that nothing else will be referencing the newly created snapshot_chainstate yet.
+    CCoinsViewDB& coins_db = *WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
+
+    const uint256& base_blockhash = metadata.m_base_blockhash;
+
+    CBlockIndex* snapshot_start_block = WITH_LOCK(::cs_main, return LookupBlockIndex(base_blockhash));
+
+    if (!snapshot_start_block) {
+        // Needed for GetUTXOStats and ExpectedAssumeutxo to determine the height.
+        LogPrintf("[snapshot] Did not find snapshot start blockheader %s\n",
+            base_blockhash.ToString());
+        return false;
+    }
+    if (WITH_LOCK(::cs_main, return snapshot_start_block->nStatus & BLOCK_FAILED_MASK)) {
+        LogPrintf("[snapshot] snapshot start block %s is invalid\n", base_blockhash.ToString());
+        return false;
+    }
+
+    {
+        LOCK(::cs_main);
+        const CBlockIndex* tip = ActiveTip();
+        if (tip && snapshot_start_block->GetAncestor(tip->nHeight) != tip) {
+            // Background validation could never connect our chain to the base.
+            LogPrintf("[snapshot] snapshot start block %s does not descend from the current tip\n",
+                base_blockhash.ToString());
+            return false;
+        }
+    }
+
+    const int base_height = snapshot_start_block->nHeight;
+    const AssumeutxoData* au_data = ExpectedAssumeutxo(base_height, ::Params());
+
+    if (!au_data) {
+        LogPrintf("[snapshot] assumeutxo height in snapshot metadata not recognized " /* Continued */
+            "(%d) - refusing to load snapshot\n", base_height);
+        return false;
+    }
+
+    const int num_threads = std::max(1, std::min(GetNumCores(), MAX_SNAPSHOT_LOAD_THREADS));
+    LogPrintf("[snapshot] loading %d coins from snapshot %s using %d threads\n",
+        metadata.m_coins_count, base_blockhash.ToString(), num_threads);
+    const int64_t load_start = GetTimeMillis();
+
+    // The calling thread joins the workers when waiting for a round of
+    // batches, so a single thread is enough to load a snapshot.
+    CCheckQueue<CSnapshotCoinsWrite> queue(1);
+    boost::thread_group workers;
+    for (int i = 0; i < num_threads - 1; ++i) {
+        workers.create_thread([&queue, i] {
+            util::ThreadRename(strprintf("snapload.%i", i));
+            queue.Thread();
+        });
+    }
+    const bool coins_ok = LoadSnapshotCoins(coins_db, coins_file, metadata, base_height, queue, num_threads);
+    workers.interrupt_all();
+    workers.join_all();
+    if (!coins_ok) {
+        return false;
+    }
+
+    LogPrintf("[snapshot] loaded %d coins in %.2fs\n",
+        metadata.m_coins_count, (GetTimeMillis() - load_start) / 1000.0);
+
+    {
+        // Mark the coins database as being consistent with the base block.
+        LOCK(::cs_main);
+        CCoinsViewCache& coins_cache = snapshot_chainstate.CoinsTip();
+        coins_cache.SetBestBlock(base_blockhash);
+        if (!coins_cache.Flush()) {
+            LogPrintf("[snapshot] failed to write to coin database\n");
+            return false;
+        }
+    }
+
+    CCoinsStats stats;
+    if (!GetUTXOStats(&coins_db, stats, CoinStatsHashType::HASH_SERIALIZED, [] {})) {
+        LogPrintf("[snapshot] failed to generate coins stats\n");
+        return false;
+    }
+
+    if (stats.coins_count != metadata.m_coins_count) {
+        LogPrintf("[snapshot] bad snapshot - %d distinct coins found, %d expected\n",
+            stats.coins_count, metadata.m_coins_count);
+        return false;
+    }
+
+    // Assert that the deserialized chainstate contents match the expected assumeutxo value.
+    if (stats.hashSerialized != au_data->hash_serialized) {
+        LogPrintf("[snapshot] bad snapshot content hash: expected %s, got %s\n",
+            au_data->hash_serialized.ToString(), stats.hashSerialized.ToString());
+        return false;
+    }
+
+    LOCK(::cs_main);
+    snapshot_chainstate.m_chain.SetTip(snapshot_start_block);
+
+    // The transaction count of the base block is needed for blocks on top of it
+    // to be linked, and for GuessVerificationProgress. We may not have any of
+    // the blocks below it, so use the hardcoded value.
+    if (!snapshot_start_block->HaveTxsDownloaded()) {
+        snapshot_start_block->nChainTx = au_data->nChainTx;
+    }
+    snapshot_chainstate.setBlockIndexCandidates.insert(snapshot_start_block);
+
+    // Blocks on top of the base that we already have can be connected right away.
+    for (const auto& entry : m_blockman.m_block_index) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nHeight > base_height && pindex->IsValid(BLOCK_VALID_TRANSACTIONS) &&
+            pindex->HaveTxsDownloaded() && pindex->GetAncestor(base_height) == snapshot_start_block) {
+            snapshot_chainstate.setBlockIndexCandidates.insert(pindex);
+        }
+    }
+
+    LogPrintf("[snapshot] validated snapshot (%.2f MB)\n",
+        coins_db.EstimateSize() / (1000 * 1000.0));
+    return true;
+}
+
 CChainState& ChainstateManager::ActiveChainstate() const
 {
     assert(m_active_chainstate);
@@ -5293,6 +6978,175 @@ bool ChainstateManager::IsBackgroundIBD(CChainState* chainstate) const
     return (m_snapshot_chainstate && chainstate == m_ibd_chainstate.get());
 }
 
+CChainState* ChainstateManager::BackgroundValidationChainstate() const
+{
+    if (m_ibd_chainstate && IsSnapshotActive() && !IsSnapshotValidated()) {
+        return m_ibd_chainstate.get();
+    }
+    return nullptr;
+}
+
+CBlockIndex* ChainstateManager::SnapshotBase() const
+{
+    if (!IsSnapshotActive()) return nullptr;
+    return LookupBlockIndex(m_snapshot_chainstate->m_from_snapshot_blockhash);
+}
+
+void ChainstateManager::AddBackgroundValidationCandidate(CBlockIndex* pindex)
+{
+    CChainState* chainstate = BackgroundValidationChainstate();
+    if (!chainstate) return;
+    const CBlockIndex* base = SnapshotBase();
+    if (base->GetAncestor(pindex->nHeight) != pindex) return;
+    const CBlockIndex* tip = chainstate->m_chain.Tip();
+    if (tip && chainstate->setBlockIndexCandidates.value_comp()(pindex, tip)) return;
+
+    chainstate->setBlockIndexCandidates.insert(pindex);
+    {
+        LOCK(m_background_validation_mutex);
+        m_background_validation_wake = true;
+    }
+    m_background_validation_cv.notify_one();
+}
+
+void ChainstateManager::StartBackgroundValidation()
+{
+    if (!WITH_LOCK(::cs_main, return BackgroundValidationChainstate())) return;
+    if (m_background_validation_thread.joinable()) return;
+
+    {
+        LOCK(m_background_validation_mutex);
+        // Connect whatever has been received before the thread was started.
+        m_background_validation_wake = true;
+        m_background_validation_stop = false;
+    }
+    m_background_validation_thread = std::thread(&TraceThread<std::function<void()>>, "bgvalid",
+        std::function<void()>(std::bind(&ChainstateManager::ThreadBackgroundValidation, this)));
+}
+
+void ChainstateManager::StopBackgroundValidation()
+{
+    if (!m_background_validation_thread.joinable()) return;
+    {
+        LOCK(m_background_validation_mutex);
+        m_background_validation_stop = true;
+    }
+    m_background_validation_cv.notify_one();
+    m_background_validation_thread.join();
+}
+
+void ChainstateManager::ThreadBackgroundValidation()
+{
+    // Leave the CPU to the threads serving the active chainstate.
+    ScheduleBatchPriority();
+
+    const CChainParams& chainparams = ::Params();
+    bool snapshot_in_ibd = true;
+    while (!ShutdownRequested()) {
+        {
+            WAIT_LOCK(m_background_validation_mutex, lock);
+            m_background_validation_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_background_validation_mutex) {
+                return m_background_validation_wake || m_background_validation_stop;
+            });
+            if (m_background_validation_stop) return;
+            m_background_validation_wake = false;
+        }
+
+        CChainState* chainstate;
+        {
+            LOCK(::cs_main);
+            chainstate = BackgroundValidationChainstate();
+            if (!chainstate) return;
+            // Once the snapshot chainstate has caught up, the bulk of the
+            // coins caches goes to background validation.
+            if (snapshot_in_ibd && !m_snapshot_chainstate->IsInitialBlockDownload()) {
+                snapshot_in_ibd = false;
+                MaybeRebalanceCaches();
+            }
+        }
+
+        // ActivateBestChain releases cs_main after every block it connects,
+        // so the active chainstate and RPC are never kept waiting for long.
+        BlockValidationState state;
+        if (!chainstate->ActivateBestChain(state, chainparams, nullptr)) {
+            LogPrintf("[background validation] failed to connect blocks: %s\n", state.ToString());
+            return;
+        }
+
+        {
+            LOCK(::cs_main);
+            const CBlockIndex* base = SnapshotBase();
+            const CBlockIndex* tip = chainstate->m_chain.Tip();
+            const CBlockIndex* next = base->GetAncestor(tip->nHeight + 1);
+            if (next && next->nStatus & BLOCK_FAILED_MASK) {
+                AbortNode(strprintf("[snapshot] the chain leading to the snapshot base %s is invalid at height %d",
+                        base->GetBlockHash().ToString(), next->nHeight),
+                    _("The UTXO snapshot in use is invalid. Please restart with a fresh data directory."));
+                return;
+            }
+        }
+
+        if (MaybeCompleteSnapshotValidation()) return;
+    }
+}
+
+bool ChainstateManager::MaybeCompleteSnapshotValidation()
+{
+    CChainState* chainstate;
+    const CBlockIndex* base;
+    {
+        LOCK(::cs_main);
+        chainstate = BackgroundValidationChainstate();
+        if (!chainstate) return IsSnapshotValidated();
+        base = SnapshotBase();
+        if (chainstate->m_chain.Tip() != base) return false;
+        chainstate->ForceFlushStateToDisk();
+    }
+
+    LogPrintf("[snapshot] background validation reached the snapshot base %s, checking the UTXO set\n",
+        base->GetBlockHash().ToString());
+
+    // Nothing but this function touches the IBD chainstate once it is at the
+    // snapshot base, so its coins can be hashed without holding cs_main.
+    const AssumeutxoData* au_data = ExpectedAssumeutxo(base->nHeight, ::Params());
+    assert(au_data);
+    CCoinsStats stats;
+    // Hashing the whole UTXO set takes minutes, so give up as soon as the
+    // node shuts down or background validation is stopped.
+    struct Interrupted {};
+    const auto interruption_point = [this] {
+        if (ShutdownRequested() || WITH_LOCK(m_background_validation_mutex, return m_background_validation_stop)) {
+            throw Interrupted{};
+        }
+    };
+    bool stats_ok;
+    try {
+        stats_ok = GetUTXOStats(&chainstate->CoinsDB(), stats, CoinStatsHashType::HASH_SERIALIZED, interruption_point);
+    } catch (const Interrupted&) {
+        LogPrintf("[snapshot] interrupted while checking the UTXO set\n");
+        return false;
+    }
+    if (!stats_ok) {
+        // The coins could not be read, and nothing would make a later
+        // attempt succeed.
+        AbortNode("[snapshot] failed to generate coins stats of the background validation chainstate",
+            _("Error reading from database, shutting down."));
+        return false;
+    }
+    if (stats.hashSerialized != au_data->hash_serialized) {
+        AbortNode(strprintf("[snapshot] UTXO set at the snapshot base %s has hash %s, the snapshot was loaded as %s",
+                base->GetBlockHash().ToString(), stats.hashSerialized.ToString(), au_data->hash_serialized.ToString()),
+            _("The UTXO snapshot in use is invalid. Please restart with a fresh data directory."));
+        return false;
+    }
+
+    LOCK(::cs_main);
+    m_snapshot_validated = true;
+    LogPrintf("[snapshot] snapshot beginning at %s has been fully validated\n", base->GetBlockHash().ToString());
+    MaybeRebalanceCaches();
+    return true;
+}
+
 void ChainstateManager::Unload()
 {
     for (CChainState* chainstate : this->GetAll()) {
@@ -5305,6 +7159,7 @@ void ChainstateManager::Unload()
 
 void ChainstateManager::Reset()
 {
+    StopBackgroundValidation();
     m_ibd_chainstate.reset();
     m_snapshot_chainstate.reset();
     m_active_chainstate = nullptr;
@@ -5318,8 +7173,13 @@ void ChainstateManager::MaybeRebalanceCaches()
         // Allocate everything to the IBD chainstate.
         m_ibd_chainstate->ResizeCoinsCaches(m_total_coinstip_cache, m_total_coinsdb_cache);
     }
-    else if (m_snapshot_chainstate && !m_ibd_chainstate) {
+    else if (m_snapshot_chainstate && (!m_ibd_chainstate || IsSnapshotValidated())) {
         LogPrintf("[snapshot] allocating all cache to the snapshot chainstate\n");
+        // The IBD chainstate, if any, is done with background validation and
+        // is only kept around until shutdown.
+        if (m_ibd_chainstate) {
+            m_ibd_chainstate->ResizeCoinsCaches(0, 0);
+        }
         // Allocate everything to the snapshot chainstate.
         m_snapshot_chainstate->ResizeCoinsCaches(m_total_coinstip_cache, m_total_coinsdb_cache);
     }
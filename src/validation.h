@@ -11,8 +11,8 @@
 #endif
 
 #include <amount.h>
+#include <blockmap.h>
 #include <coins.h>
-#include <crypto/common.h> // for ReadLE64
 #include <fs.h>
 #include <optional.h>
 #include <policy/feerate.h>
@@ -25,16 +25,19 @@
 #include <serialize.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <map>
 #include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 class CChainState;
 class BlockValidationState;
+class CAutoFile;
 class CBlockIndex;
 class CBlockTreeDB;
 class CBlockUndo;
@@ -45,12 +48,15 @@ class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class ChainstateManager;
+class SnapshotMetadata;
 class TxValidationState;
+struct AssumeutxoData;
 struct ChainTxData;
 
 struct DisconnectedBlockTransactions;
 struct PrecomputedTransactionData;
 struct LockPoints;
+struct SignatureCacheShardStats;
 
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 1000;
@@ -70,12 +76,34 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -prefetchblocks default (number of blocks read ahead of the tip while connecting blocks, 0 = disabled) */
+static const int DEFAULT_PREFETCH_BLOCKS = 16;
+/** Maximum value for -prefetchblocks */
+static const int MAX_PREFETCH_BLOCKS = 1024;
+/** Maximum number of dedicated coins fetch threads allowed */
+static const int MAX_COINS_FETCH_THREADS = 16;
+/** -coinsfetchthreads default (number of threads looking up a block's inputs in the coins database, 0 = disabled) */
+static const int DEFAULT_COINS_FETCH_THREADS = 4;
+/** Number of dedicated block prefetch threads started when -prefetchblocks is enabled */
+static const int BLOCK_PREFETCH_THREADS = 2;
+/** Share of -dbcache, in percent, that -reindex and -loadblock use on top of it for the blocks waiting to be imported */
+static const int BLOCK_IMPORT_BUFFER_DBCACHE_PERCENT = 25;
+/** Minimum memory -reindex and -loadblock use for the blocks waiting to be imported */
+static const size_t MIN_BLOCK_IMPORT_BUFFER = 32 << 20;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
+/** Default for -blockindexcache */
+static const bool DEFAULT_BLOCKINDEXCACHE = false;
+/** Default for -compressblocks */
+static const bool DEFAULT_COMPRESS_BLOCKS = false;
+/** Flag in the size field of a blk or rev file record header, set if the record data is compressed with LZCompress. */
+static constexpr uint32_t BLOCK_RECORD_COMPRESSED = 0x80000000;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 /** Default for -stopatheight */
@@ -96,14 +124,6 @@ static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 /** Minimum size of a witness commitment structure. Defined in BIP 141. **/
 static constexpr size_t MINIMUM_WITNESS_COMMITMENT{38};
 
-struct BlockHasher
-{
-    // this used to call `GetCheapHash()` in uint256, which was later moved; the
-    // cheap hash function simply calls ReadLE64() however, so the end result is
-    // identical
-    size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
-};
-
 /** Current sync state passed to tip changed callbacks. */
 enum class SynchronizationState {
     INIT_REINDEX,
@@ -114,7 +134,6 @@ enum class SynchronizationState {
 extern RecursiveMutex cs_main;
 extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
-typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern Mutex g_best_block_mutex;
 extern std::condition_variable g_best_block_cv;
 extern uint256 g_best_block;
@@ -124,8 +143,18 @@ extern std::atomic_bool fReindex;
  * False indicates all script checking is done on the main threadMessageHandler thread.
  */
 extern bool g_parallel_script_checks;
+/** Whether there are dedicated coins fetch threads running.
+ * False indicates the inputs of a block are looked up one by one while it is connected.
+ */
+extern bool g_parallel_coins_fetch;
+/** Number of blocks the block prefetch threads read ahead of the tip in ActivateBestChainStep.
+ * 0 indicates there are no block prefetch threads and ConnectTip reads every block itself.
+ */
+extern int g_block_prefetch_depth;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Whether new blk and rev files are written with compressed records (-compressblocks). */
+extern bool g_compress_blocks;
 extern bool fCheckpointsEnabled;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -155,14 +184,37 @@ extern const std::vector<std::string> CHECKLEVEL_DOC;
 FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const FlatFilePos &pos);
+/**
+ * Rewrite the blk and rev files whose format does not match -compressblocks
+ * (-rewriteblockfiles). Must be called before any block is written. Any
+ * txindex is invalidated, see the "blockfilesrewritten" block tree flag.
+ */
+bool RewriteBlockFiles(const CChainParams& chainparams);
 /** Import blocks from an external file */
 void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp = nullptr);
+/** A file to import blocks from with LoadExternalBlockFiles. */
+struct ExternalBlockFile {
+    fs::path path;
+    //! The number of the blk file, if the blocks are stored there already (-reindex).
+    Optional<int> file_number;
+};
+/**
+ * Import blocks from several files (-reindex, -loadblock). The files are
+ * scanned and their blocks deserialized and checked on several threads, while
+ * the calling thread accepts the blocks in file order. The blocks waiting to
+ * be accepted use up to about max_memory_usage.
+ */
+void LoadExternalBlockFiles(const CChainParams& chainparams, const std::vector<ExternalBlockFile>& files, size_t max_memory_usage);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex(CTxMemPool* mempool);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the coins fetch thread */
+void ThreadCoinsFetch(int worker_num);
+/** Run an instance of the block prefetch thread */
+void ThreadBlockPrefetch(int worker_num);
 /**
  * Return transaction from the block at block_index.
  * If block_index is not provided, fall back to mempool.
@@ -205,6 +257,15 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** (try to) add transactions to memory pool, in order, as AcceptToMemoryPool would one by one.
+ * Transactions may spend the outputs of earlier or later ones in txns. They are validated under
+ * one mempool lock against a shared coins view, and the scripts of those that do not depend on
+ * each other are checked as one batch.
+ * states is set to the validation state of each transaction, in order.
+ * @returns the number of transactions added **/
+size_t AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txns, std::vector<TxValidationState>& states,
+                        std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount nAbsurdFee) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -285,12 +346,22 @@ public:
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** @returns the statistics of the script-execution cache, by shard */
+std::vector<SignatureCacheShardStats> GetScriptExecutionCacheStats();
+
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/**
+ * Get the serialized block at pos without copying it, from a read-only mapping
+ * of its blk file. block stays valid as long as owner is held. Compressed
+ * records, and systems without mappings, are read into a copy instead.
+ */
+bool MapRawBlockFromDisk(Span<const uint8_t>& block, std::shared_ptr<const void>& owner, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool MapRawBlockFromDisk(Span<const uint8_t>& block, std::shared_ptr<const void>& owner, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
@@ -358,6 +429,24 @@ struct CBlockIndexWorkComparator
  * candidate tips is not maintained here.
  */
 class BlockManager {
+private:
+    //! Whether m_block_index holds all entries of the block tree database,
+    //! once setDirtyBlockIndex has been flushed.
+    bool m_block_index_complete{false};
+
+    /**
+     * Fill m_block_index from the block index cache file, if the block tree
+     * database says it matches its entries.
+     *
+     * @param[out] sorted_entries  The entries loaded, parents before children.
+     * @returns false if there is no usable cache, with m_block_index untouched.
+     */
+    bool LoadBlockIndexCache(
+        const Consensus::Params& consensus_params,
+        CBlockTreeDB& blocktree,
+        std::vector<CBlockIndex*>& sorted_entries)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
@@ -394,26 +483,46 @@ public:
      *
      * @param[out] block_index_candidates  Fill this set with any valid blocks for
      *                                     which we've downloaded all transactions.
+     * @param[in]  use_cache               Try the block index cache before the
+     *                                     block tree database.
      */
     bool LoadBlockIndex(
         const Consensus::Params& consensus_params,
         CBlockTreeDB& blocktree,
-        std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
+        std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates,
+        bool use_cache = false)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /** Mark m_block_index as holding all entries of the block tree database. */
+    void SetBlockIndexComplete() EXCLUSIVE_LOCKS_REQUIRED(cs_main) { m_block_index_complete = true; }
+
+    /**
+     * Write all block index entries, in height order and with a fixed size, to
+     * the block index cache file, and record its hash in blocktree so that
+     * the next LoadBlockIndex can load the entries from it in bulk. The hash
+     * is erased with the next change to the block tree database.
+     *
+     * Must be called right after flushing setDirtyBlockIndex, usually at
+     * shutdown.
+     */
+    bool WriteBlockIndexCache(CBlockTreeDB& blocktree) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     /** Clear all data members. */
     void Unload() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-    CBlockIndex* AddToBlockIndex(const CBlockHeader& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Create a new block index entry for a given block hash */
     CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     *
+     * @param[in] hash  The hash of block, which the caller may have computed in a batch.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
+        const uint256& hash,
         BlockValidationState& state,
         const CChainParams& chainparams,
         CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -684,6 +793,13 @@ public:
 
     std::string ToString() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
+    //! Number of blocks read ahead of the tip while connecting blocks to this
+    //! chainstate (see g_block_prefetch_depth). The prefetcher keeps a single
+    //! window, so only the active chainstate uses it: background validation
+    //! would replace that window with its own block by block, and both
+    //! chainstates would end up reading every block twice.
+    int BlockPrefetchDepth() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
 private:
     bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
     bool ConnectTip(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
@@ -802,6 +918,31 @@ private:
     friend CChainState& ChainstateActive();
     friend CChain& ChainActive();
 
+    //! Connects the blocks below the snapshot base to m_ibd_chainstate while a
+    //! snapshot chainstate is active. See StartBackgroundValidation().
+    std::thread m_background_validation_thread;
+    Mutex m_background_validation_mutex;
+    std::condition_variable m_background_validation_cv;
+    //! Set when a block the background validation chainstate can connect has
+    //! arrived since the thread last looked.
+    bool m_background_validation_wake GUARDED_BY(m_background_validation_mutex){false};
+    bool m_background_validation_stop GUARDED_BY(m_background_validation_mutex){false};
+
+    void ThreadBackgroundValidation();
+
+    //! Held by ActivateSnapshot() for the whole load, which drops cs_main
+    //! while the coins are written, so that a second load is refused instead
+    //! of wiping the database the first one is filling.
+    Mutex m_snapshot_load_mutex;
+
+    //! Internal helper for ActivateSnapshot(): write the coins of the snapshot
+    //! into the (fresh) coins database of snapshot_chainstate, check them
+    //! against the assumeutxo data and set up the chainstate's chain.
+    bool PopulateAndValidateSnapshot(
+        CChainState& snapshot_chainstate,
+        CAutoFile& coins_file,
+        const SnapshotMetadata& metadata) LOCKS_EXCLUDED(::cs_main);
+
 public:
     //! A single BlockManager instance is shared across each constructed
     //! chainstate to avoid duplicating block metadata.
@@ -826,6 +967,28 @@ public:
     //! Get all chainstates currently being used.
     std::vector<CChainState*> GetAll();
 
+    /**
+     * Construct and activate a chainstate on the basis of UTXO snapshot data.
+     *
+     * The coins are read from coins_file (positioned after the metadata) and
+     * written in sorted batches by several threads straight into a new coins
+     * database. The resulting UTXO set must hash to the value listed in the
+     * chainparams' assumeutxo data for the height of the snapshot base block,
+     * whose header must already be known.
+     *
+     * Steps:
+     *
+     * - Initialize an unused CChainState.
+     * - Load its coins database from coins_file and verify it.
+     * - Move the new chainstate to `m_snapshot_chainstate` and make it our
+     *   ChainstateActive().
+     *
+     * Only one snapshot can be loaded at a time; a concurrent call fails.
+     *
+     * @returns false, after logging the reason, if the snapshot was not loaded.
+     */
+    bool ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, bool in_memory) LOCKS_EXCLUDED(::cs_main);
+
     //! The most-work chain.
     CChainState& ActiveChainstate() const;
     CChain& ActiveChain() const { return ActiveChainstate().m_chain; }
@@ -848,6 +1011,42 @@ public:
     //!          snapshot in the background.
     bool IsBackgroundIBD(CChainState* chainstate) const;
 
+    //! The chainstate validating the active snapshot chainstate in the
+    //! background, or nullptr if there is nothing left to validate.
+    CChainState* BackgroundValidationChainstate() const EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    //! The block the active snapshot chainstate is based on, or nullptr.
+    CBlockIndex* SnapshotBase() const EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    //! Make pindex, whose transactions have all been received, a candidate
+    //! tip of the background validation chainstate if it is on the way to the
+    //! snapshot base.
+    void AddBackgroundValidationCandidate(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    /**
+     * Start connecting the blocks below the snapshot base to the IBD
+     * chainstate on a thread of its own, at batch scheduling priority, as
+     * they are downloaded. Blocks are connected one at a time, sharing
+     * ::cs_main, the script check threads and the -dbcache budget with the
+     * active chainstate. Once the snapshot base is reached the thread calls
+     * MaybeCompleteSnapshotValidation() and exits.
+     */
+    void StartBackgroundValidation();
+
+    //! Stop the background validation thread, if running.
+    void StopBackgroundValidation();
+
+    /**
+     * If the IBD chainstate has reached the snapshot base, compare the hash
+     * of its UTXO set with the assumeutxo data the snapshot was loaded
+     * against. If they match, mark the snapshot chainstate as validated and
+     * give it all of the coins caches; otherwise shut down. Hashing stops
+     * early when the node shuts down or StopBackgroundValidation() is called.
+     *
+     * @returns true if the snapshot chainstate has been validated.
+     */
+    bool MaybeCompleteSnapshotValidation() LOCKS_EXCLUDED(::cs_main);
+
     //! Return the most-work chainstate that has been fully validated.
     //!
     //! During background validation of a snapshot, this is the IBD chain. After
@@ -892,6 +1091,14 @@ public:
      */
     bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex = nullptr) LOCKS_EXCLUDED(cs_main);
 
+    /**
+     * Process incoming block headers whose hashes were already computed, e.g.
+     * with GetBlockHeaderHashes(), so that hashing does not happen under cs_main.
+     *
+     * @param[in]  hashes The hashes of the headers, in the same order
+     */
+    bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, const std::vector<uint256>& hashes, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex = nullptr) LOCKS_EXCLUDED(cs_main);
+
     //! Mark one block file as pruned (modify associated database entries)
     void PruneOneBlockFile(const int fileNumber) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
@@ -904,6 +1111,8 @@ public:
     //! Clear (deconstruct) chainstate data.
     void Reset();
 
+    ~ChainstateManager() { StopBackgroundValidation(); }
+
     //! Check to see if caches are out of balance and if so, call
     //! ResizeCoinsCaches() as needed.
     void MaybeRebalanceCaches() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
@@ -935,6 +1144,15 @@ extern VersionBitsCache versionbitscache;
  */
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params);
 
+/**
+ * Return the expected assumeutxo value for a given height, if one exists.
+ *
+ * @param[in] height Get the assumeutxo value for this height.
+ *
+ * @returns nullptr if no assumeutxo configuration exists for the given height.
+ */
+const AssumeutxoData* ExpectedAssumeutxo(const int height, const CChainParams& params);
+
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
@@ -944,6 +1162,13 @@ bool DumpMempool(const CTxMemPool& pool);
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the signature and script execution caches to disk. */
+bool DumpSignatureCaches();
+
+/** Load the signature and script execution caches from disk. Call before
+ * the caches are used by several threads. */
+bool LoadSignatureCaches();
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test loading UTXO snapshots with `loadtxoutset`.
+
+- Mine 100 blocks on node0 (deterministically, so that the UTXO set matches
+  the regtest assumeutxo data) and dump its UTXO set.
+- Give node1 the headers only, and load the snapshot into it.
+- Connect the nodes and check that node1 syncs on top of the snapshot while
+  validating the blocks below it in the background.
+- Restart node1 and check that the snapshot chainstate is removed.
+"""
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+)
+
+SNAPSHOT_BASE_HEIGHT = 100
+
+
+class AssumeutxoTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_network(self):
+        self.setup_nodes()
+        # We'll connect the nodes later
+
+    def run_test(self):
+        n0, n1 = self.nodes
+        # Same chain as in rpc_dumptxoutset.py.
+        mocktime = n0.getblockheader(n0.getblockhash(0))['time'] + 1
+        n0.setmocktime(mocktime)
+        n0.generate(SNAPSHOT_BASE_HEIGHT)
+
+        dump = n0.dumptxoutset('utxos.dat')
+        assert_equal(dump['base_height'], SNAPSHOT_BASE_HEIGHT)
+
+        self.log.info("Snapshots can't be loaded without the header of their base block")
+        assert_raises_rpc_error(-32603, "Unable to load UTXO snapshot", n1.loadtxoutset, dump['path'])
+        assert_raises_rpc_error(-8, "Couldn't open file", n1.loadtxoutset, dump['path'] + '.missing')
+
+        for height in range(1, SNAPSHOT_BASE_HEIGHT + 1):
+            n1.submitheader(n0.getblockheader(n0.getblockhash(height), False))
+        assert_equal(n1.getblockcount(), 0)
+
+        self.log.info("Load the snapshot into node1")
+        loaded = n1.loadtxoutset(dump['path'])
+        assert_equal(loaded['coins_loaded'], dump['coins_written'])
+        assert_equal(loaded['tip_hash'], dump['base_hash'])
+        assert_equal(loaded['base_height'], SNAPSHOT_BASE_HEIGHT)
+        assert_equal(n1.getbestblockhash(), dump['base_hash'])
+        assert_equal(n1.gettxoutsetinfo()['hash_serialized_2'], n0.gettxoutsetinfo()['hash_serialized_2'])
+
+        self.log.info("A second snapshot can't be loaded")
+        assert_raises_rpc_error(-32603, "Unable to load UTXO snapshot", n1.loadtxoutset, dump['path'])
+
+        self.log.info("Sync blocks on top of the snapshot, and validate the ones below it in the background")
+        n0.generate(10)
+        with n1.assert_debug_log(expected_msgs=["[snapshot] snapshot beginning at {} has been fully validated".format(dump['base_hash'])], timeout=30):
+            connect_nodes(n0, 1)
+            self.sync_blocks()
+            assert_equal(n1.getblockcount(), SNAPSHOT_BASE_HEIGHT + 10)
+        assert_equal(n1.gettxoutsetinfo()['hash_serialized_2'], n0.gettxoutsetinfo()['hash_serialized_2'])
+        assert_equal(n1.getblockheader(dump['base_hash'])['nTx'], 1)
+
+        self.log.info("The snapshot chainstate is removed on restart")
+        snapshot_dir = os.path.join(n1.datadir, self.chain, 'chainstate_' + dump['base_hash'])
+        assert os.path.isdir(snapshot_dir)
+        with n1.assert_debug_log(expected_msgs=["Removing the coins database of a UTXO snapshot loaded before the restart"]):
+            self.restart_node(1)
+        assert not os.path.exists(snapshot_dir)
+        self.wait_until(lambda: self.nodes[1].getblockcount() == SNAPSHOT_BASE_HEIGHT + 10)
+        assert_equal(self.nodes[1].gettxoutsetinfo()['hash_serialized_2'], n0.gettxoutsetinfo()['hash_serialized_2'])
+
+
+if __name__ == '__main__':
+    AssumeutxoTest().main()
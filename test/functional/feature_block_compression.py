@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test compressed block storage.
+
+- Rewrite the block files of a node compressed with -compressblocks -rewriteblockfiles,
+  and verify that blocks, undo data and the txindex are still served.
+- Add compressed blocks, reindex from the compressed files, and rewrite the
+  block files uncompressed again.
+"""
+import os
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    assert_greater_than_or_equal,
+)
+
+
+class BlockCompressionTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.extra_args = [["-txindex"]]
+
+    def blk_file_sizes(self):
+        blocks_dir = os.path.join(self.nodes[0].datadir, self.chain, 'blocks')
+        return [os.path.getsize(os.path.join(blocks_dir, name)) for name in ('blk00000.dat', 'rev00000.dat')]
+
+    def check_node(self, blocks):
+        node = self.nodes[0]
+        assert_equal(node.getblockcount(), len(blocks) - 1)
+        for height, block in enumerate(blocks):
+            assert_equal(node.getblock(node.getblockhash(height), 0), block)
+        # Reads the undo data of all blocks
+        node.verifychain(4, 0)
+        node.getrawtransaction(self.spend_txid)
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.get_deterministic_priv_key().address
+        self.log.info("Add a block with a spend, to fill the undo data and txindex")
+        prevtx = node.getblock(node.getblockhash(1), 2)['tx'][0]
+        rawtx = node.createrawtransaction(
+            inputs=[{'txid': prevtx['txid'], 'vout': 0}],
+            outputs=[{address: 50 - 0.00125}],
+        )
+        sigtx = node.signrawtransactionwithkey(
+            hexstring=rawtx,
+            privkeys=[node.get_deterministic_priv_key().key],
+            prevtxs=[{
+                'txid': prevtx['txid'],
+                'vout': 0,
+                'scriptPubKey': prevtx['vout'][0]['scriptPubKey']['hex'],
+            }],
+        )['hex']
+        self.spend_txid = node.sendrawtransaction(sigtx)
+        node.generatetoaddress(1, address)
+        self.sync_index(node)
+        blocks = [node.getblock(node.getblockhash(height), 0) for height in range(node.getblockcount() + 1)]
+
+        self.log.info("Rewrite the block files compressed")
+        self.stop_node(0)
+        with node.assert_debug_log(["Rewriting block file 0"]):
+            self.start_node(0, extra_args=["-txindex", "-compressblocks", "-rewriteblockfiles"])
+        self.sync_index(node)
+        self.check_node(blocks)
+        self.stop_node(0)
+        compressed_sizes = self.blk_file_sizes()
+
+        self.log.info("A second rewrite in the same format does nothing")
+        with node.assert_debug_log(expected_msgs=[], unexpected_msgs=["Rewriting block file 0"]):
+            self.start_node(0, extra_args=["-txindex", "-compressblocks", "-rewriteblockfiles"])
+
+        self.log.info("Add compressed blocks and reindex from the compressed block files")
+        node.generatetoaddress(5, address)
+        blocks += [node.getblock(node.getblockhash(height), 0) for height in range(len(blocks), node.getblockcount() + 1)]
+        self.stop_node(0)
+        self.start_node(0, extra_args=["-txindex", "-compressblocks", "-reindex"])
+        self.sync_index(node)
+        self.check_node(blocks)
+
+        self.log.info("Rewrite the block files uncompressed")
+        self.stop_node(0)
+        with node.assert_debug_log(["Rewriting block file 0"]):
+            self.start_node(0, extra_args=["-txindex", "-rewriteblockfiles"])
+        self.sync_index(node)
+        self.check_node(blocks)
+        self.stop_node(0)
+        uncompressed_sizes = self.blk_file_sizes()
+        assert_greater_than(uncompressed_sizes[0], compressed_sizes[0])
+        assert_greater_than_or_equal(uncompressed_sizes[1], compressed_sizes[1])
+
+    def sync_index(self, node):
+        # The spend is only found once the txindex has caught up
+        def spend_found():
+            try:
+                node.getrawtransaction(self.spend_txid)
+                return True
+            except JSONRPCException:
+                return False
+        self.wait_until(spend_found)
+
+
+if __name__ == '__main__':
+    BlockCompressionTest().main()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the block index cache (-blockindexcache).
+
+- A node shutting down with -blockindexcache writes the cache, and loads the
+  block index from it on restart.
+- Changes to the block index after the cache was written invalidate it.
+- A corrupt cache is ignored.
+"""
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+LOADED_FROM_CACHE = "LoadBlockIndexCache: loaded {} block index entries from cache"
+
+
+class BlockIndexCacheTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.extra_args = [["-blockindexcache"]]
+
+    def restart_and_check(self, expected_msgs=None, unexpected_msgs=None, extra_args=None):
+        node = self.nodes[0]
+        best_hash = node.getbestblockhash()
+        chainwork = node.getblockheader(best_hash)['chainwork']
+        self.stop_node(0)
+        with node.assert_debug_log(expected_msgs=expected_msgs or [], unexpected_msgs=unexpected_msgs or []):
+            self.start_node(0, extra_args=extra_args)
+        assert_equal(node.getbestblockhash(), best_hash)
+        assert_equal(node.getblockheader(best_hash)['chainwork'], chainwork)
+
+    def run_test(self):
+        node = self.nodes[0]
+        cache_path = os.path.join(node.datadir, self.chain, 'blocks', 'index.cache')
+
+        self.log.info("Load the block index from the cache written at shutdown")
+        node.generate(10)
+        self.restart_and_check(expected_msgs=[LOADED_FROM_CACHE.format(211)], extra_args=["-blockindexcache"])
+        assert os.path.isfile(cache_path)
+
+        self.log.info("Changes to the block index invalidate the cache unless it is written again")
+        self.restart_and_check(unexpected_msgs=["from cache"], extra_args=["-blockindexcache=0"])
+        node.generate(5)
+        self.restart_and_check(unexpected_msgs=["from cache"], extra_args=["-blockindexcache"])
+        node.invalidateblock(node.getbestblockhash())
+        self.restart_and_check(expected_msgs=[LOADED_FROM_CACHE.format(216)], extra_args=["-blockindexcache"])
+        assert_equal(node.getblockcount(), 214)
+
+        self.log.info("A corrupt cache is ignored")
+        best_hash = node.getbestblockhash()
+        self.stop_node(0)
+        with open(cache_path, 'r+b') as f:
+            f.seek(-1, os.SEEK_END)
+            last_byte = f.read(1)
+            f.seek(-1, os.SEEK_END)
+            f.write(bytes([last_byte[0] ^ 1]))
+        with node.assert_debug_log(
+            expected_msgs=["LoadBlockIndexCache: block index cache does not match the block tree database"],
+            unexpected_msgs=["from cache"],
+        ):
+            self.start_node(0, extra_args=["-blockindexcache"])
+        assert_equal(node.getbestblockhash(), best_hash)
+
+
+if __name__ == '__main__':
+    BlockIndexCacheTest().main()
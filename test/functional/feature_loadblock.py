@@ -8,9 +8,12 @@ Test the option to start a node with the option loadblock which loads
 a serialized blockchain from a file (usually called bootstrap.dat).
 To generate that file this test uses the helper scripts available
 in contrib/linearize.
+
+Then import blocks that are out of order and spread over several files.
 """
 
 import os
+import struct
 import subprocess
 import sys
 import tempfile
@@ -77,6 +80,21 @@ class LoadblockTest(BitcoinTestFramework):
         assert_equal(self.nodes[1].getblockchaininfo()['blocks'], 100)
         assert_equal(self.nodes[0].getbestblockhash(), self.nodes[1].getbestblockhash())
 
+        self.log.info("Import out of order blocks from several files")
+        self.nodes[0].generate(20)
+        heights = [list(range(111, 121)), list(reversed(range(101, 111)))]
+        block_files = []
+        for i, file_heights in enumerate(heights):
+            block_file = os.path.join(self.options.tmpdir, "blocks{}.dat".format(i))
+            with open(block_file, "wb") as f:
+                for height in file_heights:
+                    block = bytes.fromhex(self.nodes[0].getblock(self.nodes[0].getblockhash(height), 0))
+                    f.write(bytes.fromhex("fabfb5da") + struct.pack("<I", len(block)) + block)
+            block_files.append(block_file)
+        self.restart_node(1, extra_args=["-loadblock=" + f for f in block_files])
+        assert_equal(self.nodes[1].getblockcount(), 120)
+        assert_equal(self.nodes[0].getbestblockhash(), self.nodes[1].getbestblockhash())
+
 
 if __name__ == '__main__':
     LoadblockTest().main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test signature and script execution cache persistence.
+
+By default, bitcoind dumps the signature and script execution caches to
+sigcache.dat on shutdown and reloads them on startup. This can be overridden
+with the -persistsigcache=0 command line option.
+"""
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+)
+
+
+def total_inserts(node):
+    info = node.getsigcacheinfo()
+    return info['signatures']['inserts'], info['script_executions']['inserts']
+
+
+class SigCachePersistTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+
+    def run_test(self):
+        node = self.nodes[0]
+        sigcachedat = os.path.join(node.datadir, self.chain, 'sigcache.dat')
+
+        self.log.info("Fill the caches by accepting a transaction to the mempool")
+        prevtx = node.getblock(node.getblockhash(1), 2)['tx'][0]
+        rawtx = node.createrawtransaction(
+            inputs=[{'txid': prevtx['txid'], 'vout': 0}],
+            outputs=[{node.get_deterministic_priv_key().address: 50 - 0.00125}],
+        )
+        sigtx = node.signrawtransactionwithkey(
+            hexstring=rawtx,
+            privkeys=[node.get_deterministic_priv_key().key],
+            prevtxs=[{
+                'txid': prevtx['txid'],
+                'vout': 0,
+                'scriptPubKey': prevtx['vout'][0]['scriptPubKey']['hex'],
+            }],
+        )['hex']
+        node.sendrawtransaction(sigtx)
+        inserts = total_inserts(node)
+        assert_greater_than(inserts[0], 0)
+        assert_greater_than(inserts[1], 0)
+
+        # The mempool is not persisted in this test, so that only loading
+        # sigcache.dat fills the caches.
+        self.log.info("Restart the node. Verify that it loads the caches from sigcache.dat")
+        self.stop_node(0)
+        assert os.path.isfile(sigcachedat)
+        with node.assert_debug_log(["Imported signature caches from disk"]):
+            self.start_node(0, extra_args=["-persistmempool=0"])
+        assert_equal(total_inserts(node), inserts)
+
+        self.log.info("Restart the node with -persistsigcache=0. Verify that it starts with empty caches")
+        self.stop_node(0)
+        self.start_node(0, extra_args=["-persistmempool=0", "-persistsigcache=0"])
+        assert_equal(total_inserts(node), (0, 0))
+
+        self.log.info("Verify that -persistsigcache=0 did not overwrite sigcache.dat")
+        self.stop_node(0)
+        with node.assert_debug_log(["Imported signature caches from disk"]):
+            self.start_node(0, extra_args=["-persistmempool=0"])
+        assert_equal(total_inserts(node), inserts)
+
+        self.log.info("Verify that the loaded entries are hit by mempool acceptance and block validation")
+        node.sendrawtransaction(sigtx)
+        assert_greater_than(node.getsigcacheinfo()['signatures']['hits'], 0)
+        node.generatetoaddress(1, node.get_deterministic_priv_key().address)
+        assert_greater_than(node.getsigcacheinfo()['script_executions']['hits'], 0)
+
+        self.log.info("Verify that a sigcache.dat of another version is ignored")
+        self.stop_node(0)
+        with open(sigcachedat, 'wb') as f:
+            f.write(bytes(8))
+        with node.assert_debug_log(["Signature cache file has unknown version 0"]):
+            self.start_node(0, extra_args=["-persistmempool=0"])
+        assert_equal(total_inserts(node), (0, 0))
+
+
+if __name__ == '__main__':
+    SigCachePersistTest().main()
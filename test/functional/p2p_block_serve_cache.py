@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the cache of serialized recent blocks served to peers.
+
+Recent blocks requested by peers are served from the cache once serialized,
+separately for each serialization, while old blocks are not cached. The cache
+statistics are reported by getblockservecacheinfo.
+"""
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.messages import (
+    CInv,
+    MSG_BLOCK,
+    MSG_CMPCT_BLOCK,
+    MSG_WITNESS_FLAG,
+    msg_getdata,
+)
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+class P2PBlockServeCacheTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def request(self, peer, inv_type, block_hash, msg_type):
+        peer.last_message.pop(msg_type, None)
+        peer.send_and_ping(msg_getdata([CInv(inv_type, int(block_hash, 16))]))
+        assert msg_type in peer.last_message
+        return peer.last_message[msg_type]
+
+    def run_test(self):
+        node = self.nodes[0]
+        hashes = node.generatetoaddress(20, ADDRESS_BCRT1_UNSPENDABLE)
+        peer = node.add_p2p_connection(P2PInterface())
+
+        info = node.getblockservecacheinfo()
+        assert_equal(info['max_usage'], 32 << 20)
+        assert_equal(info['entries'], 0)
+        assert_equal(info['hit_rate'], 0)
+
+        self.log.info("A recent block is serialized once, and served from the cache afterwards")
+        first = self.request(peer, MSG_BLOCK | MSG_WITNESS_FLAG, hashes[-1], "block")
+        second = self.request(peer, MSG_BLOCK | MSG_WITNESS_FLAG, hashes[-1], "block")
+        first.block.rehash()
+        second.block.rehash()
+        assert_equal(first.block.hash, hashes[-1])
+        assert_equal(second.block.serialize(), first.block.serialize())
+        info = node.getblockservecacheinfo()
+        assert_equal((info['hits'], info['misses'], info['inserts'], info['entries']), (1, 1, 1, 1))
+        assert_equal(info['hit_rate'], 0.5)
+
+        self.log.info("Each serialization is cached separately")
+        self.request(peer, MSG_BLOCK, hashes[-1], "block")
+        self.request(peer, MSG_CMPCT_BLOCK, hashes[-1], "cmpctblock")
+        self.request(peer, MSG_CMPCT_BLOCK, hashes[-1], "cmpctblock")
+        info = node.getblockservecacheinfo()
+        assert_equal((info['hits'], info['misses'], info['inserts'], info['entries']), (2, 3, 3, 3))
+        assert info['usage'] > 0
+
+        self.log.info("Old blocks are not cached")
+        self.request(peer, MSG_BLOCK | MSG_WITNESS_FLAG, hashes[0], "block")
+        assert_equal(node.getblockservecacheinfo()['entries'], 3)
+
+        self.log.info("A cache without memory budget caches nothing")
+        self.restart_node(0, extra_args=['-blockservecache=0'])
+        peer = node.add_p2p_connection(P2PInterface())
+        self.request(peer, MSG_BLOCK | MSG_WITNESS_FLAG, hashes[-1], "block")
+        self.request(peer, MSG_BLOCK | MSG_WITNESS_FLAG, hashes[-1], "block")
+        info = node.getblockservecacheinfo()
+        assert_equal((info['hits'], info['inserts'], info['max_usage']), (0, 0, 0))
+
+
+if __name__ == '__main__':
+    P2PBlockServeCacheTest().main()
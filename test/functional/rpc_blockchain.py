@@ -60,6 +60,7 @@ class BlockchainTest(BitcoinTestFramework):
         self._test_gettxoutsetinfo()
         self._test_getblockheader()
         self._test_getdifficulty()
+        self._test_getsigcacheinfo()
         self._test_getnetworkhashps()
         self._test_stopatheight()
         self._test_waitforblockheight()
@@ -286,6 +287,16 @@ class BlockchainTest(BitcoinTestFramework):
         # binary => decimal => binary math is why we do this check
         assert abs(difficulty * 2**31 - 1) < 0.0001
 
+    def _test_getsigcacheinfo(self):
+        self.log.info("Test getsigcacheinfo")
+        info = self.nodes[0].getsigcacheinfo()
+        for cache in ['signatures', 'script_executions']:
+            stats = info[cache]
+            assert_equal(len(stats['shards']), 16)
+            for key in ['hits', 'misses', 'inserts', 'evictions', 'max_entries']:
+                assert_equal(stats[key], sum(shard[key] for shard in stats['shards']))
+            assert_greater_than(stats['max_entries'], 0)
+
     def _test_getnetworkhashps(self):
         hashes_per_second = self.nodes[0].getnetworkhashps()
         # This should be 2 hashes every 10 minutes or 1/300
@@ -36,12 +36,17 @@ class DumptxoutsetTest(BitcoinTestFramework):
         assert_equal(
             out['base_hash'],
             '6fd417acba2a8738b06fee43330c50d58e6a725046c3d843c8dd7e51d46d1ed6')
+        # The UTXO set hash matches the regtest assumeutxo data at height 100.
+        assert_equal(
+            out['txoutset_hash'],
+            'd4b614f476b99a6e569973bf1c0120d88b1a168076f8ce25691fb41dd1cef149')
+        assert_equal(out['txoutset_hash'], node.gettxoutsetinfo()['hash_serialized_2'])
 
         with open(str(expected_path), 'rb') as f:
             digest = hashlib.sha256(f.read()).hexdigest()
             # UTXO snapshot hash should be deterministic based on mocked time.
             assert_equal(
-                digest, 'be032e5f248264ba08e11099ac09dbd001f6f87ffc68bf0f87043d8146d50664')
+                digest, '535a50290f66c8e68832878e8a2d51e3ed5f062b9284fe75a61fdde0d3ac8fa0')
 
         # Specifying a path to an existing file will fail.
         assert_raises_rpc_error(